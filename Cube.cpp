@@ -1,8 +1,14 @@
 #define GLFW_INCLUDE_VULKAN
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #define VK_USE_PLATFORM_WIN32_KHR 
+// Keeps windows.h, included by vulkan.h, from defining min and max macros
+#define NOMINMAX
+#endif
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -10,32 +16,109 @@
 #include <glm/mat4x4.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <array>
 #include <chrono>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <numeric>
+
+// SSE2 is always there on x64, the texture kernels and the transform store
+// build on it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define SIMD_SSE2
+#endif
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "include/stb_image.h"
+#define RANGE_ALLOCATOR_IMPLEMENTATION
+#include "include/range_allocator.h"
+#define MESH_OPTIMIZER_IMPLEMENTATION
+#include "include/mesh_optimizer.h"
+#define MESHLET_IMPLEMENTATION
+#include "include/meshlet.h"
+#define TRANSFORM_STORE_IMPLEMENTATION
+#include "include/transform_store.h"
+#define KTX2_IMPLEMENTATION
+#include "include/ktx2.h"
+#define ASSET_ARCHIVE_IMPLEMENTATION
+#include "include/asset_archive.h"
+#define TEXTURE_RESIDENCY_IMPLEMENTATION
+#include "include/texture_residency.h"
+
+// Per-instance attributes, a mat4 takes one location per column
+struct InstanceData
+{
+	glm::mat4 model;
+
+	static std::array<VkVertexInputAttributeDescription, 4>
+	getAttributeDescriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions =
+			{};
+
+		for (uint32_t i = 0; i < attributeDescriptions.size(); i++)
+		{
+			attributeDescriptions[i].binding = 1;
+			attributeDescriptions[i].location = 2 + i;
+			attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[i].offset = offsetof(InstanceData, model) +
+				i * sizeof(glm::vec4);
+		}
+
+		return attributeDescriptions;
+	}
+};
 
 struct Vertex
 {
 	glm::vec3 position;
 	glm::vec3 color;
 
-	static VkVertexInputBindingDescription getBindingDescription()
+	// Binding 1 streams one InstanceData per instance in instanced mode
+	static std::array<VkVertexInputBindingDescription, 2>
+	getBindingDescriptions()
 	{
-		VkVertexInputBindingDescription bindingDescription = {};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		std::array<VkVertexInputBindingDescription, 2> bindingDescriptions =
+			{};
 
-		return bindingDescription;
+		bindingDescriptions[0].binding = 0;
+		bindingDescriptions[0].stride = sizeof(Vertex);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		bindingDescriptions[1].binding = 1;
+		bindingDescriptions[1].stride = sizeof(InstanceData);
+		bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return bindingDescriptions;
 	}
 
 	static std::array<VkVertexInputAttributeDescription, 2>
@@ -58,6 +141,35 @@ struct Vertex
 	}
 };
 
+// Compressed vertex, 12 bytes against 24 for Vertex. Same bindings and
+// locations, the packed vertex shaders dequantize it
+struct PackedVertex
+{
+	// Position in the mesh bounding box, 16 bits per axis. The fourth
+	// component holds the octahedral normal, 8 bits per axis
+	uint16_t position[4];
+	uint8_t color[4]; // RGBA8
+
+	static std::array<VkVertexInputAttributeDescription, 2>
+	getAttributeDescriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions =
+			{};
+
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UINT;
+		attributeDescriptions[0].offset = offsetof(PackedVertex, position);
+
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attributeDescriptions[1].offset = offsetof(PackedVertex, color);
+
+		return attributeDescriptions;
+	}
+};
+
 #define S_CUBE 0.5
 
 const std::vector<Vertex> vertices = {
@@ -88,11 +200,36 @@ struct UniformBufferObject
 	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
+	// World space planes of proj * view * model, inward facing, read by the
+	// culling pass only
+	glm::vec4 frustumPlanes[6];
+	// proj * view * model of the previous frame, the one the depth pyramid
+	// was built from
+	glm::mat4 previousClip;
+	// Packed vertex positions are positionOffset + position * positionScale
+	glm::vec4 positionOffset;
+	glm::vec4 positionScale;
+	// Eye in the space of model, for the cluster cone test
+	glm::vec4 cameraPosition;
 };
 
+// Objects with their own UniformBufferObject slice in each ring slot
+const uint32_t UNIFORM_OBJECT_COUNT = 1;
+
 const int WIDTH = 800;
 const int HEIGHT = 600;
 
+// Frames rendered before the benchmark starts measuring
+const uint32_t DEFAULT_WARMUP_FRAMES = 100;
+
+// Frames rendered by --headless when no --benchmark count is given
+const uint32_t DEFAULT_HEADLESS_FRAMES = 1000;
+
+// Number of frames the CPU may record ahead of the GPU
+//
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
 const std::vector<const char*> validationLayers{
 	//"VK_LAYER_LUNARG_standard_validation"
 };
@@ -109,6 +246,9 @@ static VkResult vk_res = VK_SUCCESS;
 
 #define APP_NAME "Vulkan Cube";
 
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+
+#ifdef _WIN32
 struct HWND_INFO
 {
 	HINSTANCE hInstance;
@@ -116,6 +256,104 @@ struct HWND_INFO
 };
 
 static HWND_INFO s_hInfos;
+#endif
+
+static GLFWwindow* s_window;
+
+struct AppOptions
+{
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	uint32_t deviceIndex = 0;
+	uint32_t benchmarkFrames = 0;
+	uint32_t warmupFrames = DEFAULT_WARMUP_FRAMES;
+	// .json for a summary, anything else for per-frame CSV
+	std::string benchmarkOutput;
+	// Render offscreen, no window, surface nor swapchain
+	bool headless = false;
+	uint32_t width = WIDTH;
+	uint32_t height = HEIGHT;
+	// Cubes drawn from the instance buffer, 0 for the single uniform cube
+	uint32_t instanceCount = 0;
+	// Recompose every instance matrix on the CPU each frame
+	bool animateInstances = false;
+	// Time the transform kernels against glm and exit
+	bool transformBenchmark = false;
+	// Record every frame with secondary buffers on this many threads, 0 for
+	// buffers recorded once per swap image
+	uint32_t recordThreads = 0;
+	// Record every frame into a transient pool, inline on this thread
+	bool recordPerFrame = false;
+	// Instances per draw call, 0 draws them all at once
+	uint32_t instancesPerDraw = 0;
+	// Frustum cull the instances in a compute pass, drawn indirectly
+	bool gpuCulling = false;
+	// Also test them against a depth pyramid of the previous frame
+	bool occlusionCulling = false;
+	// .obj or .glb model drawn instead of the cube
+	std::string meshFile;
+	// Reorder the mesh for the vertex cache and vertex fetch at load
+	bool optimizeMesh = false;
+	// Also sort its triangle clusters against overdraw
+	bool optimizeOverdraw = false;
+	// Upload PackedVertex instead of Vertex
+	bool packedVertices = false;
+	// Split the mesh in clusters culled by the GPU culling pass
+	bool meshlets = false;
+	// .ktx2 of BC blocks, or an image stb_image reads, instead of
+	// textures/texture.jpg
+	std::string textureFile;
+	// Time minified texture sampling with and without the mip chain after
+	// the headless run
+	bool textureBenchmark = false;
+	// MiB of streamed KTX2 texture levels, 0 uploads every level at load
+	uint32_t textureBudget = 0;
+	// Packed assets mapped at startup, looked up before loose files
+	std::string archiveFile;
+};
+
+static AppOptions s_options;
+
+// Device memory sub-allocation
+//
+// Resources are placed in large VkDeviceMemory blocks, one list of blocks
+// per memory type. Each block keeps its free ranges sorted by offset, see
+// range_allocator.h: an allocation takes the best fitting range and freed
+// ranges are merged back with their neighbours.
+
+// Preferred block size, smaller on small heaps
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint8_t* mapped; // Whole block mapped if host visible, null otherwise
+	uint32_t allocationCount;
+	std::vector<MemoryRange> freeRanges;
+};
+
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint8_t* mapped = nullptr;
+	uint32_t memoryTypeIndex = 0;
+	MemoryBlock* block = nullptr;
+};
+
+struct MemoryStats
+{
+	VkDeviceSize bytesUsed;
+	VkDeviceSize bytesReserved;
+	uint32_t allocationCount;
+	uint32_t blockCount;
+};
+
+static VkPhysicalDeviceMemoryProperties s_memoryProperties;
+static std::vector<std::unique_ptr<MemoryBlock>>
+s_memoryBlocks[VK_MAX_MEMORY_TYPES];
+static MemoryStats s_memoryStats;
 
 static VkInstance s_instance;
 
@@ -124,24 +362,84 @@ static std::vector<const char*> s_deviceExtensionNames;
 
 static uint32_t s_presentQueueFamilyIndex;
 static uint32_t s_graphicQueueFamilyIndex;
+static uint32_t s_transferQueueFamilyIndex;
 
 static std::vector<VkPhysicalDevice> s_physicalDevices;
 static VkPhysicalDevice s_physicalDevice;
+static VkPhysicalDeviceProperties s_physicalDeviceProperties;
+static VkPhysicalDeviceFeatures s_enabledFeatures;
+// VK_KHR_get_physical_device_properties2 enabled on the 1.0 instance
+static bool s_instanceProperties2 = false;
+// Heap budgets of VK_EXT_memory_budget, null when it is not supported
+static PFN_vkGetPhysicalDeviceMemoryProperties2KHR s_getMemoryProperties2;
+static uint32_t s_timestampValidBits; // 0 when the queue has no timestamps
 static VkDevice s_logicalDevice;
 
 static VkCommandPool s_commandPool;
 static VkCommandPool s_commandTransferPool;
+
+// Upload batch: pending copies and barriers recorded into one command buffer,
+// submitted once. Staging buffers are released together when its fence
+// signals.
+//
+// With a dedicated transfer queue the copies run there and the resources are
+// released to the graphics family; the matching acquire barriers are
+// recorded in a second command buffer submitted on the graphics queue.
+struct StagingBuffer
+{
+	VkBuffer buffer;
+	MemoryAllocation memory;
+};
+
+static VkCommandBuffer s_uploadCommandBuffer;
+static VkCommandBuffer s_uploadAcquireCommandBuffer;
+static bool s_uploadBatchOpen = false;
+static VkSemaphore s_uploadSemaphore;
+static VkFence s_uploadFence;
+static std::vector<StagingBuffer> s_uploadStagingBuffers;
+static std::vector<VkBufferMemoryBarrier> s_uploadBufferAcquires;
+static std::vector<VkImageMemoryBarrier> s_uploadImageAcquires;
+
+// Images whose levels are blitted from level 0 at submission, on the
+// graphics queue: transfer queues cannot blit
+struct PendingMipChain
+{
+	VkImage image;
+	VkExtent2D extent;
+	uint32_t mipLevels;
+};
+
+static std::vector<PendingMipChain> s_uploadMipChains;
 static VkBuffer s_vertexBuffer;
-static VkDeviceMemory s_vertexBufferMemory;
+static MemoryAllocation s_vertexBufferMemory;
 static VkBuffer s_indexBuffer;
-static VkDeviceMemory s_indexBufferMemory;
-static std::vector<VkBuffer> s_uniformBuffers;
-static std::vector<VkDeviceMemory> s_uniformBuffersMemory;
+static MemoryAllocation s_indexBufferMemory;
+static VkBuffer s_instanceBuffer;
+static MemoryAllocation s_instanceBufferMemory;
+static uint32_t s_instanceRingSlots; // Animated instances only
+// Camera distance factor so the whole instance grid fits in view
+static float s_sceneScale = 1.0f;
+// Instance slices of the animated and visible rings, aligned for dynamic
+// storage buffer offsets
+static VkDeviceSize s_instanceSliceSize;
+// Uniform ring buffer, persistently mapped by the memory manager. One slot
+// per swap image holding UNIFORM_OBJECT_COUNT aligned slices, bound through
+// dynamic offsets.
+static VkBuffer s_uniformBuffer;
+static MemoryAllocation s_uniformBufferMemory;
+static VkDeviceSize s_uniformSliceSize;
+static uint32_t s_uniformRingSlots;
 static VkDescriptorPool s_descriptorPool;
-static std::vector<VkDescriptorSet> s_descriptorSets;
+static VkDescriptorSet s_descriptorSet;
 static std::vector<VkCommandBuffer> s_commandBuffers;
 // Rendering command buffers, one for each swap image
 
+// Per frame recording, indexed by frame slot (and job for secondaries)
+static std::vector<VkCommandPool> s_frameCommandPools;
+static std::vector<VkCommandBuffer> s_frameCommandBuffers;
+static std::vector<VkCommandPool> s_jobCommandPools;
+static std::vector<VkCommandBuffer> s_secondaryCommandBuffers;
+
 static VkSurfaceKHR s_surfaceKHR;
 
 static VkSwapchainKHR s_swapChain;
@@ -150,26 +448,527 @@ static VkSurfaceFormatKHR s_swapChainFormat;
 static std::vector<VkImageView> s_swapChainImagesViews;
 static std::vector<VkFramebuffer> s_swapChainBuffers;
 
+// Headless render targets, they stand in for the swap images
+static std::vector<VkImage> s_offscreenImages;
+static std::vector<MemoryAllocation> s_offscreenImagesMemory;
+
 static VkImage s_depthImage;
-static VkDeviceMemory s_depthImageMemory;
+static MemoryAllocation s_depthImageMemory;
 static VkImageView s_depthImageView;
 
 // Texture
 static VkImage s_textureImage;
 static VkImageView s_textureImageView;
-static VkDeviceMemory s_textureImageMemory;
+static VkFormat s_textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+static VkExtent2D s_textureExtent;
+static uint32_t s_textureMipLevels = 1;
+static MemoryAllocation s_textureImageMemory;
 
 static VkQueue s_graphicsQueue;
+// Same as s_graphicsQueue without a dedicated transfer family
+static VkQueue s_transferQueue;
 static VkRenderPass s_renderPass;
 static VkPipeline s_graphicsPipeline;
+static VkPipelineCache s_pipelineCache;
+static bool s_pipelineCacheWarm;
 static VkDescriptorSetLayout s_descriptorLayout;
 static VkPipelineLayout s_pipelineLayout;
 
-static VkSemaphore s_imageAvailableSemaphore;
-static VkSemaphore s_renderFinishedSemaphore;
+// GPU culling
+//
+// A compute pass tests every instance against the frustum, appends the
+// visible ones to the visible ring and counts them in the draw command of
+// the cull output ring. Both rings have one slice per swap image.
+
+// Keep in sync with local_size_x of cull.comp
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// Layout of cull.comp Output, counters are read back after the fence
+struct CullOutput
+{
+	VkDrawIndexedIndirectCommand draw;
+	uint32_t frustumRejected;
+	uint32_t occlusionRejected;
+	uint32_t coneRejected;
+};
+
+struct CullConstants
+{
+	glm::vec4 boundingSphere; // Mesh space center and radius
+	glm::vec4 boundingBox; // Half extents around the sphere center
+	uint32_t instanceCount;
+	uint32_t hiZLevels;
+};
+
+enum CullCounter
+{
+	CULL_VISIBLE,
+	CULL_FRUSTUM_REJECTED,
+	CULL_OCCLUSION_REJECTED,
+	CULL_CONE_REJECTED,
+	CULL_COUNTER_COUNT
+};
+
+static const char* CULL_COUNTER_NAMES[CULL_COUNTER_COUNT] = {
+	"visible", "frustum_rejected", "occlusion_rejected", "cone_rejected"
+};
+
+static VkDescriptorSetLayout s_cullDescriptorLayout;
+static VkPipelineLayout s_cullPipelineLayout;
+static VkPipeline s_cullPipeline;
+static VkDescriptorSet s_cullDescriptorSet;
+static VkBuffer s_visibleInstanceBuffer;
+static MemoryAllocation s_visibleInstanceBufferMemory;
+static VkBuffer s_cullOutputBuffer;
+static MemoryAllocation s_cullOutputBufferMemory;
+static VkDeviceSize s_cullOutputSliceSize;
+static uint32_t s_cullRingSlots;
+
+// With --meshlets the pass culls the clusters of the mesh instead, through
+// cluster_cull.comp with the same bindings: the clusters in place of the
+// source instances, one draw per cluster in place of the visible instances.
+// Culled clusters get a draw of 0 instances, the draws keep their order.
+
+// Layout of cluster_cull.comp Meshlet
+struct GpuMeshlet
+{
+	glm::vec4 boundingSphere; // Mesh space center and radius
+	glm::vec4 coneApex;
+	glm::vec4 coneAxis; // Cutoff in w
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t padding[2];
+};
+
+static VkBuffer s_meshletBuffer;
+static MemoryAllocation s_meshletBufferMemory;
+static uint32_t s_meshletCount;
+static VkBuffer s_clusterDrawBuffer;
+static MemoryAllocation s_clusterDrawBufferMemory;
+static VkDeviceSize s_clusterDrawSliceSize;
+
+// Hierarchical depth for occlusion culling
+//
+// At the end of each frame a compute pass reduces the depth buffer into a
+// pyramid keeping the farthest depth under each texel, level 0 being half
+// the depth resolution. The culling pass of the next frame reads it. The
+// pyramid stays in the general layout and is shared by the frames in flight
+// like the depth buffer, submission order keeps them in sequence.
+
+// Keep in sync with local_size of hiz.comp
+const uint32_t HIZ_GROUP_SIZE = 8;
+
+// Enough for a 65536 pixels wide depth buffer
+const uint32_t HIZ_MAX_LEVELS = 16;
+
+static VkImage s_hiZImage;
+static MemoryAllocation s_hiZImageMemory;
+static VkImageView s_hiZImageView; // All levels, read by the culling pass
+static std::vector<VkImageView> s_hiZLevelViews;
+static VkExtent2D s_hiZExtent;
+static uint32_t s_hiZLevels;
+static VkSampler s_hiZSampler;
+static VkDescriptorSetLayout s_hiZDescriptorLayout;
+static VkPipelineLayout s_hiZPipelineLayout;
+static VkPipeline s_hiZPipeline;
+// One per level, reading the level below or the depth buffer
+static VkDescriptorSet s_hiZDescriptorSets[HIZ_MAX_LEVELS];
+static VkCommandBuffer s_hiZClearCommandBuffer;
+
+// Frames in flight
+static std::vector<VkSemaphore> s_imageAvailableSemaphores;
+static std::vector<VkSemaphore> s_renderFinishedSemaphores;
+static std::vector<VkFence> s_inFlightFences;
+// Fence of the frame currently using each swap image, or null
+static std::vector<VkFence> s_imagesInFlight;
+static uint32_t s_currentFrame = 0;
+
+// GPU queries, one range per swap image like the command buffers
+//
+enum TimestampQuery
+{
+	TIMESTAMP_CULL_BEGIN,
+	TIMESTAMP_CULL_END,
+	TIMESTAMP_PASS_BEGIN,
+	TIMESTAMP_DRAW_BEGIN,
+	TIMESTAMP_DRAW_END,
+	TIMESTAMP_PASS_END,
+	TIMESTAMP_HIZ_BEGIN,
+	TIMESTAMP_HIZ_END,
+	TIMESTAMP_QUERY_COUNT
+};
+
+// Results come in bit order of VkQueryPipelineStatisticFlagBits
+enum PipelineStatistic
+{
+	STATISTIC_VERTEX_INVOCATIONS,
+	STATISTIC_CLIPPING_PRIMITIVES,
+	STATISTIC_FRAGMENT_INVOCATIONS,
+	PIPELINE_STATISTIC_COUNT
+};
+
+static const char* PIPELINE_STATISTIC_NAMES[PIPELINE_STATISTIC_COUNT] = {
+	"vertex_invocations", "clipping_primitives", "fragment_invocations"
+};
+
+const VkQueryPipelineStatisticFlags STATISTICS_QUERY_FLAGS =
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+static VkQueryPool s_timestampQueryPool;
+static VkQueryPool s_statisticsQueryPool;
+// Set once a swap image's queries were submitted and not read back yet
+static std::vector<bool> s_queryResultsPending;
+
+// Frame timings, filled by drawFrame() for the benchmark report
+//
+typedef std::chrono::high_resolution_clock::time_point TimePoint;
+
+enum FrameStage
+{
+	STAGE_FENCE_WAIT,
+	STAGE_ACQUIRE,
+	STAGE_UPDATE,
+	STAGE_RECORD,
+	STAGE_SUBMIT,
+	STAGE_PRESENT,
+	STAGE_FRAME,
+	STAGE_GPU_RENDER_PASS,
+	STAGE_GPU_DRAW,
+	STAGE_GPU_CULL,
+	STAGE_GPU_HIZ,
+	FRAME_STAGE_COUNT
+};
+
+static const char* FRAME_STAGE_NAMES[FRAME_STAGE_COUNT] = {
+	"fence_wait", "acquire", "update", "record", "submit", "present", "frame",
+	"gpu_render_pass", "gpu_draw", "gpu_cull", "gpu_hiz"
+};
+
+// GPU stages and statistics are those of the last frame that rendered into
+// the same swap image, read back once its fence signaled
+struct FrameTimings
+{
+	double ms[FRAME_STAGE_COUNT]; // Milliseconds per stage
+	uint64_t statistics[PIPELINE_STATISTIC_COUNT];
+	uint32_t cullCounters[CULL_COUNTER_COUNT];
+};
+
+static FrameTimings s_frameTimings;
+
+static double elapsedMs(const TimePoint& start, const TimePoint& end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Worker threads running a batch of jobs, the calling thread takes part
+//
+struct WorkerPool
+{
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	const std::function<void(uint32_t)>* job = nullptr;
+	uint32_t jobCount = 0;
+	std::atomic<uint32_t> nextJob{0};
+	uint32_t busyWorkers = 0;
+	uint64_t generation = 0;
+	bool quit = false;
+};
+
+static WorkerPool s_recordWorkers;
+
+static void runPendingJobs(WorkerPool& pool)
+{
+	for (uint32_t job = pool.nextJob++; job < pool.jobCount;
+	     job = pool.nextJob++)
+	{
+		(*pool.job)(job);
+	}
+}
+
+static void workerLoop(WorkerPool* pool)
+{
+	uint64_t generation = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			pool->wake.wait(lock, [&]
+			{
+				return pool->quit || pool->generation != generation;
+			});
+
+			if (pool->quit)
+			{
+				return;
+			}
+			generation = pool->generation;
+		}
+
+		runPendingJobs(*pool);
+
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		if (--pool->busyWorkers == 0)
+		{
+			pool->finished.notify_one();
+		}
+	}
+}
+
+static void startWorkers(WorkerPool& pool, uint32_t workerCount)
+{
+	// No worker is running, new ones wait for the next batch
+	pool.quit = false;
+	pool.generation = 0;
+
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		pool.threads.emplace_back(workerLoop, &pool);
+	}
+}
+
+static void stopWorkers(WorkerPool& pool)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.quit = true;
+	}
+	pool.wake.notify_all();
+
+	for (auto& thread : pool.threads)
+	{
+		thread.join();
+	}
+	pool.threads.clear();
+}
+
+// Run job(0) to job(jobCount - 1) and return once all of them are done
+static void runJobs(WorkerPool& pool, uint32_t jobCount,
+                    const std::function<void(uint32_t)>& job)
+{
+	if (pool.threads.empty())
+	{
+		for (uint32_t i = 0; i < jobCount; i++)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.job = &job;
+		pool.jobCount = jobCount;
+		pool.nextJob = 0;
+		pool.busyWorkers = static_cast<uint32_t>(pool.threads.size());
+		pool.generation++;
+	}
+	pool.wake.notify_all();
+
+	runPendingJobs(pool);
+
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.finished.wait(lock, [&] { return pool.busyWorkers == 0; });
+	pool.job = nullptr;
+}
+
+// Asset archive
+//
+// With --archive, files are looked up by their relative path in a packed
+// archive made by tools/pack_assets.cpp before the disk is tried. The archive
+// is mapped once: entries stored as they are, 4 KiB aligned, are used in
+// place, so shader modules are created from the mapping and staging buffers
+// are filled straight from it. LZ4 entries are decompressed on load.
+
+// Read only view of a whole file
+struct MappedFile
+{
+	const uint8_t* data;
+	size_t size;
+};
+
+struct AssetArchive
+{
+	MappedFile file;
+	std::vector<AssetEntry> entries;
+};
+
+static AssetArchive s_assetArchive;
+
+// An asset's bytes: in the archive mapping when stored uncompressed,
+// otherwise read or decompressed into storage
+struct AssetData
+{
+	const uint8_t* mapped = nullptr;
+	std::vector<char> storage;
+	size_t size = 0;
+
+	const uint8_t* data() const
+	{
+		return mapped
+			       ? mapped
+			       : reinterpret_cast<const uint8_t*>(storage.data());
+	}
+};
+
+static bool mapFile(const std::string& filename, MappedFile& mapped)
+{
+#ifdef _WIN32
+	const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+	                                FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                                FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	const HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0
+		                       ? CreateFileMappingA(file, nullptr,
+		                                            PAGE_READONLY, 0, 0,
+		                                            nullptr)
+		                       : nullptr;
+	// The view keeps the file and the mapping open
+	const void* view = mapping
+		                   ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)
+		                   : nullptr;
+
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+
+	if (!view)
+	{
+		return false;
+	}
+
+	mapped.data = static_cast<const uint8_t*>(view);
+	mapped.size = static_cast<size_t>(size.QuadPart);
+#else
+	const int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+	void* view = fstat(file, &status) == 0 && status.st_size > 0
+		             ? mmap(nullptr, static_cast<size_t>(status.st_size),
+		                    PROT_READ, MAP_PRIVATE, file, 0)
+		             : MAP_FAILED;
+	// The mapping keeps the file open
+	close(file);
+
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+
+	mapped.data = static_cast<const uint8_t*>(view);
+	mapped.size = static_cast<size_t>(status.st_size);
+#endif
+
+	return true;
+}
+
+static void unmapFile(MappedFile& mapped)
+{
+	if (!mapped.data)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapped.data);
+#else
+	munmap(const_cast<uint8_t*>(mapped.data), mapped.size);
+#endif
+
+	mapped = {};
+}
+
+static int openAssetArchive(const std::string& filename)
+{
+	if (!mapFile(filename, s_assetArchive.file))
+	{
+		std::cerr << "Cannot map asset archive " << filename << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const char* error = assetReadIndex(s_assetArchive.file.data,
+	                                   s_assetArchive.file.size,
+	                                   s_assetArchive.entries);
+	if (error != nullptr)
+	{
+		std::cerr << filename << ": " << error << std::endl;
+		unmapFile(s_assetArchive.file);
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Asset archive " << filename << ": " << s_assetArchive.entries.
+		size() << " entries, " << s_assetArchive.file.size / 1024 <<
+		" KiB mapped" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+static void closeAssetArchive()
+{
+	unmapFile(s_assetArchive.file);
+	s_assetArchive.entries.clear();
+}
+
+// Entry of that relative path, null without archive or when it is not packed
+static const AssetEntry* findAsset(const std::string& name)
+{
+	return s_assetArchive.file.data
+		       ? assetFind(s_assetArchive.entries, name)
+		       : nullptr;
+}
+
+static AssetData readAsset(const AssetEntry& entry)
+{
+	AssetData asset;
+	asset.size = static_cast<size_t>(entry.uncompressedSize);
+
+	const uint8_t* stored = s_assetArchive.file.data + entry.offset;
+
+	if (entry.compression == ASSET_COMPRESSION_NONE)
+	{
+		asset.mapped = stored;
+		return asset;
+	}
+
+	asset.storage.resize(asset.size);
+	if (!lz4Decompress(stored, static_cast<size_t>(entry.size),
+	                   reinterpret_cast<uint8_t*>(asset.storage.data()),
+	                   asset.size))
+	{
+		throw std::runtime_error("Corrupt archive entry " + entry.name + "!");
+	}
+
+	return asset;
+}
 
 static std::vector<char> readFile(const std::string& filename)
 {
+	// Copied out of the archive, the callers keep the buffer
+	if (const AssetEntry* entry = findAsset(filename))
+	{
+		AssetData asset = readAsset(*entry);
+		if (!asset.mapped)
+		{
+			return std::move(asset.storage);
+		}
+		return std::vector<char>(asset.mapped, asset.mapped + asset.size);
+	}
+
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
 	if (!file.is_open())
@@ -189,6 +988,21 @@ static std::vector<char> readFile(const std::string& filename)
 	return buffer;
 }
 
+// From the archive mapping when the asset is packed there, otherwise read
+// from disk
+static AssetData loadAsset(const std::string& filename)
+{
+	if (const AssetEntry* entry = findAsset(filename))
+	{
+		return readAsset(*entry);
+	}
+
+	AssetData asset;
+	asset.storage = readFile(filename);
+	asset.size = asset.storage.size();
+	return asset;
+}
+
 static VkPresentModeKHR chooseSwapPresentMode(
 	const std::vector<VkPresentModeKHR>& presentModes)
 {
@@ -214,14 +1028,15 @@ static VkSurfaceFormatKHR chooseSurfaceFormat(
 	return formats[0];
 }
 
-static VkShaderModule createShaderModule(const std::vector<char>& code)
+// The SPIR-V is read in place, archive entries are 4 KiB aligned
+static VkShaderModule createShaderModule(const AssetData& code)
 {
 	VkShaderModuleCreateInfo shader_module_create_info{};
 
 	shader_module_create_info.sType =
 		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	shader_module_create_info.pNext = nullptr;
-	shader_module_create_info.codeSize = code.size();
+	shader_module_create_info.codeSize = code.size;
 	shader_module_create_info.pCode = reinterpret_cast<const uint32_t*>(code.
 		data());
 
@@ -239,13 +1054,10 @@ static VkShaderModule createShaderModule(const std::vector<char>& code)
 static uint32_t findMemoryType(uint32_t typeFilter,
                                VkMemoryPropertyFlags properties)
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(s_physicalDevice, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	for (uint32_t i = 0; i < s_memoryProperties.memoryTypeCount; i++)
 	{
-		if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags
-			& properties) == properties)
+		if (typeFilter & (1 << i) && (s_memoryProperties.memoryTypes[i].
+			propertyFlags & properties) == properties)
 		{
 			return i;
 		}
@@ -254,86 +1066,551 @@ static uint32_t findMemoryType(uint32_t typeFilter,
 	throw std::runtime_error("Failed to get a memory type for the buffer !");
 }
 
-static int createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                        VkMemoryPropertyFlags properties,
-                        VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.pNext = nullptr;
-	bufferInfo.size = size;
-	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	// Vulkan alignments are powers of two
+	return (value + alignment - 1) & ~(alignment - 1);
+}
 
-	vk_res = vkCreateBuffer(s_logicalDevice, &bufferInfo, nullptr, &buffer);
-	ASSERT_VK(vk_res);
+static void initMemoryManager()
+{
+	vkGetPhysicalDeviceMemoryProperties(s_physicalDevice, &s_memoryProperties);
+	s_memoryStats = {};
+}
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(s_logicalDevice, buffer, &memRequirements);
+static MemoryBlock* createMemoryBlock(uint32_t memoryTypeIndex,
+                                      VkDeviceSize minSize)
+{
+	if (s_memoryStats.blockCount >= s_physicalDeviceProperties.limits.
+		maxMemoryAllocationCount)
+	{
+		throw std::runtime_error("Too many device memory allocations!");
+	}
 
-	VkMemoryAllocateInfo allocInfo = {};
+	const VkMemoryType& memoryType = s_memoryProperties.memoryTypes[
+		memoryTypeIndex];
+	const VkDeviceSize heapSize = s_memoryProperties.memoryHeaps[memoryType.
+		heapIndex].size;
+
+	// Small heaps (e.g. host visible device local) get smaller blocks,
+	// larger resources get a block of their own
+	VkDeviceSize blockSize = heapSize <= 1024ull * 1024 * 1024
+		                         ? heapSize / 8
+		                         : MEMORY_BLOCK_SIZE;
+	blockSize = std::max(blockSize, minSize);
 
+	auto block = std::make_unique<MemoryBlock>();
+	block->size = blockSize;
+	block->mapped = nullptr;
+	block->allocationCount = 0;
+	block->freeRanges.push_back({0, blockSize});
+
+	VkMemoryAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-	                                           properties);
+	allocInfo.pNext = nullptr;
+	allocInfo.allocationSize = blockSize;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	if (vkAllocateMemory(s_logicalDevice, &allocInfo, nullptr,
+	                     &block->memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate device memory block!");
+	}
+
+	if (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* pData;
+		if (vkMapMemory(s_logicalDevice, block->memory, 0, VK_WHOLE_SIZE, 0,
+		                &pData) != VK_SUCCESS)
+		{
+			vkFreeMemory(s_logicalDevice, block->memory, nullptr);
+			throw std::runtime_error("Failed to map device memory block!");
+		}
+		block->mapped = static_cast<uint8_t*>(pData);
+	}
+
+	s_memoryStats.bytesReserved += blockSize;
+	s_memoryStats.blockCount++;
+
+	s_memoryBlocks[memoryTypeIndex].push_back(std::move(block));
+
+	return s_memoryBlocks[memoryTypeIndex].back().get();
+}
+
+static void destroyMemoryBlock(MemoryBlock* block, uint32_t memoryTypeIndex)
+{
+	if (block->mapped)
+	{
+		vkUnmapMemory(s_logicalDevice, block->memory);
+	}
+	vkFreeMemory(s_logicalDevice, block->memory, nullptr);
+
+	s_memoryStats.bytesReserved -= block->size;
+	s_memoryStats.blockCount--;
+
+	auto& blocks = s_memoryBlocks[memoryTypeIndex];
+	blocks.erase(std::find_if(blocks.begin(), blocks.end(),
+	                          [block](const std::unique_ptr<MemoryBlock>& b)
+	                          {
+		                          return b.get() == block;
+	                          }));
+}
+
+// Linear resources (buffers, linear images) and optimal images may not share
+// a bufferImageGranularity page, so optimal images are aligned and padded to
+// whole pages.
+static MemoryAllocation allocateMemory(
+	const VkMemoryRequirements& requirements,
+	VkMemoryPropertyFlags properties, bool optimalImage)
+{
+	MemoryAllocation allocation;
+	allocation.memoryTypeIndex = findMemoryType(
+		requirements.memoryTypeBits, properties);
+
+	VkDeviceSize size = requirements.size;
+	VkDeviceSize alignment = requirements.alignment;
+
+	if (optimalImage)
+	{
+		rangeImageGranularity(s_physicalDeviceProperties.limits.
+		                      bufferImageGranularity, size, alignment);
+	}
+
+	MemoryBlock* block = nullptr;
+
+	for (auto& candidate : s_memoryBlocks[allocation.memoryTypeIndex])
+	{
+		if (allocateRange(candidate->freeRanges, size, alignment,
+		                  allocation.offset))
+		{
+			block = candidate.get();
+			break;
+		}
+	}
+
+	if (!block)
+	{
+		block = createMemoryBlock(allocation.memoryTypeIndex, size);
+		allocateRange(block->freeRanges, size, alignment, allocation.offset);
+	}
+
+	block->allocationCount++;
+
+	allocation.memory = block->memory;
+	allocation.size = size;
+	allocation.block = block;
+	allocation.mapped = block->mapped
+		                    ? block->mapped + allocation.offset
+		                    : nullptr;
+
+	s_memoryStats.bytesUsed += size;
+	s_memoryStats.allocationCount++;
+
+	return allocation;
+}
+
+static void freeMemory(MemoryAllocation& allocation)
+{
+	MemoryBlock* block = allocation.block;
+
+	if (!block)
+	{
+		return;
+	}
+
+	freeRange(block->freeRanges, allocation.offset, allocation.size);
+	block->allocationCount--;
+
+	s_memoryStats.bytesUsed -= allocation.size;
+	s_memoryStats.allocationCount--;
+
+	// Keep one empty block per memory type around for staging churn
+	if (block->allocationCount == 0 && s_memoryBlocks[allocation.
+		memoryTypeIndex].size() > 1)
+	{
+		destroyMemoryBlock(block, allocation.memoryTypeIndex);
+	}
+
+	allocation = {};
+}
 
-	vk_res = vkAllocateMemory(s_logicalDevice, &allocInfo, nullptr,
-	                          &bufferMemory);
+static void destroyMemoryManager()
+{
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		while (!s_memoryBlocks[i].empty())
+		{
+			destroyMemoryBlock(s_memoryBlocks[i].back().get(), i);
+		}
+	}
+}
+
+static void printMemoryStats()
+{
+	std::cout << "Device memory: " << s_memoryStats.bytesUsed << " bytes used / "
+		<< s_memoryStats.bytesReserved << " bytes reserved in " <<
+		s_memoryStats.blockCount << " blocks, " << s_memoryStats.
+		allocationCount << " allocations" << std::endl;
+}
+
+static int createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                        VkMemoryPropertyFlags properties,
+                        VkBuffer& buffer, MemoryAllocation& bufferMemory)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	vk_res = vkCreateBuffer(s_logicalDevice, &bufferInfo, nullptr, &buffer);
 	ASSERT_VK(vk_res);
 
-	vk_res = vkBindBufferMemory(s_logicalDevice, buffer, bufferMemory, 0);
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(s_logicalDevice, buffer, &memRequirements);
+
+	bufferMemory = allocateMemory(memRequirements, properties, false);
+
+	vk_res = vkBindBufferMemory(s_logicalDevice, buffer, bufferMemory.memory,
+	                            bufferMemory.offset);
 	ASSERT_VK(vk_res);
 
 	return EXIT_SUCCESS;
 }
 
-static VkCommandBuffer beginSingleTransferCommands()
+static bool hasDedicatedTransferQueue()
 {
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = 1;
-	allocInfo.commandPool = s_commandTransferPool;
+	return s_transferQueueFamilyIndex != s_graphicQueueFamilyIndex;
+}
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(s_logicalDevice, &allocInfo, &commandBuffer);
+static int beginUploadBatch()
+{
+	if (s_uploadFence == VK_NULL_HANDLE)
+	{
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.pNext = nullptr;
+		fenceInfo.flags = 0;
+
+		vk_res = vkCreateFence(s_logicalDevice, &fenceInfo, nullptr,
+		                       &s_uploadFence);
+		ASSERT_VK(vk_res);
+
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = nullptr;
+		semaphoreInfo.flags = 0;
+
+		vk_res = vkCreateSemaphore(s_logicalDevice, &semaphoreInfo, nullptr,
+		                           &s_uploadSemaphore);
+		ASSERT_VK(vk_res);
+	}
+
+	// Allocated once, the transfer pool is reset after each batch
+	if (s_uploadCommandBuffer == VK_NULL_HANDLE)
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.pNext = nullptr;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = s_commandTransferPool;
+
+		vk_res = vkAllocateCommandBuffers(s_logicalDevice, &allocInfo,
+		                                  &s_uploadCommandBuffer);
+		ASSERT_VK(vk_res);
+	}
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	beginInfo.pNext = nullptr;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	vk_res = vkBeginCommandBuffer(s_uploadCommandBuffer, &beginInfo);
+	ASSERT_VK(vk_res);
+
+	s_uploadBatchOpen = true;
+
+	return EXIT_SUCCESS;
+}
+
+// Mapped staging buffer owned by the current upload batch
+static StagingBuffer createStagingBuffer(VkDeviceSize size)
+{
+	if (!s_uploadBatchOpen)
+	{
+		throw std::runtime_error("No upload batch in progress!");
+	}
+
+	StagingBuffer staging;
+	if (createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging.buffer,
+	                 staging.memory) != EXIT_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create staging buffer!");
+	}
+
+	s_uploadStagingBuffers.push_back(staging);
+
+	return staging;
+}
+
+// Each level is read from the previous one with a linear blit, then left
+// shader readable
+static void recordMipChain(VkCommandBuffer commandBuffer,
+                           const PendingMipChain& chain)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = chain.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	if (hasDedicatedTransferQueue())
+	{
+		// Acquire every level released by generateMipChain()
+		VkImageMemoryBarrier acquire = barrier;
+		acquire.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		acquire.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		acquire.srcAccessMask = 0;
+		acquire.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT |
+			VK_ACCESS_TRANSFER_WRITE_BIT;
+		acquire.srcQueueFamilyIndex = s_transferQueueFamilyIndex;
+		acquire.dstQueueFamilyIndex = s_graphicQueueFamilyIndex;
+		acquire.subresourceRange.levelCount = chain.mipLevels;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+		                     nullptr, 1, &acquire);
+	}
+
+	const VkPipelineStageFlags shaderStages =
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	int32_t width = static_cast<int32_t>(chain.extent.width);
+	int32_t height = static_cast<int32_t>(chain.extent.height);
+
+	for (uint32_t level = 1; level < chain.mipLevels; level++)
+	{
+		// Previous level, written by the copy or the last blit
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+		                     nullptr, 1, &barrier);
+
+		const int32_t levelWidth = std::max(width / 2, 1);
+		const int32_t levelHeight = std::max(height / 2, 1);
+
+		VkImageBlit blit = {};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[0] = {0, 0, 0};
+		blit.srcOffsets[1] = {width, height, 1};
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+		blit.dstOffsets[0] = {0, 0, 0};
+		blit.dstOffsets[1] = {levelWidth, levelHeight, 1};
+
+		vkCmdBlitImage(commandBuffer, chain.image,
+		               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, chain.image,
+		               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+		               VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     shaderStages, 0, 0, nullptr, 0, nullptr, 1,
+		                     &barrier);
 
-	return commandBuffer;
+		width = levelWidth;
+		height = levelHeight;
+	}
+
+	// Last level, never read by a blit
+	barrier.subresourceRange.baseMipLevel = chain.mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     shaderStages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
 
-static void endSingleTransferCommands(VkCommandBuffer commandBuffer)
+static int submitUploadBatch()
 {
-	vkEndCommandBuffer(commandBuffer);
+	s_uploadBatchOpen = false;
+
+	if (!hasDedicatedTransferQueue())
+	{
+		for (const PendingMipChain& chain : s_uploadMipChains)
+		{
+			recordMipChain(s_uploadCommandBuffer, chain);
+		}
+		s_uploadMipChains.clear();
+
+		// Make the buffer copies visible to vertex input and the culling pass
+		// of later submissions
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+			VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(s_uploadCommandBuffer,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+		                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+		                     &barrier, 0, nullptr, 0, nullptr);
+
+		vk_res = vkEndCommandBuffer(s_uploadCommandBuffer);
+		ASSERT_VK(vk_res);
 
-	// Submit one time
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &s_uploadCommandBuffer;
+
+		vk_res = vkQueueSubmit(s_graphicsQueue, 1, &submitInfo, s_uploadFence);
+		ASSERT_VK(vk_res);
+
+		return EXIT_SUCCESS;
+	}
+
+	// Transfer queue: copies and release barriers
 	//
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	vk_res = vkEndCommandBuffer(s_uploadCommandBuffer);
+	ASSERT_VK(vk_res);
+
+	VkSubmitInfo transferSubmitInfo = {};
+	transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	transferSubmitInfo.commandBufferCount = 1;
+	transferSubmitInfo.pCommandBuffers = &s_uploadCommandBuffer;
+	transferSubmitInfo.signalSemaphoreCount = 1;
+	transferSubmitInfo.pSignalSemaphores = &s_uploadSemaphore;
+
+	vk_res = vkQueueSubmit(s_transferQueue, 1, &transferSubmitInfo, nullptr);
+	ASSERT_VK(vk_res);
+
+	// Graphics queue: acquire barriers, once the copies are done. Begin
+	// resets the buffer of the previous batch
+	//
+	if (s_uploadAcquireCommandBuffer == VK_NULL_HANDLE)
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.pNext = nullptr;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = s_commandPool;
+
+		vk_res = vkAllocateCommandBuffers(s_logicalDevice, &allocInfo,
+		                                  &s_uploadAcquireCommandBuffer);
+		ASSERT_VK(vk_res);
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pNext = nullptr;
+
+	vk_res = vkBeginCommandBuffer(s_uploadAcquireCommandBuffer, &beginInfo);
+	ASSERT_VK(vk_res);
+
+	const VkPipelineStageFlags acquireStages =
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	vkCmdPipelineBarrier(s_uploadAcquireCommandBuffer, acquireStages,
+	                     acquireStages, 0, 0, nullptr,
+	                     static_cast<uint32_t>(s_uploadBufferAcquires.size()),
+	                     s_uploadBufferAcquires.data(),
+	                     static_cast<uint32_t>(s_uploadImageAcquires.size()),
+	                     s_uploadImageAcquires.data());
+
+	for (const PendingMipChain& chain : s_uploadMipChains)
+	{
+		recordMipChain(s_uploadAcquireCommandBuffer, chain);
+	}
+	s_uploadMipChains.clear();
+
+	vk_res = vkEndCommandBuffer(s_uploadAcquireCommandBuffer);
+	ASSERT_VK(vk_res);
+
+	// The blits wait for the copies too
+	const VkPipelineStageFlags waitStages = acquireStages |
+		VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkSubmitInfo acquireSubmitInfo = {};
+	acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	acquireSubmitInfo.waitSemaphoreCount = 1;
+	acquireSubmitInfo.pWaitSemaphores = &s_uploadSemaphore;
+	acquireSubmitInfo.pWaitDstStageMask = &waitStages;
+	acquireSubmitInfo.commandBufferCount = 1;
+	acquireSubmitInfo.pCommandBuffers = &s_uploadAcquireCommandBuffer;
+
+	vk_res = vkQueueSubmit(s_graphicsQueue, 1, &acquireSubmitInfo,
+	                       s_uploadFence);
+	ASSERT_VK(vk_res);
+
+	s_uploadBufferAcquires.clear();
+	s_uploadImageAcquires.clear();
+
+	return EXIT_SUCCESS;
+}
 
-	vkQueueSubmit(s_graphicsQueue, 1, &submitInfo, nullptr);
-	vkQueueWaitIdle(s_graphicsQueue);
+// Waits for the submitted batch, then recycles its command buffer and
+// releases its staging buffers
+static int waitUploadBatch()
+{
+	vk_res = vkWaitForFences(s_logicalDevice, 1, &s_uploadFence, VK_TRUE,
+	                         UINT64_MAX);
+	ASSERT_VK(vk_res);
+
+	vk_res = vkResetFences(s_logicalDevice, 1, &s_uploadFence);
+	ASSERT_VK(vk_res);
+
+	vk_res = vkResetCommandPool(s_logicalDevice, s_commandTransferPool, 0);
+	ASSERT_VK(vk_res);
+
+	for (auto& staging : s_uploadStagingBuffers)
+	{
+		vkDestroyBuffer(s_logicalDevice, staging.buffer, nullptr);
+		freeMemory(staging.memory);
+	}
+	s_uploadStagingBuffers.clear();
 
-	vkFreeCommandBuffers(s_logicalDevice, s_commandTransferPool, 1,
-	                     &commandBuffer);
+	return EXIT_SUCCESS;
 }
 
+// Every level of the first mipLevels goes through the same transition
 static int transitionImageLayout(VkImage image, VkFormat format,
                                  VkImageLayout oldLayout,
-                                 VkImageLayout newLayout)
+                                 VkImageLayout newLayout, uint32_t mipLevels)
 {
-	const VkCommandBuffer commandBuffer = beginSingleTransferCommands();
-
 	VkImageMemoryBarrier barrier = {};
 
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -346,7 +1623,7 @@ static int transitionImageLayout(VkImage image, VkFormat format,
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
@@ -368,61 +1645,138 @@ static int transitionImageLayout(VkImage image, VkFormat format,
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
+		// The texture benchmark samples from a compute pass
 		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+		if (hasDedicatedTransferQueue())
+		{
+			// Release to the graphics family, which acquires it with the same
+			// layout transition
+			barrier.srcQueueFamilyIndex = s_transferQueueFamilyIndex;
+			barrier.dstQueueFamilyIndex = s_graphicQueueFamilyIndex;
+
+			VkImageMemoryBarrier acquire = barrier;
+			acquire.srcAccessMask = 0;
+			s_uploadImageAcquires.push_back(acquire);
+
+			barrier.dstAccessMask = 0;
+			destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		}
 	}
 	else
 	{
 		throw std::invalid_argument("Unsupported layout transition!");
 	}
 
-	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
-	                     nullptr, 0, nullptr, 1, &barrier);
-
-	endSingleTransferCommands(commandBuffer);
+	vkCmdPipelineBarrier(s_uploadCommandBuffer, sourceStage, destinationStage,
+	                     0, 0, nullptr, 0, nullptr, 1, &barrier);
 
 	return EXIT_SUCCESS;
 }
 
+// Levels 1 and up of an image whose level 0 was just copied, every level in
+// TRANSFER_DST_OPTIMAL. They are blitted when the batch is submitted, after
+// which the whole chain is SHADER_READ_ONLY_OPTIMAL
+static void generateMipChain(VkImage image, VkExtent2D extent,
+                             uint32_t mipLevels)
+{
+	if (hasDedicatedTransferQueue())
+	{
+		// Release every level to the graphics family, layout unchanged
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = s_transferQueueFamilyIndex;
+		barrier.dstQueueFamilyIndex = s_graphicQueueFamilyIndex;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(s_uploadCommandBuffer,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+		                     nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	s_uploadMipChains.push_back({image, extent, mipLevels});
+}
+
 static int transferBuffer(const VkBuffer& srcBuffer, VkBuffer& dstBuffer,
                           VkDeviceSize size)
 {
-	const VkCommandBuffer commandBuffer = beginSingleTransferCommands();
-
 	VkBufferCopy copyRegion = {};
 	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	vkCmdCopyBuffer(s_uploadCommandBuffer, srcBuffer, dstBuffer, 1,
+	                &copyRegion);
+
+	if (hasDedicatedTransferQueue())
+	{
+		// Release to the graphics family
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = s_transferQueueFamilyIndex;
+		barrier.dstQueueFamilyIndex = s_graphicQueueFamilyIndex;
+		barrier.buffer = dstBuffer;
+		barrier.offset = 0;
+		barrier.size = size;
+
+		vkCmdPipelineBarrier(s_uploadCommandBuffer,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+		                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+		                     nullptr, 1, &barrier, 0, nullptr);
 
-	endSingleTransferCommands(commandBuffer);
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+			VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		s_uploadBufferAcquires.push_back(barrier);
+	}
 
 	return EXIT_SUCCESS;
 }
 
+// One level per entry of levelOffsets, level 0 being width x height and
+// tightly packed in srcBuffer at that offset
 static int transferBufferToImage(const VkBuffer& srcBuffer, VkImage& dstImage,
-                                 uint32_t width, uint32_t height)
-{
-	const VkCommandBuffer commandBuffer = beginSingleTransferCommands();
-
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
+                                 uint32_t width, uint32_t height,
+                                 const std::vector<VkDeviceSize>& levelOffsets)
+{
+	std::vector<VkBufferImageCopy> regions(levelOffsets.size());
 
-	vkCmdCopyBufferToImage(commandBuffer, srcBuffer, dstImage,
-	                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	for (uint32_t level = 0; level < regions.size(); level++)
+	{
+		VkBufferImageCopy& region = regions[level];
+		region.bufferOffset = levelOffsets[level];
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+
+		region.imageOffset = {0, 0, 0};
+		region.imageExtent = {
+			std::max(width >> level, 1u),
+			std::max(height >> level, 1u),
+			1
+		};
+	}
 
-	endSingleTransferCommands(commandBuffer);
+	vkCmdCopyBufferToImage(s_uploadCommandBuffer, srcBuffer, dstImage,
+	                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                       static_cast<uint32_t>(regions.size()),
+	                       regions.data());
 
 	return EXIT_SUCCESS;
 }
@@ -430,28 +1784,17 @@ static int transferBufferToImage(const VkBuffer& srcBuffer, VkImage& dstImage,
 template <class T>
 static int createBufferWithStaging(T* data, size_t size, size_t stride,
                                    VkBufferUsageFlags usage, VkBuffer& buffer,
-                                   VkDeviceMemory& bufferMemory)
+                                   MemoryAllocation& bufferMemory)
 {
 	const VkDeviceSize bufferSize = size * stride;
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-	             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-	             stagingBufferMemory);
-
-	void* pData;
-	vkMapMemory(s_logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &pData);
-	memcpy(pData, data, static_cast<size_t>(bufferSize));
-	vkUnmapMemory(s_logicalDevice, stagingBufferMemory);
+	const StagingBuffer staging = createStagingBuffer(bufferSize);
+
+	memcpy(staging.memory.mapped, data, static_cast<size_t>(bufferSize));
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
 	             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
 
-	transferBuffer(stagingBuffer, buffer, bufferSize);
-
-	vkDestroyBuffer(s_logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(s_logicalDevice, stagingBufferMemory, nullptr);
+	transferBuffer(staging.buffer, buffer, bufferSize);
 
 	return EXIT_SUCCESS;
 }
@@ -488,20 +1831,24 @@ static bool hasStencilComponent(VkFormat format)
 
 static VkFormat findDepthFormat()
 {
+	// Occlusion culling samples the depth buffer
 	return findSupportedFormats({
 		                            VK_FORMAT_D32_SFLOAT,
 		                            VK_FORMAT_D32_SFLOAT_S8_UINT,
 		                            VK_FORMAT_D24_UNORM_S8_UINT
 	                            },
 	                            VK_IMAGE_TILING_OPTIMAL,
-	                            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	                            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+	                            (s_options.occlusionCulling
+		                             ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+		                             : 0));
 }
 
-static int createImage2D(const VkExtent2D extent, const VkFormat format,
-                         const VkImageTiling tiling,
+static int createImage2D(const VkExtent2D extent, const uint32_t mipLevels,
+                         const VkFormat format, const VkImageTiling tiling,
                          const VkBufferUsageFlags usage,
                          const VkMemoryPropertyFlags properties, VkImage& image,
-                         VkDeviceMemory& memory)
+                         MemoryAllocation& memory)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -511,7 +1858,7 @@ static int createImage2D(const VkExtent2D extent, const VkFormat format,
 	imageInfo.extent.height = extent.height;
 	imageInfo.extent.depth = 1;
 	imageInfo.arrayLayers = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.format = format;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -524,23 +1871,19 @@ static int createImage2D(const VkExtent2D extent, const VkFormat format,
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(s_logicalDevice, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-	                                           properties);
+	memory = allocateMemory(memRequirements, properties,
+	                        tiling == VK_IMAGE_TILING_OPTIMAL);
 
-	vk_res = vkAllocateMemory(s_logicalDevice, &allocInfo, nullptr, &memory);
+	vk_res = vkBindImageMemory(s_logicalDevice, image, memory.memory,
+	                           memory.offset);
 	ASSERT_VK(vk_res);
 
-	vkBindImageMemory(s_logicalDevice, image, memory, 0);
-
 	return EXIT_SUCCESS;
 }
 
-static VkImageView& createImageView(const VkImage& image, VkFormat format,
-                                    VkImageAspectFlags aspectFlags)
+static VkImageView createImageView(const VkImage& image, VkFormat format,
+                                   VkImageAspectFlags aspectFlags,
+                                   uint32_t mipLevels)
 {
 	VkImageView imageView;
 
@@ -552,7 +1895,7 @@ static VkImageView& createImageView(const VkImage& image, VkFormat format,
 	imageViewInfo.image = image;
 	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	imageViewInfo.subresourceRange.aspectMask = aspectFlags;
-	imageViewInfo.subresourceRange.levelCount = 1;
+	imageViewInfo.subresourceRange.levelCount = mipLevels;
 	imageViewInfo.subresourceRange.layerCount = 1;
 
 	if (vkCreateImageView(s_logicalDevice, &imageViewInfo, nullptr, &imageView)
@@ -564,8 +1907,39 @@ static VkImageView& createImageView(const VkImage& image, VkFormat format,
 	return imageView;
 }
 
+static bool hasExtension(const std::vector<VkExtensionProperties>& extensions,
+                         const char* name)
+{
+	return std::any_of(extensions.begin(), extensions.end(),
+	                   [name](const VkExtensionProperties& extension)
+	                   {
+		                   return strcmp(extension.extensionName, name) == 0;
+	                   });
+}
+
 void initAppExtensions()
 {
+	// Needed to query VK_EXT_memory_budget, optional
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+	                                       extensions.data());
+
+	if (hasExtension(extensions,
+	                 VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+	{
+		s_instanceExtensionNames.push_back(
+			VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		s_instanceProperties2 = true;
+	}
+
+	if (s_options.headless)
+	{
+		return;
+	}
+
 	uint32_t glfwExtensionCount;
 	const char** glfwRequiredExtensions;
 	glfwRequiredExtensions = glfwGetRequiredInstanceExtensions(
@@ -584,11 +1958,15 @@ void initAppExtensions()
 
 void initDeviceExtension()
 {
-	s_deviceExtensionNames.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	if (!s_options.headless)
+	{
+		s_deviceExtensionNames.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
 }
 
 int initSurface()
 {
+#ifdef _WIN32
 	VkWin32SurfaceCreateInfoKHR surfaceInfo = {};
 	surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 	surfaceInfo.pNext = nullptr;
@@ -597,6 +1975,10 @@ int initSurface()
 
 	vk_res = vkCreateWin32SurfaceKHR(s_instance, &surfaceInfo, nullptr,
 	                                 &s_surfaceKHR);
+#else
+	vk_res = glfwCreateWindowSurface(s_instance, s_window, nullptr,
+	                                 &s_surfaceKHR);
+#endif
 	ASSERT_VK(vk_res);
 
 	return EXIT_SUCCESS;
@@ -707,9 +2089,18 @@ int initInstance()
 
 int initLogicalDevice()
 {
-	// Select first device
+	// Select requested device, first one by default
 	//
-	s_physicalDevice = s_physicalDevices[0];
+	if (s_options.deviceIndex >= s_physicalDevices.size())
+	{
+		std::cerr << "Device " << s_options.deviceIndex << " not found!" <<
+			std::endl;
+		return EXIT_FAILURE;
+	}
+
+	s_physicalDevice = s_physicalDevices[s_options.deviceIndex];
+	vkGetPhysicalDeviceProperties(s_physicalDevice,
+	                              &s_physicalDeviceProperties);
 
 	uint32_t queueFamilyCount;
 	vkGetPhysicalDeviceQueueFamilyProperties(s_physicalDevice,
@@ -725,9 +2116,15 @@ int initLogicalDevice()
 		queueFamilyCount * sizeof(VkBool32)));
 	for (uint32_t i = 0; i < queueFamilyCount; i++)
 	{
-		vkGetPhysicalDeviceSurfaceSupportKHR(s_physicalDevice, i, s_surfaceKHR,
-		                                     &pSupport[i]);
-	}
+		// Headless, nothing to present to
+		pSupport[i] = VK_FALSE;
+
+		if (!s_options.headless)
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(s_physicalDevice, i,
+			                                     s_surfaceKHR, &pSupport[i]);
+		}
+	}
 
 	s_graphicQueueFamilyIndex = UINT32_MAX;
 	s_presentQueueFamilyIndex = UINT32_MAX;
@@ -764,30 +2161,107 @@ int initLogicalDevice()
 
 	free(pSupport);
 
+	// Transfer only family (no graphics nor compute) for uploads, falls back
+	// to the graphics queue
+	s_transferQueueFamilyIndex = s_graphicQueueFamilyIndex;
+
+	for (uint32_t i = 0; i < queueFamilyCount; i++)
+	{
+		const VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+
+		if (flags & VK_QUEUE_TRANSFER_BIT && !(flags & (VK_QUEUE_GRAPHICS_BIT |
+			VK_QUEUE_COMPUTE_BIT)))
+		{
+			s_transferQueueFamilyIndex = i;
+			break;
+		}
+	}
+
+	s_timestampValidBits = queueFamilyProperties[s_graphicQueueFamilyIndex].
+		timestampValidBits;
+
+	// Optional features, only enabled when the device has them
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(s_physicalDevice, &supportedFeatures);
+
+	s_enabledFeatures = {};
+	s_enabledFeatures.pipelineStatisticsQuery = supportedFeatures.
+		pipelineStatisticsQuery;
+	s_enabledFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+	s_enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	s_enabledFeatures.textureCompressionBC = supportedFeatures.
+		textureCompressionBC;
+
+	if (s_timestampValidBits == 0)
+	{
+		std::cout << "GPU timestamps not supported by the graphics queue" <<
+			std::endl;
+	}
+
+	if (!s_enabledFeatures.pipelineStatisticsQuery)
+	{
+		std::cout << "Pipeline statistics queries not supported" << std::endl;
+	}
+
+	// Heap budgets for the texture streamer, when the driver reports them
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(s_physicalDevice, nullptr,
+	                                     &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(s_physicalDevice, nullptr,
+	                                     &extensionCount, extensions.data());
+
+	if (s_instanceProperties2 && hasExtension(
+		extensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+	{
+		s_deviceExtensionNames.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		s_getMemoryProperties2 = reinterpret_cast<
+			PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(
+			s_instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+	}
+
+	static const float queuePriority = 0.0f;
+
+	std::vector<VkDeviceQueueCreateInfo> deviceQueueInfos;
+
 	VkDeviceQueueCreateInfo deviceQueueInfo = {};
 	deviceQueueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 	deviceQueueInfo.pNext = nullptr;
-	deviceQueueInfo.pQueuePriorities = new float[1]{0.0};
+	deviceQueueInfo.pQueuePriorities = &queuePriority;
 	deviceQueueInfo.queueCount = 1;
 	deviceQueueInfo.queueFamilyIndex = s_graphicQueueFamilyIndex;
+	deviceQueueInfos.push_back(deviceQueueInfo);
+
+	if (hasDedicatedTransferQueue())
+	{
+		deviceQueueInfo.queueFamilyIndex = s_transferQueueFamilyIndex;
+		deviceQueueInfos.push_back(deviceQueueInfo);
+	}
 
 	VkDeviceCreateInfo deviceInfo = {};
 
 	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.pNext = nullptr;
-	deviceInfo.queueCreateInfoCount = 1;
-	deviceInfo.pQueueCreateInfos = &deviceQueueInfo;
+	deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(deviceQueueInfos.
+		size());
+	deviceInfo.pQueueCreateInfos = deviceQueueInfos.data();
 	deviceInfo.enabledExtensionCount = s_deviceExtensionNames.size();
 	deviceInfo.ppEnabledExtensionNames = s_deviceExtensionNames.data();
 	deviceInfo.enabledLayerCount = 0;
 	deviceInfo.ppEnabledLayerNames = nullptr;
+	deviceInfo.pEnabledFeatures = &s_enabledFeatures;
 
 	vk_res = vkCreateDevice(s_physicalDevice, &deviceInfo, nullptr,
 	                        &s_logicalDevice);
 	ASSERT_VK(vk_res);
 
-	vkGetDeviceQueue(s_logicalDevice, deviceQueueInfo.queueFamilyIndex, 0,
+	vkGetDeviceQueue(s_logicalDevice, s_graphicQueueFamilyIndex, 0,
 	                 &s_graphicsQueue);
+	vkGetDeviceQueue(s_logicalDevice, s_transferQueueFamilyIndex, 0,
+	                 &s_transferQueue);
+
+	initMemoryManager();
 
 	return EXIT_SUCCESS;
 }
@@ -864,12 +2338,20 @@ int createSwapChain()
 	swapChainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 	swapChainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainInfo.clipped = VK_TRUE;
-	swapChainInfo.oldSwapchain = nullptr;
+	// Handing over the previous swapchain lets presentation continue
+	// during an interactive resize
+	const VkSwapchainKHR oldSwapChain = s_swapChain;
+	swapChainInfo.oldSwapchain = oldSwapChain;
 
 	vk_res = vkCreateSwapchainKHR(s_logicalDevice, &swapChainInfo, nullptr,
 	                              &s_swapChain);
 	ASSERT_VK(vk_res);
 
+	if (oldSwapChain != VK_NULL_HANDLE)
+	{
+		vkDestroySwapchainKHR(s_logicalDevice, oldSwapChain, nullptr);
+	}
+
 	uint32_t swapImageCount;
 
 	vk_res = vkGetSwapchainImagesKHR(s_logicalDevice, s_swapChain,
@@ -888,13 +2370,57 @@ int createSwapChain()
 	for (int i = 0; i < swapImageCount; i++)
 	{
 		s_swapChainImagesViews[i] = createImageView(
-			images[i], swapChainInfo.imageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+			images[i], swapChainInfo.imageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 		ASSERT_VK(vk_res);
 	}
 
 	return EXIT_SUCCESS;
 }
 
+int createOffscreenTargets()
+{
+	s_swapChainExtent = {s_options.width, s_options.height};
+	s_swapChainFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+	s_swapChainFormat.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+
+	// One target per frame in flight, like a swapchain with that many images
+	const uint32_t imageCount = s_options.framesInFlight;
+
+	s_offscreenImages.resize(imageCount);
+	s_offscreenImagesMemory.resize(imageCount);
+	s_swapChainImagesViews.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		const int result = createImage2D(
+			s_swapChainExtent, 1, s_swapChainFormat.format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_offscreenImages[i],
+			s_offscreenImagesMemory[i]);
+		ASSERT(result);
+
+		s_swapChainImagesViews[i] = createImageView(
+			s_offscreenImages[i], s_swapChainFormat.format,
+			VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void destroyOffscreenTargets()
+{
+	for (size_t i = 0; i < s_offscreenImages.size(); i++)
+	{
+		vkDestroyImage(s_logicalDevice, s_offscreenImages[i], nullptr);
+		freeMemory(s_offscreenImagesMemory[i]);
+	}
+
+	s_offscreenImages.clear();
+	s_offscreenImagesMemory.clear();
+}
+
 int createRenderPass()
 {
 	// Color Attachment
@@ -909,8 +2435,11 @@ int createRenderPass()
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
+	// Headless targets are left ready to be copied out
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.finalLayout = s_options.headless
+		                              ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+		                              : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	// SubPass
 	//
@@ -923,12 +2452,22 @@ int createRenderPass()
 	depthAttachment.format = findDepthFormat();
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout =
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	// Kept for the depth pyramid when occlusion culling, discarded otherwise
+	if (s_options.occlusionCulling)
+	{
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	else
+	{
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.finalLayout =
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	}
 
 	VkAttachmentReference depthAttachmentRef = {};
 	depthAttachmentRef.attachment = 1;
@@ -943,15 +2482,35 @@ int createRenderPass()
 
 	// SubPass dependency
 	//
-	VkSubpassDependency dependency = {};
+	std::array<VkSubpassDependency, 2> dependencies = {};
+	VkSubpassDependency& dependency = dependencies[0];
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependency.dstSubpass = 0;
 
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstStageMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	// The depth image is shared by all frames in flight, so the previous
+	// frame depth writes, and its depth pyramid reads, must be done before
+	// this one clears it.
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+		(s_options.occlusionCulling ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0);
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	// Depth writes and the final layout transition before the depth pyramid
+	// reads the depth buffer
+	VkSubpassDependency& depthReadDependency = dependencies[1];
+	depthReadDependency.srcSubpass = 0;
+	depthReadDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	depthReadDependency.srcStageMask =
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	depthReadDependency.srcAccessMask =
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthReadDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	depthReadDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
 	const std::array<VkAttachmentDescription, 2> attachments = {
 		colorAttachment, depthAttachment
@@ -966,8 +2525,8 @@ int createRenderPass()
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subPassDesc;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = s_options.occlusionCulling ? 2 : 1;
+	renderPassInfo.pDependencies = dependencies.data();
 
 	vk_res = vkCreateRenderPass(s_logicalDevice, &renderPassInfo, nullptr,
 	                            &s_renderPass);
@@ -976,11 +2535,118 @@ int createRenderPass()
 	return EXIT_SUCCESS;
 }
 
+// Checks that cache data was written by this driver and device
+static bool isPipelineCacheValid(const std::vector<char>& data)
+{
+	// VkPipelineCacheHeaderVersionOne
+	const size_t headerSize = 16 + VK_UUID_SIZE;
+
+	if (data.size() < headerSize)
+	{
+		return false;
+	}
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof header);
+
+	return header[0] >= headerSize &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == s_physicalDeviceProperties.vendorID &&
+		header[3] == s_physicalDeviceProperties.deviceID &&
+		memcmp(data.data() + 16, s_physicalDeviceProperties.pipelineCacheUUID,
+		       VK_UUID_SIZE) == 0;
+}
+
+int createPipelineCache()
+{
+	std::vector<char> cacheData;
+
+	std::ifstream file(PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary);
+	if (file.is_open())
+	{
+		cacheData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(cacheData.data(), cacheData.size());
+		file.close();
+
+		if (!isPipelineCacheValid(cacheData))
+		{
+			std::cout << "Discarding stale pipeline cache" << std::endl;
+			cacheData.clear();
+		}
+	}
+
+	s_pipelineCacheWarm = !cacheData.empty();
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.pNext = nullptr;
+	cacheInfo.flags = 0;
+	cacheInfo.initialDataSize = cacheData.size();
+	cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	vk_res = vkCreatePipelineCache(s_logicalDevice, &cacheInfo, nullptr,
+	                               &s_pipelineCache);
+	ASSERT_VK(vk_res);
+
+	return EXIT_SUCCESS;
+}
+
+// Written to a temporary file then moved over the previous cache, so a
+// crash never leaves a truncated cache behind
+int savePipelineCache()
+{
+	size_t dataSize = 0;
+	vk_res = vkGetPipelineCacheData(s_logicalDevice, s_pipelineCache,
+	                                &dataSize, nullptr);
+	ASSERT_VK(vk_res);
+
+	std::vector<char> data(dataSize);
+	vk_res = vkGetPipelineCacheData(s_logicalDevice, s_pipelineCache,
+	                                &dataSize, data.data());
+	ASSERT_VK(vk_res);
+
+	const std::string tmpFile = std::string{PIPELINE_CACHE_FILE} + ".tmp";
+
+	std::ofstream file(tmpFile, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return EXIT_FAILURE;
+	}
+
+	file.write(data.data(), dataSize);
+	file.close();
+
+	// A short or failed write must not replace the last good cache
+	if (file.fail())
+	{
+		std::remove(tmpFile.c_str());
+		return EXIT_FAILURE;
+	}
+
+#ifdef _WIN32
+	const bool moved = MoveFileExA(tmpFile.c_str(), PIPELINE_CACHE_FILE,
+	                               MOVEFILE_REPLACE_EXISTING |
+	                               MOVEFILE_WRITE_THROUGH);
+#else
+	// rename() replaces the target atomically on POSIX
+	const bool moved = std::rename(tmpFile.c_str(), PIPELINE_CACHE_FILE) == 0;
+#endif
+
+	if (!moved)
+	{
+		std::remove(tmpFile.c_str());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
 int createDescriptorSetLayout()
 {
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -1000,8 +2666,15 @@ int createDescriptorSetLayout()
 
 int createGraphicsPipeline()
 {
-	const auto vertShaderCode = readFile("shaders/vert.spv");
-	const auto fragShaderCode = readFile("shaders/frag.spv");
+	const bool instanced = s_options.instanceCount > 0;
+	const bool packed = s_options.packedVertices;
+	std::string vertShaderFile = instanced
+		                             ? "shaders/instanced_vert"
+		                             : "shaders/vert";
+	vertShaderFile += packed ? "_packed.spv" : ".spv";
+
+	const AssetData vertShaderCode = loadAsset(vertShaderFile);
+	const AssetData fragShaderCode = loadAsset("shaders/frag.spv");
 
 	auto shaderModuleVert = createShaderModule(vertShaderCode);
 	auto shaderModuleFrag = createShaderModule(fragShaderCode);
@@ -1034,15 +2707,32 @@ int createGraphicsPipeline()
 
 	// Input shader stage
 	//
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescriptions = Vertex::getBindingDescriptions();
+	auto vertexAttributes = packed
+		                        ? PackedVertex::getAttributeDescriptions()
+		                        : Vertex::getAttributeDescriptions();
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(
+		vertexAttributes.begin(), vertexAttributes.end());
+
+	if (packed)
+	{
+		bindingDescriptions[0].stride = sizeof(PackedVertex);
+	}
+
+	if (instanced)
+	{
+		auto instanceAttributes = InstanceData::getAttributeDescriptions();
+		attributeDescriptions.insert(attributeDescriptions.end(),
+		                             instanceAttributes.begin(),
+		                             instanceAttributes.end());
+	}
 
 	VkPipelineVertexInputStateCreateInfo vertInputInfo = {};
 	vertInputInfo.sType =
 		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertInputInfo.pNext = nullptr;
-	vertInputInfo.vertexBindingDescriptionCount = 1;
-	vertInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertInputInfo.vertexBindingDescriptionCount = instanced ? 2 : 1;
+	vertInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	vertInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.
 		size();
 	vertInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
@@ -1056,27 +2746,16 @@ int createGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	// Viewport State
+	// Viewport State, set by the command buffers (dynamic state) so the
+	// pipeline does not depend on the swapchain extent
 	//
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(s_swapChainExtent.width);
-	viewport.height = static_cast<float>(s_swapChainExtent.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = {0, 0};
-	scissor.extent = s_swapChainExtent;
-
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.pNext = nullptr;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 	// Rasterization
 	//
@@ -1133,6 +2812,17 @@ int createGraphicsPipeline()
 
 	// DynamicStates
 	//
+	const std::array<VkDynamicState, 2> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.pNext = nullptr;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.
+		size());
+	dynamicState.pDynamicStates = dynamicStates.data();
 
 	// Pipeline layout
 	//
@@ -1164,7 +2854,7 @@ int createGraphicsPipeline()
 	pipelineInfo.pMultisampleState = &multiSample;
 	pipelineInfo.pColorBlendState = &colorBlendState;
 	pipelineInfo.pDepthStencilState = &depthState;
-	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.pDynamicState = &dynamicState;
 
 	pipelineInfo.layout = s_pipelineLayout;
 	pipelineInfo.renderPass = s_renderPass;
@@ -1172,10 +2862,21 @@ int createGraphicsPipeline()
 	pipelineInfo.basePipelineHandle = nullptr;
 	pipelineInfo.basePipelineIndex = -1;
 
-	vk_res = vkCreateGraphicsPipelines(s_logicalDevice, nullptr, 1,
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	vk_res = vkCreateGraphicsPipelines(s_logicalDevice, s_pipelineCache, 1,
 	                                   &pipelineInfo, nullptr,
 	                                   &s_graphicsPipeline);
-	ASSERT_VK(vk_rest);
+	ASSERT_VK(vk_res);
+
+	const auto endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << "Graphics pipeline created in " << std::chrono::duration<
+			double, std::milli>(endTime - startTime).count() << " ms (" <<
+		(s_pipelineCacheWarm ? "warm" : "cold") << " cache)" << std::endl;
+
+	// Later rebuilds hit the entries added by this one
+	s_pipelineCacheWarm = true;
 
 	vkDestroyShaderModule(s_logicalDevice, shaderModuleVert, nullptr);
 	vkDestroyShaderModule(s_logicalDevice, shaderModuleFrag, nullptr);
@@ -1183,6 +2884,190 @@ int createGraphicsPipeline()
 	return EXIT_SUCCESS;
 }
 
+// Does not depend on the render pass, kept across swapchain recreation
+int createCullPipeline()
+{
+	if (!s_options.gpuCulling)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	// Uniforms, source instances, visible instances and output, all sliced
+	// per swap image through dynamic offsets, then the depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, 5> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 0
+			                             ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+			                             : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+	bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.bindingCount = s_options.occlusionCulling ? 5 : 4;
+	layoutInfo.pBindings = bindings.data();
+
+	vk_res = vkCreateDescriptorSetLayout(s_logicalDevice, &layoutInfo, nullptr,
+	                                     &s_cullDescriptorLayout);
+	ASSERT_VK(vk_res);
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &s_cullDescriptorLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	vk_res = vkCreatePipelineLayout(s_logicalDevice, &pipelineLayoutInfo,
+	                                nullptr, &s_cullPipelineLayout);
+	ASSERT_VK(vk_res);
+
+	const AssetData compShaderCode = loadAsset(
+		s_options.meshlets
+			? "shaders/cluster_cull.spv"
+			: s_options.occlusionCulling
+			? "shaders/cull_occlusion.spv"
+			: "shaders/cull.spv");
+	auto shaderModuleComp = createShaderModule(compShaderCode);
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModuleComp;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = s_cullPipelineLayout;
+	pipelineInfo.basePipelineHandle = nullptr;
+	pipelineInfo.basePipelineIndex = -1;
+
+	vk_res = vkCreateComputePipelines(s_logicalDevice, s_pipelineCache, 1,
+	                                  &pipelineInfo, nullptr, &s_cullPipeline);
+	ASSERT_VK(vk_res);
+
+	vkDestroyShaderModule(s_logicalDevice, shaderModuleComp, nullptr);
+
+	return EXIT_SUCCESS;
+}
+
+// Depth pyramid reduction, one dispatch per level
+int createHiZPipeline()
+{
+	if (!s_options.occlusionCulling)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	// texelFetch only, the sampler does not filter
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.pNext = nullptr;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(HIZ_MAX_LEVELS);
+
+	vk_res = vkCreateSampler(s_logicalDevice, &samplerInfo, nullptr,
+	                         &s_hiZSampler);
+	ASSERT_VK(vk_res);
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	vk_res = vkCreateDescriptorSetLayout(s_logicalDevice, &layoutInfo, nullptr,
+	                                     &s_hiZDescriptorLayout);
+	ASSERT_VK(vk_res);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &s_hiZDescriptorLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+	vk_res = vkCreatePipelineLayout(s_logicalDevice, &pipelineLayoutInfo,
+	                                nullptr, &s_hiZPipelineLayout);
+	ASSERT_VK(vk_res);
+
+	const AssetData compShaderCode = loadAsset("shaders/hiz.spv");
+	auto shaderModuleComp = createShaderModule(compShaderCode);
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModuleComp;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = s_hiZPipelineLayout;
+	pipelineInfo.basePipelineHandle = nullptr;
+	pipelineInfo.basePipelineIndex = -1;
+
+	vk_res = vkCreateComputePipelines(s_logicalDevice, s_pipelineCache, 1,
+	                                  &pipelineInfo, nullptr, &s_hiZPipeline);
+	ASSERT_VK(vk_res);
+
+	vkDestroyShaderModule(s_logicalDevice, shaderModuleComp, nullptr);
+
+	return EXIT_SUCCESS;
+}
+
+void destroyCullPipeline()
+{
+	if (s_options.gpuCulling)
+	{
+		vkDestroyPipeline(s_logicalDevice, s_cullPipeline, nullptr);
+		vkDestroyPipelineLayout(s_logicalDevice, s_cullPipelineLayout,
+		                        nullptr);
+		vkDestroyDescriptorSetLayout(s_logicalDevice, s_cullDescriptorLayout,
+		                             nullptr);
+	}
+
+	if (s_options.occlusionCulling)
+	{
+		vkDestroyPipeline(s_logicalDevice, s_hiZPipeline, nullptr);
+		vkDestroyPipelineLayout(s_logicalDevice, s_hiZPipelineLayout,
+		                        nullptr);
+		vkDestroyDescriptorSetLayout(s_logicalDevice, s_hiZDescriptorLayout,
+		                             nullptr);
+		vkDestroySampler(s_logicalDevice, s_hiZSampler, nullptr);
+	}
+}
+
 int createFrameBuffers()
 {
 	s_swapChainBuffers.resize(s_swapChainImagesViews.size());
@@ -1214,37 +3099,56 @@ int createFrameBuffers()
 	return EXIT_SUCCESS;
 }
 
-int createUniformBuffers()
+static VkDeviceSize uniformSliceOffset(uint32_t ringSlot, uint32_t object)
 {
-	const VkDeviceSize bufferSize = sizeof UniformBufferObject;
-
-	s_uniformBuffers.resize(s_swapChainImagesViews.size());
-	s_uniformBuffersMemory.resize(s_swapChainImagesViews.size());
+	return (ringSlot * UNIFORM_OBJECT_COUNT + object) * s_uniformSliceSize;
+}
 
-	for (int i = 0; i < s_swapChainImagesViews.size(); i++)
-	{
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		             s_uniformBuffers[i], s_uniformBuffersMemory[i]);
-	}
+int createUniformBuffers()
+{
+	// Slices must start on minUniformBufferOffsetAlignment (a power of two)
+	const VkDeviceSize alignment = s_physicalDeviceProperties.limits.
+		minUniformBufferOffsetAlignment;
+	s_uniformSliceSize = alignUp(sizeof(UniformBufferObject), alignment);
+	s_uniformRingSlots = static_cast<uint32_t>(s_swapChainImagesViews.size());
+
+	const VkDeviceSize bufferSize = s_uniformSliceSize * UNIFORM_OBJECT_COUNT *
+		s_uniformRingSlots;
+
+	int result = createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+	                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                          s_uniformBuffer, s_uniformBufferMemory);
+	ASSERT(result);
 
 	return EXIT_SUCCESS;
 }
 
+void destroyUniformBuffers()
+{
+	vkDestroyBuffer(s_logicalDevice, s_uniformBuffer, nullptr);
+	freeMemory(s_uniformBufferMemory);
+}
+
 int createDescriptorPool()
 {
-	VkDescriptorPoolSize poolSize = {};
-	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize.descriptorCount = static_cast<uint32_t>(s_swapChainImagesViews.
-		size());
+	// Scene set, plus the culling set and one set per depth pyramid level
+	std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 2;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = 3;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = HIZ_MAX_LEVELS + 1;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[3].descriptorCount = HIZ_MAX_LEVELS;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.pNext = nullptr;
-	poolInfo.poolSizeCount = 1;
-	poolInfo.pPoolSizes = &poolSize;
-	poolInfo.maxSets = poolSize.descriptorCount;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = 2 + HIZ_MAX_LEVELS;
 
 	vk_res = vkCreateDescriptorPool(s_logicalDevice, &poolInfo, nullptr,
 	                                &s_descriptorPool);
@@ -1253,72 +3157,1746 @@ int createDescriptorPool()
 	return EXIT_SUCCESS;
 }
 
-int createDescriptorSet()
+void updateDescriptorSet()
 {
-	s_descriptorSets.resize(s_swapChainImagesViews.size());
+	// A single slice is visible at a time, selected by the dynamic offset
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.offset = 0;
+	bufferInfo.buffer = s_uniformBuffer;
+	bufferInfo.range = sizeof(UniformBufferObject);
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.pNext = nullptr;
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = s_descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(s_logicalDevice, 1, &descriptorWrite, 0, nullptr);
+
+	if (!s_options.gpuCulling)
+	{
+		return;
+	}
+
+	// Culling set, same uniform slice and one instance slice per binding
+	const VkDeviceSize instancesSize = static_cast<VkDeviceSize>(s_options.
+		instanceCount) * sizeof(InstanceData);
+
+	std::array<VkDescriptorBufferInfo, 4> cullBufferInfos = {};
+	cullBufferInfos[0] = bufferInfo;
+	cullBufferInfos[1].buffer = s_instanceBuffer;
+	cullBufferInfos[1].offset = 0;
+	cullBufferInfos[1].range = instancesSize;
+	cullBufferInfos[2].buffer = s_visibleInstanceBuffer;
+	cullBufferInfos[2].offset = 0;
+	cullBufferInfos[2].range = instancesSize;
+
+	// Or every cluster and one draw slice
+	if (s_options.meshlets)
+	{
+		cullBufferInfos[1].buffer = s_meshletBuffer;
+		cullBufferInfos[1].range = s_meshletCount * sizeof(GpuMeshlet);
+		cullBufferInfos[2].buffer = s_clusterDrawBuffer;
+		cullBufferInfos[2].range = s_meshletCount * sizeof(
+			VkDrawIndexedIndirectCommand);
+	}
+
+	cullBufferInfos[3].buffer = s_cullOutputBuffer;
+	cullBufferInfos[3].offset = 0;
+	cullBufferInfos[3].range = sizeof(CullOutput);
+
+	std::array<VkWriteDescriptorSet, 4> cullWrites = {};
+	for (uint32_t i = 0; i < cullWrites.size(); i++)
+	{
+		cullWrites[i] = descriptorWrite;
+		cullWrites[i].dstSet = s_cullDescriptorSet;
+		cullWrites[i].dstBinding = i;
+		cullWrites[i].descriptorType = i == 0
+			                               ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+			                               : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		cullWrites[i].pBufferInfo = &cullBufferInfos[i];
+	}
 
-	std::vector<VkDescriptorSetLayout> layouts(s_swapChainImagesViews.size(),
-	                                           s_descriptorLayout);
+	vkUpdateDescriptorSets(s_logicalDevice,
+	                       static_cast<uint32_t>(cullWrites.size()),
+	                       cullWrites.data(), 0, nullptr);
+}
 
+int createDescriptorSet()
+{
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.pNext = nullptr;
 	allocInfo.descriptorPool = s_descriptorPool;
-	allocInfo.descriptorSetCount = s_swapChainImagesViews.size();
-	allocInfo.pSetLayouts = layouts.data();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &s_descriptorLayout;
 
 	vk_res = vkAllocateDescriptorSets(s_logicalDevice, &allocInfo,
-	                                  s_descriptorSets.data());
+	                                  &s_descriptorSet);
 	ASSERT_VK(vk_res);
 
-	for (size_t i = 0; i < s_swapChainImagesViews.size(); ++i)
+	if (s_options.gpuCulling)
+	{
+		allocInfo.pSetLayouts = &s_cullDescriptorLayout;
+
+		vk_res = vkAllocateDescriptorSets(s_logicalDevice, &allocInfo,
+		                                  &s_cullDescriptorSet);
+		ASSERT_VK(vk_res);
+	}
+
+	// Written with the depth pyramid, for its number of levels
+	if (s_options.occlusionCulling)
 	{
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.offset = 0;
-		bufferInfo.buffer = s_uniformBuffers[i];
-		bufferInfo.range = VK_WHOLE_SIZE;
+		std::array<VkDescriptorSetLayout, HIZ_MAX_LEVELS> layouts;
+		layouts.fill(s_hiZDescriptorLayout);
 
-		VkWriteDescriptorSet descriptorWrite = {};
-		descriptorWrite.pNext = nullptr;
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = s_descriptorSets[i];
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
-		descriptorWrite.descriptorCount = 1;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.pBufferInfo = &bufferInfo;
+		allocInfo.descriptorSetCount = HIZ_MAX_LEVELS;
+		allocInfo.pSetLayouts = layouts.data();
 
-		vkUpdateDescriptorSets(s_logicalDevice, 1, &descriptorWrite, 0,
-		                       nullptr);
+		vk_res = vkAllocateDescriptorSets(s_logicalDevice, &allocInfo,
+		                                  s_hiZDescriptorSets);
+		ASSERT_VK(vk_res);
 	}
 
+	updateDescriptorSet();
+
 	return EXIT_SUCCESS;
 }
 
-int createVertexAndIndexBuffers()
+// Mesh loading
+//
+// Wavefront OBJ and binary glTF 2.0 files are decoded into the interleaved
+// Vertex layout. Each file is split into meshes (OBJ objects and groups,
+// glTF primitives) decoded in parallel on a worker pool, then merged into a
+// single vertex and index list.
+
+struct Mesh
 {
-	createBufferWithStaging(vertices.data(), vertices.size(), sizeof Vertex,
-	                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, s_vertexBuffer,
-	                        s_vertexBufferMemory);
-	createBufferWithStaging(indices.data(), indices.size(), sizeof uint16_t,
-	                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, s_indexBuffer,
-	                        s_indexBufferMemory);
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
 
-	return EXIT_SUCCESS;
-}
+// Scene geometry, the cube unless --mesh loads a model
+static Mesh s_mesh;
+static VkIndexType s_indexType = VK_INDEX_TYPE_UINT16;
+static uint32_t s_indexCount;
+// Mesh space bounding box, the culling pass derives its volumes from it
+static glm::vec3 s_meshBoundsMin;
+static glm::vec3 s_meshBoundsMax;
 
-int createCommandPools()
+// Largest side of the bounding box, 1 for the cube
+static float meshSize()
 {
-	VkCommandPoolCreateInfo commandPoolInfo = {};
-	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	commandPoolInfo.pNext = nullptr;
-	commandPoolInfo.queueFamilyIndex = s_graphicQueueFamilyIndex;
+	const glm::vec3 size = s_meshBoundsMax - s_meshBoundsMin;
+	return std::max(std::max(size.x, size.y), size.z);
+}
 
-	vk_res = vkCreateCommandPool(s_logicalDevice, &commandPoolInfo, nullptr,
-	                             &s_commandPool);
-	ASSERT_VK(vk_res);
+// OBJ text is cut in chunks of about this size, so large objects are still
+// parsed by several workers
+const size_t OBJ_CHUNK_SIZE = 4 * 1024 * 1024;
 
-	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+// Vertex colors are used when the file has them, otherwise the normal is
+// shown, and white without either
+static glm::vec3 meshVertexColor(const glm::vec3* color,
+                                 const glm::vec3* normal)
+{
+	if (color != nullptr)
+	{
+		return *color;
+	}
+	if (normal != nullptr)
+	{
+		return *normal * 0.5f + glm::vec3(0.5f);
+	}
+	return glm::vec3(1.0f);
+}
+
+// Jobs sized to the machine, the calling thread takes part
+static void runLoadJobs(uint32_t jobCount,
+                        const std::function<void(uint32_t)>& job)
+{
+	const uint32_t threads = std::max(1u, std::min(
+		                                  jobCount,
+		                                  std::thread::hardware_concurrency()));
+
+	WorkerPool pool;
+	startWorkers(pool, threads - 1);
+	runJobs(pool, jobCount, job);
+	stopWorkers(pool);
+}
+
+// Append the meshes one after the other, rebasing their indices
+static void mergeMeshes(std::vector<Mesh>& meshes, Mesh& mesh)
+{
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (const Mesh& part : meshes)
+	{
+		vertexCount += part.vertices.size();
+		indexCount += part.indices.size();
+	}
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.vertices.reserve(vertexCount);
+	mesh.indices.reserve(indexCount);
+
+	for (Mesh& part : meshes)
+	{
+		const uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+
+		mesh.vertices.insert(mesh.vertices.end(), part.vertices.begin(),
+		                     part.vertices.end());
+		for (uint32_t index : part.indices)
+		{
+			mesh.indices.push_back(base + index);
+		}
+
+		part = Mesh();
+	}
+}
+
+// OBJ
+//
+// A sequential pass cuts the text in chunks and counts the attributes each
+// one declares, so every chunk knows where its attributes start. Chunks are
+// then parsed in parallel into the shared attribute arrays, and each mesh
+// gathers the faces of its chunks into its own vertices.
+
+struct ObjCorner
+{
+	int32_t position;
+	int32_t normal; // -1 without normal
+};
+
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+	uint32_t mesh;
+	uint32_t firstPosition;
+	uint32_t firstNormal;
+	std::vector<ObjCorner> corners; // Triangles, fans of the faces
+	std::string error;
+};
+
+static const char* skipObjSpaces(const char* cursor, const char* end)
+{
+	while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+	{
+		cursor++;
+	}
+	return cursor;
+}
+
+static const char* findLineEnd(const char* cursor, const char* end)
+{
+	const void* newline = memchr(cursor, '\n', end - cursor);
+	return newline != nullptr ? static_cast<const char*>(newline) : end;
+}
+
+// Reads up to count floats, returns how many were found
+static int parseObjFloats(const char* cursor, const char* end, float* values,
+                          int count)
+{
+	// strtof stops at the newline, the line is not copied
+	int parsed = 0;
+	while (parsed < count)
+	{
+		cursor = skipObjSpaces(cursor, end);
+		if (cursor >= end || *cursor == '\r' || *cursor == '#')
+		{
+			break;
+		}
+
+		char* next;
+		values[parsed] = std::strtof(cursor, &next);
+		if (next == cursor)
+		{
+			break;
+		}
+		cursor = next;
+		parsed++;
+	}
+	return parsed;
+}
+
+// 1-based, negative values count back from the last declared attribute
+static bool resolveObjIndex(long value, uint32_t declared, int32_t& index)
+{
+	const long resolved = value > 0 ? value - 1 : declared + value;
+	if (value == 0 || resolved < 0 || resolved >= static_cast<long>(declared))
+	{
+		return false;
+	}
+	index = static_cast<int32_t>(resolved);
+	return true;
+}
+
+static void parseObjChunk(ObjChunk& chunk, std::vector<glm::vec3>& positions,
+                          std::vector<glm::vec3>& colors,
+                          std::vector<uint8_t>& hasColor,
+                          std::vector<glm::vec3>& normals)
+{
+	uint32_t positionCount = chunk.firstPosition;
+	uint32_t normalCount = chunk.firstNormal;
+	std::vector<ObjCorner> face;
+
+	for (const char* line = chunk.begin; line < chunk.end;)
+	{
+		const char* lineEnd = findLineEnd(line, chunk.end);
+		const char* cursor = skipObjSpaces(line, lineEnd);
+		line = lineEnd + 1;
+
+		if (lineEnd - cursor < 2 || (cursor[1] != ' ' && cursor[1] != '\t' &&
+			cursor[1] != 'n'))
+		{
+			continue;
+		}
+
+		if (cursor[0] == 'v' && cursor[1] != 'n')
+		{
+			// Position, with an optional RGB color
+			float values[6];
+			const int count = parseObjFloats(cursor + 1, lineEnd, values, 6);
+			if (count < 3)
+			{
+				chunk.error = "bad vertex position";
+				return;
+			}
+
+			positions[positionCount] = glm::vec3(values[0], values[1],
+			                                     values[2]);
+			if (count == 6)
+			{
+				colors[positionCount] = glm::vec3(values[3], values[4],
+				                                  values[5]);
+				hasColor[positionCount] = 1;
+			}
+			positionCount++;
+		}
+		else if (cursor[0] == 'v' && cursor[1] == 'n')
+		{
+			float values[3];
+			if (parseObjFloats(cursor + 2, lineEnd, values, 3) != 3)
+			{
+				chunk.error = "bad vertex normal";
+				return;
+			}
+			normals[normalCount++] = glm::normalize(
+				glm::vec3(values[0], values[1], values[2]));
+		}
+		else if (cursor[0] == 'f' && cursor[1] != 'n')
+		{
+			// v, v/vt, v//vn or v/vt/vn corners
+			face.clear();
+			cursor++;
+
+			for (;;)
+			{
+				cursor = skipObjSpaces(cursor, lineEnd);
+				if (cursor >= lineEnd || *cursor == '\r' || *cursor == '#')
+				{
+					break;
+				}
+
+				char* next;
+				ObjCorner corner = {0, -1};
+				if (!resolveObjIndex(std::strtol(cursor, &next, 10),
+				                     positionCount, corner.position))
+				{
+					chunk.error = "bad face index";
+					return;
+				}
+				cursor = next;
+
+				if (cursor < lineEnd && *cursor == '/')
+				{
+					cursor++;
+					// Texture coordinates are not used
+					std::strtol(cursor, &next, 10);
+					cursor = next;
+
+					if (cursor < lineEnd && *cursor == '/')
+					{
+						cursor++;
+						if (!resolveObjIndex(std::strtol(cursor, &next, 10),
+						                     normalCount, corner.normal))
+						{
+							chunk.error = "bad face normal index";
+							return;
+						}
+						cursor = next;
+					}
+				}
+
+				face.push_back(corner);
+			}
+
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[i - 1]);
+				chunk.corners.push_back(face[i]);
+			}
+		}
+	}
+}
+
+// The file must end with a null character, strtof() may look past the
+// last line
+static int loadObj(const std::vector<char>& file, Mesh& mesh,
+                   uint32_t& meshCount)
+{
+	const char* const begin = file.data();
+	const char* const end = begin + file.size() - 1;
+
+	// Cut at object and group starts and every OBJ_CHUNK_SIZE bytes
+	std::vector<ObjChunk> chunks;
+	uint32_t positionCount = 0;
+	uint32_t normalCount = 0;
+	uint32_t meshIndex = 0;
+	bool meshHasFaces = false;
+
+	auto startChunk = [&](const char* start)
+	{
+		if (!chunks.empty())
+		{
+			chunks.back().end = start;
+		}
+		ObjChunk chunk = {};
+		chunk.begin = start;
+		chunk.mesh = meshIndex;
+		chunk.firstPosition = positionCount;
+		chunk.firstNormal = normalCount;
+		chunks.push_back(chunk);
+	};
+
+	startChunk(begin);
+
+	for (const char* line = begin; line < end;)
+	{
+		const char* lineEnd = findLineEnd(line, end);
+		const char* cursor = skipObjSpaces(line, lineEnd);
+
+		if (lineEnd - cursor >= 2 && (cursor[1] == ' ' || cursor[1] == '\t'))
+		{
+			if ((cursor[0] == 'o' || cursor[0] == 'g') && meshHasFaces)
+			{
+				meshIndex++;
+				meshHasFaces = false;
+				startChunk(line);
+			}
+			else if (line - chunks.back().begin >= static_cast<ptrdiff_t>(
+				OBJ_CHUNK_SIZE))
+			{
+				startChunk(line);
+			}
+
+			positionCount += cursor[0] == 'v';
+			meshHasFaces |= cursor[0] == 'f';
+		}
+		else if (lineEnd - cursor >= 3 && cursor[0] == 'v' && cursor[1] ==
+			'n')
+		{
+			normalCount++;
+		}
+
+		line = lineEnd + 1;
+	}
+
+	chunks.back().end = end;
+	meshCount = meshIndex + 1;
+
+	std::vector<glm::vec3> positions(positionCount);
+	std::vector<glm::vec3> colors(positionCount);
+	// Bytes rather than std::vector<bool>, chunks write side by side
+	std::vector<uint8_t> hasColor(positionCount, 0);
+	std::vector<glm::vec3> normals(normalCount);
+
+	runLoadJobs(static_cast<uint32_t>(chunks.size()), [&](uint32_t job)
+	{
+		parseObjChunk(chunks[job], positions, colors, hasColor, normals);
+	});
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (!chunk.error.empty())
+		{
+			std::cerr << "OBJ: " << chunk.error << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Each mesh dedupes its position and normal pairs
+	std::vector<Mesh> meshes(meshCount);
+
+	runLoadJobs(meshCount, [&](uint32_t job)
+	{
+		Mesh& part = meshes[job];
+		std::unordered_map<uint64_t, uint32_t> remap;
+
+		for (const ObjChunk& chunk : chunks)
+		{
+			if (chunk.mesh != job)
+			{
+				continue;
+			}
+
+			for (const ObjCorner& corner : chunk.corners)
+			{
+				const uint64_t key = static_cast<uint64_t>(corner.position) <<
+					32 | static_cast<uint32_t>(corner.normal);
+				const auto inserted = remap.emplace(
+					key, static_cast<uint32_t>(part.vertices.size()));
+
+				if (inserted.second)
+				{
+					Vertex vertex;
+					vertex.position = positions[corner.position];
+					vertex.color = meshVertexColor(
+						hasColor[corner.position]
+							? &colors[corner.position]
+							: nullptr,
+						corner.normal >= 0 ? &normals[corner.normal] : nullptr);
+					part.vertices.push_back(vertex);
+				}
+				part.indices.push_back(inserted.first->second);
+			}
+		}
+	});
+
+	mergeMeshes(meshes, mesh);
+
+	return EXIT_SUCCESS;
+}
+
+// glTF
+//
+// Only what the binary container needs: a small JSON reader for the
+// document, accessors into the BIN chunk and the node hierarchy. Every
+// triangle primitive placed by a node is one mesh, transformed to scene
+// space.
+
+struct JsonValue
+{
+	enum Type
+	{
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT
+	};
+
+	Type type = JSON_NULL;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> elements; // Array elements or object values
+	std::vector<std::string> keys; // Object keys, same order as elements
+
+	const JsonValue* find(const char* key) const
+	{
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			if (keys[i] == key)
+			{
+				return &elements[i];
+			}
+		}
+		return nullptr;
+	}
+
+	const JsonValue* at(size_t index) const
+	{
+		return type == JSON_ARRAY && index < elements.size()
+			       ? &elements[index]
+			       : nullptr;
+	}
+
+	// Element at the index held by a JSON number, null when there is none,
+	// or it is negative or out of range
+	const JsonValue* atIndex(const JsonValue* index) const
+	{
+		return index != nullptr && index->type == JSON_NUMBER &&
+		       index->number >= 0.0 && index->number < elements.size()
+			       ? at(static_cast<size_t>(index->number))
+			       : nullptr;
+	}
+
+	double numberOr(const char* key, double fallback) const
+	{
+		const JsonValue* value = find(key);
+		return value != nullptr && value->type == JSON_NUMBER
+			       ? value->number
+			       : fallback;
+	}
+
+	bool boolOr(const char* key, bool fallback) const
+	{
+		const JsonValue* value = find(key);
+		return value != nullptr && value->type == JSON_BOOL
+			       ? value->number != 0.0
+			       : fallback;
+	}
+};
+
+static void skipJsonSpaces(const char*& cursor, const char* end)
+{
+	while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor ==
+		'\n' || *cursor == '\r'))
+	{
+		cursor++;
+	}
+}
+
+static bool parseJsonString(const char*& cursor, const char* end,
+                            std::string& string)
+{
+	// Names and keys of glTF are ASCII, escapes are kept simple
+	cursor++;
+	while (cursor < end && *cursor != '"')
+	{
+		if (*cursor == '\\' && cursor + 1 < end)
+		{
+			cursor++;
+			switch (*cursor)
+			{
+			case 'n': string += '\n';
+				break;
+			case 't': string += '\t';
+				break;
+			case 'u': string += '?';
+				// Four hex digits follow, all of them inside the chunk
+				if (end - cursor <= 4)
+				{
+					return false;
+				}
+				cursor += 4;
+				break;
+			default: string += *cursor;
+				break;
+			}
+		}
+		else
+		{
+			string += *cursor;
+		}
+		cursor++;
+	}
+
+	if (cursor >= end)
+	{
+		return false;
+	}
+	cursor++;
+	return true;
+}
+
+static bool parseJson(const char*& cursor, const char* end, JsonValue& value,
+                      int depth = 0)
+{
+	skipJsonSpaces(cursor, end);
+	if (cursor >= end || depth > 64)
+	{
+		return false;
+	}
+
+	if (*cursor == '{' || *cursor == '[')
+	{
+		const bool object = *cursor == '{';
+		const char close = object ? '}' : ']';
+		value.type = object ? JsonValue::JSON_OBJECT : JsonValue::JSON_ARRAY;
+		cursor++;
+
+		skipJsonSpaces(cursor, end);
+		if (cursor < end && *cursor == close)
+		{
+			cursor++;
+			return true;
+		}
+
+		for (;;)
+		{
+			if (object)
+			{
+				skipJsonSpaces(cursor, end);
+				value.keys.emplace_back();
+				if (cursor >= end || *cursor != '"' || !parseJsonString(
+					cursor, end, value.keys.back()))
+				{
+					return false;
+				}
+
+				skipJsonSpaces(cursor, end);
+				if (cursor >= end || *cursor != ':')
+				{
+					return false;
+				}
+				cursor++;
+			}
+
+			value.elements.emplace_back();
+			if (!parseJson(cursor, end, value.elements.back(), depth + 1))
+			{
+				return false;
+			}
+
+			skipJsonSpaces(cursor, end);
+			if (cursor < end && *cursor == ',')
+			{
+				cursor++;
+			}
+			else if (cursor < end && *cursor == close)
+			{
+				cursor++;
+				return true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+	}
+
+	if (*cursor == '"')
+	{
+		value.type = JsonValue::JSON_STRING;
+		return parseJsonString(cursor, end, value.string);
+	}
+
+	if ((end - cursor >= 4 && strncmp(cursor, "true", 4) == 0) ||
+		(end - cursor >= 5 && strncmp(cursor, "false", 5) == 0))
+	{
+		value.type = JsonValue::JSON_BOOL;
+		value.number = *cursor == 't' ? 1.0 : 0.0;
+		cursor += *cursor == 't' ? 4 : 5;
+		return true;
+	}
+
+	if (end - cursor >= 4 && strncmp(cursor, "null", 4) == 0)
+	{
+		cursor += 4;
+		return true;
+	}
+
+	// The chunk is not NUL terminated and the BIN chunk header after it may
+	// hold anything, the number is copied out before strtod() reads it
+	char number[64];
+	size_t length = 0;
+	while (cursor + length < end && length < sizeof number - 1 &&
+		cursor[length] != '\0' &&
+		strchr("0123456789+-.eE", cursor[length]) != nullptr)
+	{
+		length++;
+	}
+	memcpy(number, cursor, length);
+	number[length] = '\0';
+
+	char* next;
+	value.type = JsonValue::JSON_NUMBER;
+	value.number = std::strtod(number, &next);
+	if (next == number)
+	{
+		return false;
+	}
+	cursor += next - number;
+	return true;
+}
+
+// Typed view on the BIN chunk
+struct GltfAccessor
+{
+	const uint8_t* data;
+	uint32_t count;
+	uint32_t components;
+	uint32_t componentType;
+	uint32_t stride;
+	bool normalized;
+};
+
+enum GltfComponentType
+{
+	GLTF_BYTE = 5120,
+	GLTF_UNSIGNED_BYTE = 5121,
+	GLTF_SHORT = 5122,
+	GLTF_UNSIGNED_SHORT = 5123,
+	GLTF_UNSIGNED_INT = 5125,
+	GLTF_FLOAT = 5126
+};
+
+static uint32_t gltfComponentSize(uint32_t componentType)
+{
+	switch (componentType)
+	{
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE: return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT: return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT: return 4;
+	default: return 0;
+	}
+}
+
+static bool getGltfAccessor(const JsonValue& document, const uint8_t* bin,
+                            size_t binSize, const JsonValue* index,
+                            GltfAccessor& accessor)
+{
+	const JsonValue* accessors = document.find("accessors");
+	const JsonValue* views = document.find("bufferViews");
+	const JsonValue* json = accessors != nullptr
+		                        ? accessors->atIndex(index)
+		                        : nullptr;
+	if (json == nullptr || views == nullptr)
+	{
+		return false;
+	}
+
+	// Sparse accessors and accessors without view are not supported
+	const JsonValue* view = views->atIndex(json->find("bufferView"));
+	const JsonValue* type = json->find("type");
+	if (view == nullptr || type == nullptr || view->numberOr("buffer", 0.0) !=
+		0.0)
+	{
+		return false;
+	}
+
+	static const char* TYPES[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+	accessor.components = 0;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (type->string == TYPES[i])
+		{
+			accessor.components = i + 1;
+		}
+	}
+
+	accessor.componentType = static_cast<uint32_t>(json->numberOr(
+		"componentType", 0.0));
+	accessor.count = static_cast<uint32_t>(json->numberOr("count", 0.0));
+	accessor.normalized = json->boolOr("normalized", false);
+
+	const uint32_t elementSize = accessor.components * gltfComponentSize(
+		accessor.componentType);
+	accessor.stride = static_cast<uint32_t>(view->numberOr("byteStride",
+	                                                       elementSize));
+
+	const size_t offset = static_cast<size_t>(view->numberOr("byteOffset",
+	                                                         0.0) +
+		json->numberOr("byteOffset", 0.0));
+	const size_t viewEnd = static_cast<size_t>(view->numberOr("byteOffset",
+	                                                          0.0) +
+		view->numberOr("byteLength", 0.0));
+
+	if (elementSize == 0 || accessor.count == 0 || viewEnd > binSize ||
+		offset + static_cast<size_t>(accessor.count - 1) * accessor.stride +
+		elementSize > viewEnd)
+	{
+		return false;
+	}
+
+	accessor.data = bin + offset;
+	return true;
+}
+
+// Component of an element as float, normalized integers mapped to [0, 1]
+// or [-1, 1]
+static float readGltfComponent(const GltfAccessor& accessor, uint32_t element,
+                               uint32_t component)
+{
+	const uint8_t* data = accessor.data + static_cast<size_t>(element) *
+		accessor.stride + component * gltfComponentSize(accessor.componentType);
+
+	switch (accessor.componentType)
+	{
+	case GLTF_BYTE:
+		{
+			const int8_t value = *reinterpret_cast<const int8_t*>(data);
+			return accessor.normalized
+				       ? std::max(value / 127.0f, -1.0f)
+				       : value;
+		}
+	case GLTF_UNSIGNED_BYTE:
+		return accessor.normalized ? *data / 255.0f : *data;
+	case GLTF_SHORT:
+		{
+			int16_t value;
+			memcpy(&value, data, sizeof value);
+			return accessor.normalized
+				       ? std::max(value / 32767.0f, -1.0f)
+				       : value;
+		}
+	case GLTF_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, data, sizeof value);
+			return accessor.normalized ? value / 65535.0f : value;
+		}
+	case GLTF_UNSIGNED_INT:
+		{
+			uint32_t value;
+			memcpy(&value, data, sizeof value);
+			return static_cast<float>(value);
+		}
+	default:
+		{
+			float value;
+			memcpy(&value, data, sizeof value);
+			return value;
+		}
+	}
+}
+
+static glm::vec3 readGltfVec3(const GltfAccessor& accessor, uint32_t element)
+{
+	return glm::vec3(readGltfComponent(accessor, element, 0),
+	                 readGltfComponent(accessor, element, 1),
+	                 readGltfComponent(accessor, element, 2));
+}
+
+static glm::mat4 gltfNodeMatrix(const JsonValue& node)
+{
+	const JsonValue* matrix = node.find("matrix");
+	if (matrix != nullptr && matrix->elements.size() == 16)
+	{
+		// Column major like glm
+		glm::mat4 result(1.0f);
+		for (int i = 0; i < 16; i++)
+		{
+			result[i / 4][i % 4] = static_cast<float>(matrix->elements[i].
+				number);
+		}
+		return result;
+	}
+
+	glm::vec3 translation(0.0f);
+	glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale(1.0f);
+
+	const JsonValue* t = node.find("translation");
+	if (t != nullptr && t->elements.size() == 3)
+	{
+		translation = glm::vec3(static_cast<float>(t->elements[0].number),
+		                        static_cast<float>(t->elements[1].number),
+		                        static_cast<float>(t->elements[2].number));
+	}
+
+	// Stored x, y, z, w
+	const JsonValue* r = node.find("rotation");
+	if (r != nullptr && r->elements.size() == 4)
+	{
+		rotation = glm::quat(static_cast<float>(r->elements[3].number),
+		                     static_cast<float>(r->elements[0].number),
+		                     static_cast<float>(r->elements[1].number),
+		                     static_cast<float>(r->elements[2].number));
+	}
+
+	const JsonValue* s = node.find("scale");
+	if (s != nullptr && s->elements.size() == 3)
+	{
+		scale = glm::vec3(static_cast<float>(s->elements[0].number),
+		                  static_cast<float>(s->elements[1].number),
+		                  static_cast<float>(s->elements[2].number));
+	}
+
+	return glm::translate(glm::mat4(1.0f), translation) *
+		glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+}
+
+// A primitive placed in the scene by a node
+struct GltfDraw
+{
+	const JsonValue* primitive;
+	glm::mat4 transform;
+};
+
+static void collectGltfDraws(const JsonValue& document,
+                             const JsonValue& nodeIndex,
+                             const glm::mat4& parent,
+                             std::vector<GltfDraw>& draws, int depth = 0)
+{
+	const JsonValue* nodes = document.find("nodes");
+	const JsonValue* node = nodes != nullptr ? nodes->atIndex(&nodeIndex) : nullptr;
+	if (node == nullptr || depth > 64)
+	{
+		return;
+	}
+
+	const glm::mat4 transform = parent * gltfNodeMatrix(*node);
+
+	const JsonValue* meshes = document.find("meshes");
+	const JsonValue* mesh = meshes != nullptr
+		                        ? meshes->atIndex(node->find("mesh"))
+		                        : nullptr;
+	const JsonValue* primitives = mesh != nullptr
+		                              ? mesh->find("primitives")
+		                              : nullptr;
+	if (primitives != nullptr)
+	{
+		for (const JsonValue& primitive : primitives->elements)
+		{
+			draws.push_back({&primitive, transform});
+		}
+	}
+
+	const JsonValue* children = node->find("children");
+	if (children != nullptr)
+	{
+		for (const JsonValue& child : children->elements)
+		{
+			collectGltfDraws(document, child, transform, draws, depth + 1);
+		}
+	}
+}
+
+static std::string loadGltfPrimitive(const JsonValue& document,
+                                     const uint8_t* bin, size_t binSize,
+                                     const GltfDraw& draw, Mesh& mesh)
+{
+	const JsonValue& primitive = *draw.primitive;
+
+	// Points and lines are skipped
+	if (primitive.numberOr("mode", 4.0) != 4.0)
+	{
+		return std::string();
+	}
+
+	const JsonValue* attributes = primitive.find("attributes");
+	const JsonValue* position = attributes != nullptr
+		                            ? attributes->find("POSITION")
+		                            : nullptr;
+	GltfAccessor positions;
+	if (position == nullptr || !getGltfAccessor(
+		document, bin, binSize, position, positions) || positions.
+		components != 3)
+	{
+		return "bad POSITION accessor";
+	}
+
+	GltfAccessor normals = {};
+	const JsonValue* normal = attributes->find("NORMAL");
+	if (normal != nullptr && (!getGltfAccessor(document, bin, binSize,
+	                                           normal, normals) ||
+		normals.components != 3 || normals.count != positions.count))
+	{
+		return "bad NORMAL accessor";
+	}
+
+	GltfAccessor colors = {};
+	const JsonValue* color = attributes->find("COLOR_0");
+	if (color != nullptr && (!getGltfAccessor(document, bin, binSize,
+	                                          color, colors) ||
+		colors.components < 3 || colors.count != positions.count))
+	{
+		return "bad COLOR_0 accessor";
+	}
+
+	mesh.vertices.resize(positions.count);
+	for (uint32_t i = 0; i < positions.count; i++)
+	{
+		Vertex& vertex = mesh.vertices[i];
+		vertex.position = glm::vec3(draw.transform * glm::vec4(
+			readGltfVec3(positions, i), 1.0f));
+
+		// Rotation and uniform scale only, normals only tint the colors
+		glm::vec3 vertexNormal;
+		if (normal != nullptr)
+		{
+			vertexNormal = glm::normalize(glm::vec3(draw.transform *
+				glm::vec4(readGltfVec3(normals, i), 0.0f)));
+		}
+
+		glm::vec3 vertexColor;
+		if (color != nullptr)
+		{
+			vertexColor = readGltfVec3(colors, i);
+		}
+
+		vertex.color = meshVertexColor(color != nullptr ? &vertexColor : nullptr,
+		                               normal != nullptr
+			                               ? &vertexNormal
+			                               : nullptr);
+	}
+
+	const JsonValue* indices = primitive.find("indices");
+	if (indices == nullptr)
+	{
+		// Not indexed, every three vertices are a triangle
+		mesh.indices.resize(positions.count / 3 * 3);
+		for (uint32_t i = 0; i < mesh.indices.size(); i++)
+		{
+			mesh.indices[i] = i;
+		}
+		return std::string();
+	}
+
+	GltfAccessor indexAccessor;
+	if (!getGltfAccessor(document, bin, binSize, indices,
+	                     indexAccessor) || indexAccessor.components != 1 ||
+		(indexAccessor.componentType != GLTF_UNSIGNED_BYTE && indexAccessor.
+			componentType != GLTF_UNSIGNED_SHORT && indexAccessor.componentType
+			!= GLTF_UNSIGNED_INT))
+	{
+		return "bad indices accessor";
+	}
+
+	mesh.indices.resize(indexAccessor.count / 3 * 3);
+	for (uint32_t i = 0; i < mesh.indices.size(); i++)
+	{
+		// Read as integers, floats lose 32-bit indices above 2^24
+		const uint8_t* data = indexAccessor.data + static_cast<size_t>(i) *
+			indexAccessor.stride;
+		uint32_t index = 0;
+		memcpy(&index, data, gltfComponentSize(indexAccessor.componentType));
+		if (index >= positions.count)
+		{
+			return "index out of range";
+		}
+		mesh.indices[i] = index;
+	}
+
+	return std::string();
+}
+
+// Binary glTF: 12 byte header, then the JSON and BIN chunks
+static int loadGlb(const std::vector<char>& file, Mesh& mesh,
+                   uint32_t& meshCount)
+{
+	const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+	const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+	const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+	uint32_t header[3];
+	if (file.size() < 20)
+	{
+		std::cerr << "glTF: file too small" << std::endl;
+		return EXIT_FAILURE;
+	}
+	memcpy(header, file.data(), sizeof header);
+	if (header[0] != GLB_MAGIC || header[1] != 2)
+	{
+		std::cerr << "glTF: not a binary glTF 2.0 file" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const char* json = nullptr;
+	size_t jsonSize = 0;
+	const uint8_t* bin = nullptr;
+	size_t binSize = 0;
+
+	for (size_t offset = 12; offset + 8 <= file.size();)
+	{
+		uint32_t chunk[2]; // Length, type
+		memcpy(chunk, file.data() + offset, sizeof chunk);
+		offset += 8;
+		if (chunk[0] > file.size() - offset)
+		{
+			std::cerr << "glTF: truncated chunk" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		if (chunk[1] == GLB_CHUNK_JSON && json == nullptr)
+		{
+			json = file.data() + offset;
+			jsonSize = chunk[0];
+		}
+		else if (chunk[1] == GLB_CHUNK_BIN && bin == nullptr)
+		{
+			bin = reinterpret_cast<const uint8_t*>(file.data() + offset);
+			binSize = chunk[0];
+		}
+		offset += (chunk[0] + 3) & ~3u;
+	}
+
+	JsonValue document;
+	const char* cursor = json;
+	if (json == nullptr || !parseJson(cursor, json + jsonSize, document) ||
+		document.type != JsonValue::JSON_OBJECT)
+	{
+		std::cerr << "glTF: bad JSON chunk" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Nodes of the default scene, every mesh untransformed without scenes
+	std::vector<GltfDraw> draws;
+	const JsonValue* scenes = document.find("scenes");
+	const JsonValue* sceneIndex = document.find("scene");
+	const JsonValue* scene = scenes == nullptr
+		                         ? nullptr
+		                         : sceneIndex != nullptr
+		                         ? scenes->atIndex(sceneIndex)
+		                         : scenes->at(size_t(0));
+	const JsonValue* roots = scene != nullptr ? scene->find("nodes") : nullptr;
+
+	if (roots != nullptr)
+	{
+		for (const JsonValue& root : roots->elements)
+		{
+			collectGltfDraws(document, root,
+			                 glm::mat4(1.0f), draws);
+		}
+	}
+	else if (document.find("meshes") != nullptr)
+	{
+		for (const JsonValue& gltfMesh : document.find("meshes")->elements)
+		{
+			const JsonValue* primitives = gltfMesh.find("primitives");
+			if (primitives != nullptr)
+			{
+				for (const JsonValue& primitive : primitives->elements)
+				{
+					draws.push_back({&primitive, glm::mat4(1.0f)});
+				}
+			}
+		}
+	}
+
+	meshCount = static_cast<uint32_t>(draws.size());
+	std::vector<Mesh> meshes(draws.size());
+	std::vector<std::string> errors(draws.size());
+
+	runLoadJobs(meshCount, [&](uint32_t job)
+	{
+		errors[job] = loadGltfPrimitive(document, bin, binSize, draws[job],
+		                                meshes[job]);
+	});
+
+	for (const std::string& error : errors)
+	{
+		if (!error.empty())
+		{
+			std::cerr << "glTF: " << error << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	mergeMeshes(meshes, mesh);
+
+	return EXIT_SUCCESS;
+}
+
+// Load an .obj or .glb file into a single mesh
+static int loadMesh(const std::string& path, Mesh& mesh)
+{
+	const TimePoint startTime = std::chrono::high_resolution_clock::now();
+
+	std::vector<char> file = readFile(path);
+
+	const bool glb = path.size() >= 4 && path.compare(path.size() - 4, 4,
+	                                                  ".glb") == 0;
+	uint32_t meshCount = 0;
+	int result;
+
+	if (glb)
+	{
+		result = loadGlb(file, mesh, meshCount);
+	}
+	else
+	{
+		file.push_back('\0');
+		result = loadObj(file, mesh, meshCount);
+	}
+	ASSERT(result);
+
+	if (mesh.indices.empty())
+	{
+		std::cerr << path << " has no triangles" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const TimePoint endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << "Mesh : " << path << " (" << meshCount << " meshes, " <<
+		mesh.vertices.size() << " vertices, " << mesh.indices.size() / 3 <<
+		" triangles, " << (mesh.vertices.size() > UINT16_MAX ? 32 : 16) <<
+		"-bit indices) loaded in " << elapsedMs(startTime, endTime) << " ms on "
+		<< std::max(1u, std::thread::hardware_concurrency()) << " threads" <<
+		std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+// Mesh optimization
+//
+// Triangles are reordered for the post-transform vertex cache with Tipsify,
+// optionally followed by its cluster sort against overdraw, see
+// mesh_optimizer.h. Vertices are then renumbered in first use order for
+// fetch locality. A FIFO cache simulation measures the result.
+
+// Vertices renumbered in the order the triangles first use them, so the
+// vertex fetch walks the buffer forward. Unreferenced vertices are dropped
+static void optimizeVertexFetch(Mesh& mesh)
+{
+	const uint32_t UNUSED = UINT32_MAX;
+	std::vector<uint32_t> remap(mesh.vertices.size(), UNUSED);
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == UNUSED)
+		{
+			remap[index] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	mesh.vertices.swap(vertices);
+}
+
+static void optimizeMesh(Mesh& mesh, bool overdraw)
+{
+	const TimePoint startTime = std::chrono::high_resolution_clock::now();
+	const VertexCacheStats before = simulateVertexCache(
+		mesh.indices, mesh.vertices.size());
+
+	std::vector<uint32_t> clusterStarts;
+	optimizeVertexCache(mesh.indices, mesh.vertices.size(), clusterStarts);
+	if (overdraw)
+	{
+		optimizeOverdraw(mesh.indices, &mesh.vertices[0].position.x,
+		                 sizeof(Vertex), mesh.vertices.size(), clusterStarts);
+	}
+	optimizeVertexFetch(mesh);
+
+	const VertexCacheStats after = simulateVertexCache(
+		mesh.indices, mesh.vertices.size());
+	const TimePoint endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << "Mesh optimization : ACMR " << before.acmr << " -> " <<
+		after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr <<
+		" (FIFO " << VERTEX_CACHE_SIZE << ")" << (overdraw
+			                                          ? ", overdraw sorted"
+			                                          : "") << " in " <<
+		elapsedMs(startTime, endTime) << " ms" << std::endl;
+}
+
+// Vertex compression
+//
+// Positions are quantized to 16 bits in the mesh bounding box, which the
+// shaders get back from the uniforms. Normals, area weighted from the
+// triangles, are octahedral encoded: projected on the octahedron
+// |x| + |y| + |z| = 1 whose lower half is folded over the upper one, leaving
+// two coordinates.
+
+static uint8_t quantizeUnorm8(float value)
+{
+	return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f),
+	                                                 1.0f) * 255.0f));
+}
+
+static uint16_t encodeOctahedral(const glm::vec3& normal)
+{
+	const float sum = std::abs(normal.x) + std::abs(normal.y) +
+		std::abs(normal.z);
+	if (sum == 0.0f)
+	{
+		return encodeOctahedral(glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	float x = normal.x / sum;
+	float y = normal.y / sum;
+	if (normal.z < 0.0f)
+	{
+		const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	return static_cast<uint16_t>(quantizeUnorm8(x * 0.5f + 0.5f) |
+		quantizeUnorm8(y * 0.5f + 0.5f) << 8);
+}
+
+static void packVertices(const Mesh& mesh, std::vector<PackedVertex>& packed)
+{
+	std::vector<glm::vec3> normals(mesh.vertices.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const glm::vec3& a = mesh.vertices[mesh.indices[i]].position;
+		const glm::vec3& b = mesh.vertices[mesh.indices[i + 1]].position;
+		const glm::vec3& c = mesh.vertices[mesh.indices[i + 2]].position;
+
+		// Length is twice the area
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			normals[mesh.indices[i + corner]] += normal;
+		}
+	}
+
+	const glm::vec3 extent = s_meshBoundsMax - s_meshBoundsMin;
+
+	packed.resize(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		const Vertex& vertex = mesh.vertices[i];
+		PackedVertex& packedVertex = packed[i];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float position = extent[axis] > 0.0f
+				                       ? (vertex.position[axis] -
+					                       s_meshBoundsMin[axis]) / extent[axis]
+				                       : 0.0f;
+			packedVertex.position[axis] = static_cast<uint16_t>(std::lround(
+				std::min(std::max(position, 0.0f), 1.0f) * 65535.0f));
+		}
+		packedVertex.position[3] = encodeOctahedral(normals[i]);
+
+		packedVertex.color[0] = quantizeUnorm8(vertex.color.x);
+		packedVertex.color[1] = quantizeUnorm8(vertex.color.y);
+		packedVertex.color[2] = quantizeUnorm8(vertex.color.z);
+		packedVertex.color[3] = 255;
+	}
+}
+
+// Splits the mesh in meshlets and rewrites its indices cluster by cluster,
+// each cluster is then a range of the index buffer
+static int createMeshletBuffer()
+{
+	const TimePoint startTime = std::chrono::high_resolution_clock::now();
+
+	MeshletData data;
+	buildMeshlets(data, s_mesh.indices.data(), s_mesh.indices.size(),
+	              s_mesh.vertices.size());
+
+	std::vector<GpuMeshlet> meshlets(data.meshlets.size());
+	std::vector<uint32_t> indices;
+	indices.reserve(s_mesh.indices.size());
+
+	for (size_t i = 0; i < data.meshlets.size(); i++)
+	{
+		const Meshlet& meshlet = data.meshlets[i];
+		const MeshletBounds bounds = computeMeshletBounds(
+			data, meshlet, &s_mesh.vertices[0].position.x, sizeof(Vertex));
+
+		GpuMeshlet& gpuMeshlet = meshlets[i];
+		gpuMeshlet.boundingSphere = glm::vec4(bounds.center[0],
+		                                      bounds.center[1],
+		                                      bounds.center[2], bounds.radius);
+		gpuMeshlet.coneApex = glm::vec4(bounds.coneApex[0], bounds.coneApex[1],
+		                                bounds.coneApex[2], 0.0f);
+		gpuMeshlet.coneAxis = glm::vec4(bounds.coneAxis[0], bounds.coneAxis[1],
+		                                bounds.coneAxis[2], bounds.coneCutoff);
+		gpuMeshlet.firstIndex = static_cast<uint32_t>(indices.size());
+		gpuMeshlet.indexCount = meshlet.triangleCount * 3;
+
+		for (uint32_t j = 0; j < meshlet.triangleCount * 3; j++)
+		{
+			indices.push_back(data.vertices[meshlet.vertexOffset + data.
+				triangles[meshlet.triangleOffset + j]]);
+		}
+	}
+
+	s_mesh.indices.swap(indices);
+	s_meshletCount = static_cast<uint32_t>(meshlets.size());
+
+	createBufferWithStaging(meshlets.data(), meshlets.size(),
+	                        sizeof(GpuMeshlet),
+	                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                        s_meshletBuffer, s_meshletBufferMemory);
+
+	const TimePoint endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << "Meshlets : " << s_meshletCount << " (" << static_cast<double>(
+			data.vertices.size()) / s_meshletCount << " vertices, " <<
+		s_mesh.indices.size() / 3.0 / s_meshletCount <<
+		" triangles on average) built in " << elapsedMs(startTime, endTime) <<
+		" ms" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+int createVertexAndIndexBuffers()
+{
+	if (s_options.meshFile.empty())
+	{
+		s_mesh.vertices = vertices;
+		s_mesh.indices.assign(indices.begin(), indices.end());
+	}
+	else
+	{
+		int result = loadMesh(s_options.meshFile, s_mesh);
+		ASSERT(result);
+	}
+
+	if (s_options.optimizeMesh)
+	{
+		optimizeMesh(s_mesh, s_options.optimizeOverdraw);
+	}
+
+	s_meshBoundsMin = s_meshBoundsMax = s_mesh.vertices[0].position;
+	for (const Vertex& vertex : s_mesh.vertices)
+	{
+		s_meshBoundsMin = glm::min(s_meshBoundsMin, vertex.position);
+		s_meshBoundsMax = glm::max(s_meshBoundsMax, vertex.position);
+	}
+
+	// Models of any size are framed like the cube
+	s_sceneScale = std::max(1.0f, meshSize());
+
+	if (s_options.meshlets)
+	{
+		int result = createMeshletBuffer();
+		ASSERT(result);
+	}
+
+	if (s_options.packedVertices)
+	{
+		std::vector<PackedVertex> packedVertices;
+		packVertices(s_mesh, packedVertices);
+
+		createBufferWithStaging(packedVertices.data(), packedVertices.size(),
+		                        sizeof(PackedVertex),
+		                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		                        s_vertexBuffer, s_vertexBufferMemory);
+
+		std::cout << "Vertices : " << packedVertices.size() << " packed, " <<
+			packedVertices.size() * sizeof(PackedVertex) / 1024.0 << " KB for "
+			<< s_mesh.vertices.size() * sizeof(Vertex) / 1024.0 <<
+			" KB unpacked" << std::endl;
+	}
+	else
+	{
+		createBufferWithStaging(s_mesh.vertices.data(),
+		                        s_mesh.vertices.size(), sizeof(Vertex),
+		                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		                        s_vertexBuffer, s_vertexBufferMemory);
+	}
+
+	// 16-bit indices halve the index fetch, as long as they can address
+	// every vertex
+	s_indexCount = static_cast<uint32_t>(s_mesh.indices.size());
+	if (s_mesh.vertices.size() <= UINT16_MAX)
+	{
+		const std::vector<uint16_t> shortIndices(s_mesh.indices.begin(),
+		                                         s_mesh.indices.end());
+		s_indexType = VK_INDEX_TYPE_UINT16;
+		createBufferWithStaging(shortIndices.data(), shortIndices.size(),
+		                        sizeof(uint16_t),
+		                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, s_indexBuffer,
+		                        s_indexBufferMemory);
+	}
+	else
+	{
+		s_indexType = VK_INDEX_TYPE_UINT32;
+		createBufferWithStaging(s_mesh.indices.data(), s_mesh.indices.size(),
+		                        sizeof(uint32_t),
+		                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, s_indexBuffer,
+		                        s_indexBufferMemory);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Transforms of the instances, see transform_store.h
+static TransformStore s_transforms;
+
+static VkDeviceSize instanceSliceOffset(uint32_t ringSlot)
+{
+	return ringSlot * s_instanceSliceSize;
+}
+
+// Vertex input of the instances, also read by the culling pass
+static VkBufferUsageFlags instanceBufferUsage()
+{
+	return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | (s_options.gpuCulling
+		                                            ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		                                            : 0);
+}
+
+// Animated instances are recomposed every frame straight into host visible
+// memory, one slice per swap image like the uniform ring
+int createInstanceRing()
+{
+	s_instanceRingSlots = static_cast<uint32_t>(s_swapChainImagesViews.size());
+
+	return createBuffer(instanceSliceOffset(s_instanceRingSlots),
+	                    instanceBufferUsage(),
+	                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, s_instanceBuffer,
+	                    s_instanceBufferMemory);
+}
+
+void destroyInstanceBuffer()
+{
+	if (s_options.instanceCount > 0)
+	{
+		vkDestroyBuffer(s_logicalDevice, s_instanceBuffer, nullptr);
+		freeMemory(s_instanceBufferMemory);
+	}
+}
+
+// Instances are laid out on a cube grid centered on the origin. Static ones
+// are uploaded once, nothing is done per object on the CPU afterwards
+int createInstanceBuffer()
+{
+	const uint32_t count = s_options.instanceCount;
+	if (count == 0)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(
+		static_cast<double>(count))));
+	while (static_cast<uint64_t>(side) * side * side < count)
+	{
+		side++;
+	}
+
+	// One mesh size between neighbours
+	const float spacing = 2.0f * meshSize();
+	const float center = (side - 1) * spacing * 0.5f;
+
+	s_transforms.resize(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		s_transforms.positionX[i] = i % side * spacing - center;
+		s_transforms.positionY[i] = i / side % side * spacing - center;
+		s_transforms.positionZ[i] = i / (side * side) * spacing - center;
+
+		// Golden angle steps so neighbours do not line up
+		const float angle = i * 2.3999632f;
+		s_transforms.rotationZ[i] = std::sin(angle * 0.5f);
+		s_transforms.rotationW[i] = std::cos(angle * 0.5f);
+	}
+
+	s_sceneScale = std::max(1.0f, side * spacing * 0.75f);
+
+	// Slices must start on minStorageBufferOffsetAlignment (a power of two)
+	s_instanceSliceSize = alignUp(static_cast<VkDeviceSize>(count) *
+	                              sizeof(InstanceData),
+	                              s_physicalDeviceProperties.limits.
+	                              minStorageBufferOffsetAlignment);
+
+	if (s_options.animateInstances)
+	{
+		int result = createInstanceRing();
+		ASSERT(result);
+	}
+	else
+	{
+		std::vector<InstanceData> instances(count);
+		composeModelMatrices(s_transforms,
+		                     reinterpret_cast<float*>(instances.data()));
+
+		createBufferWithStaging(instances.data(), instances.size(),
+		                        sizeof(InstanceData), instanceBufferUsage(),
+		                        s_instanceBuffer, s_instanceBufferMemory);
+	}
+
+	std::cout << "Instances : " << count << " (" << count * s_indexCount / 3
+		<< " triangles" << (s_options.animateInstances ? ", animated" : "") <<
+		")" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+static VkDeviceSize cullOutputSliceOffset(uint32_t ringSlot)
+{
+	return ringSlot * s_cullOutputSliceSize;
+}
+
+static VkDeviceSize clusterDrawSliceOffset(uint32_t ringSlot)
+{
+	return ringSlot * s_clusterDrawSliceSize;
+}
+
+// Visible instances stay on the device, the output ring is host visible so
+// the counters can be read back without a copy
+int createCullBuffers()
+{
+	if (!s_options.gpuCulling)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	s_cullRingSlots = static_cast<uint32_t>(s_swapChainImagesViews.size());
+	s_cullOutputSliceSize = alignUp(sizeof(CullOutput),
+	                                s_physicalDeviceProperties.limits.
+	                                minStorageBufferOffsetAlignment);
+
+	int result;
+	if (s_options.meshlets)
+	{
+		s_clusterDrawSliceSize = alignUp(s_meshletCount * sizeof(
+			                                 VkDrawIndexedIndirectCommand),
+		                                 s_physicalDeviceProperties.limits.
+		                                 minStorageBufferOffsetAlignment);
+
+		result = createBuffer(clusterDrawSliceOffset(s_cullRingSlots),
+		                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		                      s_clusterDrawBuffer, s_clusterDrawBufferMemory);
+	}
+	else
+	{
+		result = createBuffer(instanceSliceOffset(s_cullRingSlots),
+		                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+		                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		                      s_visibleInstanceBuffer,
+		                      s_visibleInstanceBufferMemory);
+	}
+	ASSERT(result);
+
+	result = createBuffer(cullOutputSliceOffset(s_cullRingSlots),
+	                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+	                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+	                      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                      s_cullOutputBuffer, s_cullOutputBufferMemory);
+	ASSERT(result);
+
+	return EXIT_SUCCESS;
+}
+
+void destroyCullBuffers()
+{
+	if (s_options.meshlets)
+	{
+		vkDestroyBuffer(s_logicalDevice, s_clusterDrawBuffer, nullptr);
+		freeMemory(s_clusterDrawBufferMemory);
+	}
+	else if (s_options.gpuCulling)
+	{
+		vkDestroyBuffer(s_logicalDevice, s_visibleInstanceBuffer, nullptr);
+		freeMemory(s_visibleInstanceBufferMemory);
+	}
+
+	if (s_options.gpuCulling)
+	{
+		vkDestroyBuffer(s_logicalDevice, s_cullOutputBuffer, nullptr);
+		freeMemory(s_cullOutputBufferMemory);
+	}
+}
+
+int createCommandPools()
+{
+	VkCommandPoolCreateInfo commandPoolInfo = {};
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.pNext = nullptr;
+	commandPoolInfo.queueFamilyIndex = s_graphicQueueFamilyIndex;
+	// Long lived buffers, re-recorded in place
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	vk_res = vkCreateCommandPool(s_logicalDevice, &commandPoolInfo, nullptr,
+	                             &s_commandPool);
+	ASSERT_VK(vk_res);
+
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolInfo.queueFamilyIndex = s_transferQueueFamilyIndex;
 
 	vk_res = vkCreateCommandPool(s_logicalDevice, &commandPoolInfo, nullptr,
 	                             &s_commandTransferPool);
@@ -1328,457 +4906,3585 @@ int createCommandPools()
 	return EXIT_SUCCESS;
 }
 
-int createDepthResources()
+int createDepthResources()
+{
+	const VkFormat depthFormat = findDepthFormat();
+
+	createImage2D(s_swapChainExtent, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+	              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+	              (s_options.occlusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : 0),
+	              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_depthImage,
+	              s_depthImageMemory);
+	s_depthImageView = createImageView(s_depthImage, depthFormat,
+	                                   VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+	return EXIT_SUCCESS;
+}
+
+static VkImageView createHiZView(uint32_t baseLevel, uint32_t levelCount)
+{
+	VkImageViewCreateInfo imageViewInfo = {};
+	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewInfo.flags = 0;
+	imageViewInfo.pNext = nullptr;
+	imageViewInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageViewInfo.image = s_hiZImage;
+	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewInfo.subresourceRange.baseMipLevel = baseLevel;
+	imageViewInfo.subresourceRange.levelCount = levelCount;
+	imageViewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView imageView;
+	if (vkCreateImageView(s_logicalDevice, &imageViewInfo, nullptr, &imageView)
+		!= VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create image view!");
+	}
+
+	return imageView;
+}
+
+// Nothing was rendered yet, the pyramid starts at the far plane so the
+// first frame culls nothing by occlusion
+static int clearHiZ()
+{
+	if (s_hiZClearCommandBuffer == VK_NULL_HANDLE)
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.pNext = nullptr;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = s_commandPool;
+
+		vk_res = vkAllocateCommandBuffers(s_logicalDevice, &allocInfo,
+		                                  &s_hiZClearCommandBuffer);
+		ASSERT_VK(vk_res);
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pNext = nullptr;
+
+	vk_res = vkBeginCommandBuffer(s_hiZClearCommandBuffer, &beginInfo);
+	ASSERT_VK(vk_res);
+
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = s_hiZLevels;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = s_hiZImage;
+	barrier.subresourceRange = range;
+
+	vkCmdPipelineBarrier(s_hiZClearCommandBuffer,
+	                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+	                     nullptr, 1, &barrier);
+
+	VkClearColorValue farPlane = {};
+	farPlane.float32[0] = 1.0f;
+	vkCmdClearColorImage(s_hiZClearCommandBuffer, s_hiZImage,
+	                     VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &range);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	vkCmdPipelineBarrier(s_hiZClearCommandBuffer,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+	                     nullptr, 1, &barrier);
+
+	vk_res = vkEndCommandBuffer(s_hiZClearCommandBuffer);
+	ASSERT_VK(vk_res);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &s_hiZClearCommandBuffer;
+
+	vk_res = vkQueueSubmit(s_graphicsQueue, 1, &submitInfo, nullptr);
+	ASSERT_VK(vk_res);
+
+	// Only at startup and after a resize, the device is idle anyway
+	vk_res = vkQueueWaitIdle(s_graphicsQueue);
+	ASSERT_VK(vk_res);
+
+	return EXIT_SUCCESS;
+}
+
+// Sized from the depth buffer, recreated with it
+int createHiZResources()
+{
+	if (!s_options.occlusionCulling)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	s_hiZExtent.width = (s_swapChainExtent.width + 1) / 2;
+	s_hiZExtent.height = (s_swapChainExtent.height + 1) / 2;
+
+	// Full mip chain down to 1x1
+	s_hiZLevels = 1;
+	for (uint32_t size = std::max(s_hiZExtent.width, s_hiZExtent.height);
+	     size > 1 && s_hiZLevels < HIZ_MAX_LEVELS; size /= 2)
+	{
+		s_hiZLevels++;
+	}
+
+	int result = createImage2D(s_hiZExtent, s_hiZLevels, VK_FORMAT_R32_SFLOAT,
+	                           VK_IMAGE_TILING_OPTIMAL,
+	                           VK_IMAGE_USAGE_STORAGE_BIT |
+	                           VK_IMAGE_USAGE_SAMPLED_BIT |
+	                           VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+	                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_hiZImage,
+	                           s_hiZImageMemory);
+	ASSERT(result);
+
+	s_hiZImageView = createHiZView(0, s_hiZLevels);
+	s_hiZLevelViews.resize(s_hiZLevels);
+	for (uint32_t level = 0; level < s_hiZLevels; level++)
+	{
+		s_hiZLevelViews[level] = createHiZView(level, 1);
+	}
+
+	result = clearHiZ();
+	ASSERT(result);
+
+	// Level n reads level n - 1, the first one the depth buffer
+	std::vector<VkDescriptorImageInfo> imageInfos(s_hiZLevels * 2 + 1);
+	std::vector<VkWriteDescriptorSet> writes(s_hiZLevels * 2 + 1);
+
+	for (uint32_t level = 0; level < s_hiZLevels; level++)
+	{
+		VkDescriptorImageInfo& source = imageInfos[level * 2];
+		source.sampler = s_hiZSampler;
+		source.imageView = level == 0
+			                   ? s_depthImageView
+			                   : s_hiZLevelViews[level - 1];
+		source.imageLayout = level == 0
+			                     ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+			                     : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo& destination = imageInfos[level * 2 + 1];
+		destination.sampler = VK_NULL_HANDLE;
+		destination.imageView = s_hiZLevelViews[level];
+		destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		for (uint32_t binding = 0; binding < 2; binding++)
+		{
+			VkWriteDescriptorSet& write = writes[level * 2 + binding];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.pNext = nullptr;
+			write.dstSet = s_hiZDescriptorSets[level];
+			write.dstBinding = binding;
+			write.dstArrayElement = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = binding == 0
+				                       ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+				                       : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			write.pImageInfo = &imageInfos[level * 2 + binding];
+		}
+	}
+
+	// The whole pyramid for the culling pass
+	VkDescriptorImageInfo& pyramid = imageInfos.back();
+	pyramid.sampler = s_hiZSampler;
+	pyramid.imageView = s_hiZImageView;
+	pyramid.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet& write = writes.back();
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = s_cullDescriptorSet;
+	write.dstBinding = 4;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &pyramid;
+
+	vkUpdateDescriptorSets(s_logicalDevice,
+	                       static_cast<uint32_t>(writes.size()), writes.data(),
+	                       0, nullptr);
+
+	return EXIT_SUCCESS;
+}
+
+void destroyHiZResources()
+{
+	if (!s_options.occlusionCulling)
+	{
+		return;
+	}
+
+	for (auto imageView : s_hiZLevelViews)
+	{
+		vkDestroyImageView(s_logicalDevice, imageView, nullptr);
+	}
+	s_hiZLevelViews.clear();
+
+	vkDestroyImageView(s_logicalDevice, s_hiZImageView, nullptr);
+	vkDestroyImage(s_logicalDevice, s_hiZImage, nullptr);
+	freeMemory(s_hiZImageMemory);
+}
+
+int createQueryPools()
+{
+	const uint32_t imageCount = static_cast<uint32_t>(s_swapChainBuffers.
+		size());
+
+	s_queryResultsPending.assign(imageCount, false);
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext = nullptr;
+
+	if (s_timestampValidBits > 0)
+	{
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = TIMESTAMP_QUERY_COUNT * imageCount;
+
+		vk_res = vkCreateQueryPool(s_logicalDevice, &queryPoolInfo, nullptr,
+		                           &s_timestampQueryPool);
+		ASSERT_VK(vk_res);
+	}
+
+	if (s_enabledFeatures.pipelineStatisticsQuery)
+	{
+		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryPoolInfo.queryCount = imageCount;
+		queryPoolInfo.pipelineStatistics = STATISTICS_QUERY_FLAGS;
+
+		vk_res = vkCreateQueryPool(s_logicalDevice, &queryPoolInfo, nullptr,
+		                           &s_statisticsQueryPool);
+		ASSERT_VK(vk_res);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void destroyQueryPools()
+{
+	vkDestroyQueryPool(s_logicalDevice, s_timestampQueryPool, nullptr);
+	vkDestroyQueryPool(s_logicalDevice, s_statisticsQueryPool, nullptr);
+	s_timestampQueryPool = VK_NULL_HANDLE;
+	s_statisticsQueryPool = VK_NULL_HANDLE;
+}
+
+static void writeTimestamp(VkCommandBuffer commandBuffer,
+                           VkPipelineStageFlagBits stage, uint32_t imageIndex,
+                           TimestampQuery query)
+{
+	if (s_timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, stage, s_timestampQueryPool,
+		                    imageIndex * TIMESTAMP_QUERY_COUNT + query);
+	}
+}
+
+static uint32_t instancesPerDraw()
+{
+	const uint32_t instances = std::max(s_options.instanceCount, 1u);
+
+	return s_options.instancesPerDraw == 0
+		       ? instances
+		       : std::min(s_options.instancesPerDraw, instances);
+}
+
+static uint32_t sceneDrawCount()
+{
+	// The culling pass writes a single indirect draw
+	if (s_options.gpuCulling)
+	{
+		return 1;
+	}
+
+	const uint32_t instances = std::max(s_options.instanceCount, 1u);
+	const uint32_t perDraw = instancesPerDraw();
+
+	return (instances + perDraw - 1) / perDraw;
+}
+
+// Statistics queries can only stay active over secondary command buffers
+// when the device inherits them
+static bool isStatisticsQueryRecorded()
+{
+	return s_statisticsQueryPool != VK_NULL_HANDLE && (s_options.recordThreads
+		== 0 || s_enabledFeatures.inheritedQueries);
+}
+
+// Bind the scene state and record the draws [firstDraw, firstDraw + count)
+static void recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                        uint32_t firstDraw, uint32_t count)
+{
+	// Activate pipeline
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                  s_graphicsPipeline);
+
+	// Dynamic viewport and scissor, cover the whole swap image
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(s_swapChainExtent.width);
+	viewport.height = static_cast<float>(s_swapChainExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = {0, 0};
+	scissor.extent = s_swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// Culled instances are drawn from the visible slice of this image
+	VkBuffer vertexBuffers[] = {
+		s_vertexBuffer,
+		s_options.gpuCulling ? s_visibleInstanceBuffer : s_instanceBuffer
+	};
+	VkDeviceSize offsets[] = {
+		0, s_options.gpuCulling || s_options.animateInstances
+			   ? instanceSliceOffset(imageIndex)
+			   : 0
+	};
+	vkCmdBindVertexBuffers(commandBuffer, 0,
+	                       s_options.instanceCount > 0 ? 2 : 1, vertexBuffers,
+	                       offsets);
+	vkCmdBindIndexBuffer(commandBuffer, s_indexBuffer, 0, s_indexType);
+
+	// Bind descriptors, the uniform slice of this swap image
+	const uint32_t dynamicOffset = static_cast<uint32_t>(
+		uniformSliceOffset(imageIndex, 0));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                        s_pipelineLayout, 0, 1, &s_descriptorSet, 1,
+	                        &dynamicOffset);
+
+	if (s_options.meshlets)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		// One draw per cluster, as few calls as the device allows
+		const VkDeviceSize drawOffset = clusterDrawSliceOffset(imageIndex);
+		const uint32_t drawStride = sizeof(VkDrawIndexedIndirectCommand);
+		const uint32_t maxDraws = s_enabledFeatures.multiDrawIndirect
+			                          ? s_physicalDeviceProperties.limits.
+			                          maxDrawIndirectCount
+			                          : 1;
+
+		for (uint32_t first = 0; first < s_meshletCount; first += maxDraws)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, s_clusterDrawBuffer,
+			                         drawOffset + first * drawStride,
+			                         std::min(maxDraws, s_meshletCount - first),
+			                         drawStride);
+		}
+		return;
+	}
+
+	if (s_options.gpuCulling)
+	{
+		if (count > 0)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, s_cullOutputBuffer,
+			                         cullOutputSliceOffset(imageIndex) +
+			                         offsetof(CullOutput, draw), 1,
+			                         sizeof(VkDrawIndexedIndirectCommand));
+		}
+		return;
+	}
+
+	// Draw, instances are split in runs of instancesPerDraw()
+	const uint32_t instances = std::max(s_options.instanceCount, 1u);
+	const uint32_t perDraw = instancesPerDraw();
+
+	for (uint32_t draw = firstDraw; draw < firstDraw + count; draw++)
+	{
+		const uint32_t firstInstance = draw * perDraw;
+
+		vkCmdDrawIndexed(commandBuffer, s_indexCount,
+		                 std::min(perDraw, instances - firstInstance), 0, 0,
+		                 firstInstance);
+	}
+}
+
+// Frustum cull the instances into the visible slice of this image, the
+// draws of the render pass wait on it
+static void recordCull(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	// No instances visible yet
+	CullOutput output = {};
+	output.draw.indexCount = s_indexCount;
+	vkCmdUpdateBuffer(commandBuffer, s_cullOutputBuffer,
+	                  cullOutputSliceOffset(imageIndex), sizeof output,
+	                  &output);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+		VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+	                     0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+	                  s_cullPipeline);
+
+	const uint32_t dynamicOffsets[] = {
+		static_cast<uint32_t>(uniformSliceOffset(imageIndex, 0)),
+		static_cast<uint32_t>(s_options.animateInstances
+			                      ? instanceSliceOffset(imageIndex)
+			                      : 0),
+		static_cast<uint32_t>(s_options.meshlets
+			                      ? clusterDrawSliceOffset(imageIndex)
+			                      : instanceSliceOffset(imageIndex)),
+		static_cast<uint32_t>(cullOutputSliceOffset(imageIndex))
+	};
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+	                        s_cullPipelineLayout, 0, 1, &s_cullDescriptorSet,
+	                        4, dynamicOffsets);
+
+	// Volumes of the mesh bounding box
+	const glm::vec3 center = (s_meshBoundsMin + s_meshBoundsMax) * 0.5f;
+	const glm::vec3 halfExtents = (s_meshBoundsMax - s_meshBoundsMin) * 0.5f;
+
+	CullConstants constants = {};
+	constants.boundingSphere = glm::vec4(center, glm::length(halfExtents));
+	constants.boundingBox = glm::vec4(halfExtents, 0.0f);
+	// Clusters carry their own volumes, only their count is used
+	constants.instanceCount = s_options.meshlets
+		                          ? s_meshletCount
+		                          : s_options.instanceCount;
+	constants.hiZLevels = s_hiZLevels;
+	vkCmdPushConstants(commandBuffer, s_cullPipelineLayout,
+	                   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof constants,
+	                   &constants);
+
+	vkCmdDispatch(commandBuffer, (constants.instanceCount + CULL_GROUP_SIZE -
+		              1) / CULL_GROUP_SIZE, 1, 1);
+
+	// Draw command and visible instances to the draws, counters to the host
+	// once the fence signaled
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+	                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+	                     VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+	                     nullptr, 0, nullptr);
+}
+
+// Reduce this frame's depth into the pyramid read by the next frame's
+// culling pass
+static void recordHiZ(VkCommandBuffer commandBuffer)
+{
+	// The culling pass of this frame is done reading the pyramid, the depth
+	// buffer is covered by the render pass dependency
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = 0;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+	                     0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+	                  s_hiZPipeline);
+
+	// Each level waits for the one it reads, the last one for the next
+	// frame's culling pass
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	for (uint32_t level = 0; level < s_hiZLevels; level++)
+	{
+		const uint32_t width = std::max(1u, s_hiZExtent.width >> level);
+		const uint32_t height = std::max(1u, s_hiZExtent.height >> level);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+		                        s_hiZPipelineLayout, 0, 1,
+		                        &s_hiZDescriptorSets[level], 0, nullptr);
+		vkCmdDispatch(commandBuffer,
+		              (width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+		              (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+		vkCmdPipelineBarrier(commandBuffer,
+		                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+		                     &barrier, 0, nullptr, 0, nullptr);
+	}
+}
+
+// Record the frame into a primary command buffer, the draws are either
+// recorded inline or come from already recorded secondary buffers
+static int recordCommandBuffer(VkCommandBuffer commandBuffer,
+                               uint32_t imageIndex,
+                               VkCommandBufferUsageFlags usage,
+                               const VkCommandBuffer* secondaryBuffers,
+                               uint32_t secondaryCount)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = usage;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+	// Begin Command Buffer
+	//
+	vk_res = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	ASSERT_VK(vk_res);
+
+	// Queries are reset outside of the render pass
+	if (s_timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, s_timestampQueryPool,
+		                    imageIndex * TIMESTAMP_QUERY_COUNT,
+		                    TIMESTAMP_QUERY_COUNT);
+	}
+
+	const bool statistics = isStatisticsQueryRecorded();
+
+	if (statistics)
+	{
+		vkCmdResetQueryPool(commandBuffer, s_statisticsQueryPool, imageIndex,
+		                    1);
+	}
+
+	// Written without culling too, the whole range must be available
+	writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+	               imageIndex, TIMESTAMP_CULL_BEGIN);
+
+	if (s_options.gpuCulling)
+	{
+		recordCull(commandBuffer, imageIndex);
+	}
+
+	writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	               imageIndex, TIMESTAMP_CULL_END);
+
+	writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+	               imageIndex, TIMESTAMP_PASS_BEGIN);
+
+	// The scene is the only work of the pass, the statistics of the pass
+	// are those of its draws
+	if (statistics)
+	{
+		vkCmdBeginQuery(commandBuffer, s_statisticsQueryPool, imageIndex, 0);
+	}
+
+	// Begin Render Pass
+	//
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.pNext = nullptr;
+	renderPassInfo.renderPass = s_renderPass;
+	renderPassInfo.framebuffer = s_swapChainBuffers[imageIndex];
+
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent = s_swapChainExtent;
+
+	std::array<VkClearValue, 2> clearValues{};
+	clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+	clearValues[1].depthStencil = {1.0f, 0};
+
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues.data();
+
+	if (secondaryCount > 0)
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+		                     VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(commandBuffer, secondaryCount, secondaryBuffers);
+	}
+	else
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+		                     VK_SUBPASS_CONTENTS_INLINE);
+
+		writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		               imageIndex, TIMESTAMP_DRAW_BEGIN);
+		recordDraws(commandBuffer, imageIndex, 0, sceneDrawCount());
+		writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		               imageIndex, TIMESTAMP_DRAW_END);
+	}
+
+	// End RenderPass
+	vkCmdEndRenderPass(commandBuffer);
+
+	if (statistics)
+	{
+		vkCmdEndQuery(commandBuffer, s_statisticsQueryPool, imageIndex);
+	}
+
+	writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	               imageIndex, TIMESTAMP_PASS_END);
+
+	writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+	               imageIndex, TIMESTAMP_HIZ_BEGIN);
+
+	if (s_options.occlusionCulling)
+	{
+		recordHiZ(commandBuffer);
+	}
+
+	writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	               imageIndex, TIMESTAMP_HIZ_END);
+
+	// Close Command Buffer
+	vk_res = vkEndCommandBuffer(commandBuffer);
+	ASSERT_VK(vk_res);
+
+	return EXIT_SUCCESS;
+}
+
+static bool isRecordingPerFrame()
+{
+	return s_options.recordPerFrame || s_options.recordThreads > 0;
+}
+
+// Prerecorded command buffers, one per swap image. They are kept for the
+// lifetime of the pool and re-recorded in place after a resize
+int createCommandBuffers()
+{
+	if (isRecordingPerFrame())
+	{
+		return EXIT_SUCCESS;
+	}
+
+	const TimePoint recordStart = std::chrono::high_resolution_clock::now();
+
+	const size_t allocated = s_commandBuffers.size();
+
+	if (s_swapChainBuffers.size() > allocated)
+	{
+		s_commandBuffers.resize(s_swapChainBuffers.size());
+
+		VkCommandBufferAllocateInfo commandBufferInfo = {};
+		commandBufferInfo.sType =
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferInfo.pNext = nullptr;
+		commandBufferInfo.commandPool = s_commandPool;
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferInfo.commandBufferCount = static_cast<uint32_t>(
+			s_swapChainBuffers.size() - allocated);
+
+		vk_res = vkAllocateCommandBuffers(s_logicalDevice, &commandBufferInfo,
+		                                  &s_commandBuffers[allocated]);
+		ASSERT_VK(vk_res);
+	}
+
+	for (size_t i = 0; i < s_swapChainBuffers.size(); i++)
+	{
+		int result = recordCommandBuffer(s_commandBuffers[i],
+		                                 static_cast<uint32_t>(i), 0, nullptr,
+		                                 0);
+		ASSERT(result);
+	}
+
+	const TimePoint recordEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "Prerecorded " << s_swapChainBuffers.size() <<
+		" command buffers, " << sceneDrawCount() << " draws each, in " <<
+		elapsedMs(recordStart, recordEnd) << " ms" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+// Per frame recording, each frame in flight owns a primary pool and, with
+// recording threads, one pool per job so workers never share a pool
+int createFrameCommandPools()
+{
+	if (!isRecordingPerFrame())
+	{
+		return EXIT_SUCCESS;
+	}
+
+	const uint32_t jobCount = s_options.recordThreads;
+
+	s_frameCommandPools.resize(s_options.framesInFlight);
+	s_frameCommandBuffers.resize(s_options.framesInFlight);
+	s_jobCommandPools.resize(s_options.framesInFlight * jobCount);
+	s_secondaryCommandBuffers.resize(s_options.framesInFlight * jobCount);
+
+	// Pools are reset as a whole every frame
+	VkCommandPoolCreateInfo commandPoolInfo = {};
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.pNext = nullptr;
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolInfo.queueFamilyIndex = s_graphicQueueFamilyIndex;
+
+	VkCommandBufferAllocateInfo commandBufferInfo = {};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferInfo.pNext = nullptr;
+	commandBufferInfo.commandBufferCount = 1;
+
+	for (uint32_t i = 0; i < s_options.framesInFlight; i++)
+	{
+		vk_res = vkCreateCommandPool(s_logicalDevice, &commandPoolInfo,
+		                             nullptr, &s_frameCommandPools[i]);
+		ASSERT_VK(vk_res);
+
+		commandBufferInfo.commandPool = s_frameCommandPools[i];
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+		vk_res = vkAllocateCommandBuffers(s_logicalDevice, &commandBufferInfo,
+		                                  &s_frameCommandBuffers[i]);
+		ASSERT_VK(vk_res);
+	}
+
+	for (uint32_t i = 0; i < s_jobCommandPools.size(); i++)
+	{
+		vk_res = vkCreateCommandPool(s_logicalDevice, &commandPoolInfo,
+		                             nullptr, &s_jobCommandPools[i]);
+		ASSERT_VK(vk_res);
+
+		commandBufferInfo.commandPool = s_jobCommandPools[i];
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+		vk_res = vkAllocateCommandBuffers(s_logicalDevice, &commandBufferInfo,
+		                                  &s_secondaryCommandBuffers[i]);
+		ASSERT_VK(vk_res);
+	}
+
+	// The calling thread records a share too
+	if (jobCount > 1)
+	{
+		startWorkers(s_recordWorkers, jobCount - 1);
+	}
+
+	std::cout << "Recording every frame " << (jobCount > 0
+		                                          ? "with secondary buffers"
+		                                          : "inline") << " on " <<
+		std::max(jobCount, 1u) << " thread(s), " << sceneDrawCount() <<
+		" draws" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+void destroyFrameCommandPools()
+{
+	stopWorkers(s_recordWorkers);
+
+	// Destroying a pool frees its command buffers
+	for (auto commandPool : s_frameCommandPools)
+	{
+		vkDestroyCommandPool(s_logicalDevice, commandPool, nullptr);
+	}
+
+	for (auto commandPool : s_jobCommandPools)
+	{
+		vkDestroyCommandPool(s_logicalDevice, commandPool, nullptr);
+	}
+
+	s_frameCommandPools.clear();
+	s_frameCommandBuffers.clear();
+	s_jobCommandPools.clear();
+	s_secondaryCommandBuffers.clear();
+}
+
+// Record one chunk of the scene into the secondary buffer of a job
+static VkResult recordSecondary(uint32_t job, uint32_t imageIndex)
+{
+	const uint32_t jobCount = s_options.recordThreads;
+	const uint32_t slot = s_currentFrame * jobCount + job;
+	const VkCommandBuffer commandBuffer = s_secondaryCommandBuffers[slot];
+
+	VkResult res = vkResetCommandPool(s_logicalDevice, s_jobCommandPools[slot],
+	                                  0);
+	if (res != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.pNext = nullptr;
+	inheritanceInfo.renderPass = s_renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = s_swapChainBuffers[imageIndex];
+	inheritanceInfo.occlusionQueryEnable = VK_FALSE;
+	inheritanceInfo.pipelineStatistics = isStatisticsQueryRecorded()
+		                                     ? STATISTICS_QUERY_FLAGS
+		                                     : 0;
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = nullptr;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+		VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	res = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	if (res != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	// Contiguous chunks, secondaries execute in job order
+	const uint32_t drawCount = sceneDrawCount();
+	const uint32_t firstDraw = static_cast<uint64_t>(drawCount) * job /
+		jobCount;
+	const uint32_t lastDraw = static_cast<uint64_t>(drawCount) * (job + 1) /
+		jobCount;
+
+	if (job == 0)
+	{
+		writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		               imageIndex, TIMESTAMP_DRAW_BEGIN);
+	}
+
+	recordDraws(commandBuffer, imageIndex, firstDraw, lastDraw - firstDraw);
+
+	if (job + 1 == jobCount)
+	{
+		writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		               imageIndex, TIMESTAMP_DRAW_END);
+	}
+
+	return vkEndCommandBuffer(commandBuffer);
+}
+
+// Record this frame's command buffer, the fence of the frame slot has been
+// waited on so its pools can be reset
+int recordFrame(uint32_t imageIndex)
+{
+	const uint32_t jobCount = s_options.recordThreads;
+
+	if (jobCount == 0)
+	{
+		vk_res = vkResetCommandPool(s_logicalDevice,
+		                            s_frameCommandPools[s_currentFrame], 0);
+		ASSERT_VK(vk_res);
+
+		return recordCommandBuffer(s_frameCommandBuffers[s_currentFrame],
+		                           imageIndex,
+		                           VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		                           nullptr, 0);
+	}
+
+	std::vector<VkResult> results(jobCount, VK_SUCCESS);
+
+	runJobs(s_recordWorkers, jobCount, [&](uint32_t job)
+	{
+		results[job] = recordSecondary(job, imageIndex);
+	});
+
+	for (VkResult res : results)
+	{
+		vk_res = res;
+		ASSERT_VK(vk_res);
+	}
+
+	vk_res = vkResetCommandPool(s_logicalDevice,
+	                            s_frameCommandPools[s_currentFrame], 0);
+	ASSERT_VK(vk_res);
+
+	return recordCommandBuffer(s_frameCommandBuffers[s_currentFrame],
+	                           imageIndex,
+	                           VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	                           &s_secondaryCommandBuffers[s_currentFrame *
+		                           jobCount], jobCount);
+}
+
+int createSyncObjects()
+{
+	s_imageAvailableSemaphores.resize(s_options.framesInFlight);
+	s_renderFinishedSemaphores.resize(s_options.framesInFlight);
+	s_inFlightFences.resize(s_options.framesInFlight);
+	s_imagesInFlight.resize(s_swapChainImagesViews.size(), VK_NULL_HANDLE);
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = nullptr;
+	semaphoreInfo.flags = 0;
+
+	// Fences start signaled so the first wait on each frame returns at once
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = nullptr;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < s_options.framesInFlight; i++)
+	{
+		vk_res = vkCreateSemaphore(s_logicalDevice, &semaphoreInfo, nullptr,
+		                           &s_imageAvailableSemaphores[i]);
+		ASSERT_VK(vk_res);
+
+		vk_res = vkCreateSemaphore(s_logicalDevice, &semaphoreInfo, nullptr,
+		                           &s_renderFinishedSemaphores[i]);
+		ASSERT_VK(vk_res);
+
+		vk_res = vkCreateFence(s_logicalDevice, &fenceInfo, nullptr,
+		                       &s_inFlightFences[i]);
+		ASSERT_VK(vk_res);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Texture streaming
+//
+// With --texture-budget the levels of a KTX2 texture are read from its file
+// on demand. The tail of levels up to TEXTURE_RESIDENCY_TAIL_SIZE texels is
+// always resident; more detailed levels are wanted from the size the texture
+// covers on screen each frame, and kept after they stop being needed until
+// the budget is short. Over budget, the least recently used textures give
+// their most detailed levels back first (include/texture_residency.h).
+//
+// A new level range is a new image, its levels read again from the file in an
+// upload batch, swapped in once the batch fence has signaled. The levels kept
+// weigh at most a third of the level added: not worth copying them from the
+// old image, which would have to be released to the transfer queue first.
+
+// Share of the free device local memory reported by VK_EXT_memory_budget
+// that streamed levels may grow into, the rest is left to other allocations
+#define STREAMING_HEAP_SHARE 0.5
+
+// Level range being uploaded, swapped in when the upload fence signals
+struct PendingResidency
+{
+	bool active;
+	uint32_t firstLevel;
+	VkImage image;
+	MemoryAllocation memory;
+};
+
+// Replaced level range, destroyed once no frame in flight can sample it
+struct RetiredTexture
+{
+	VkImage image;
+	VkImageView view;
+	MemoryAllocation memory;
+	uint64_t frame;
+};
+
+static bool s_textureStreaming = false;
+static std::string s_streamedTextureFile;
+// The whole file when it is packed in the asset archive
+static AssetData s_streamedTextureData;
+static Ktx2File s_streamedTexture;
+static TextureResidency s_textureResidency;
+static PendingResidency s_pendingResidency;
+static std::vector<RetiredTexture> s_retiredTextures;
+static uint64_t s_streamingFrame = 0;
+
+// Staging layout of levels [firstLevel, levelCount) of a KTX2 file, one
+// after the other from offset 0, each starting on a block. Returns the size
+static VkDeviceSize ktx2StagingOffsets(const Ktx2File& ktx,
+                                       uint32_t firstLevel,
+                                       std::vector<VkDeviceSize>& offsets)
+{
+	const VkDeviceSize blockSize = ktx2BlockSize(ktx.header.vkFormat);
+
+	offsets.clear();
+	VkDeviceSize size = 0;
+
+	for (uint32_t level = firstLevel; level < ktx.header.levelCount; level++)
+	{
+		offsets.push_back(alignUp(size, blockSize));
+		size = offsets.back() + ktx.levels[level].byteLength;
+	}
+
+	return size;
+}
+
+// Levels [firstLevel, levelCount) of a checked KTX2 file into a new image
+// whose level 0 is firstLevel, recorded into the open upload batch. They are
+// copied from packed, the whole file, unless it is empty
+static int uploadKtx2Levels(const std::string& filename,
+                            const AssetData& packed, const Ktx2File& ktx,
+                            uint32_t firstLevel, VkImage& image,
+                            MemoryAllocation& memory)
+{
+	std::vector<VkDeviceSize> offsets;
+	const VkDeviceSize size = ktx2StagingOffsets(ktx, firstLevel, offsets);
+
+	const StagingBuffer staging = createStagingBuffer(size);
+	char* mapped = reinterpret_cast<char*>(staging.memory.mapped);
+
+	const uint32_t levelCount = ktx.header.levelCount;
+
+	if (packed.size > 0)
+	{
+		for (uint32_t level = firstLevel; level < levelCount; level++)
+		{
+			memcpy(mapped + offsets[level - firstLevel],
+			       packed.data() + ktx.levels[level].byteOffset,
+			       static_cast<size_t>(ktx.levels[level].byteLength));
+		}
+	}
+	else
+	{
+		std::ifstream file(filename, std::ios::binary);
+
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Fail to load texture " + filename + "!");
+		}
+
+		for (uint32_t level = firstLevel; level < levelCount; level++)
+		{
+			file.seekg(static_cast<std::streamoff>(ktx.levels[level].
+				byteOffset));
+			file.read(mapped + offsets[level - firstLevel],
+			          static_cast<std::streamsize>(ktx.levels[level].
+				          byteLength));
+		}
+
+		if (!file)
+		{
+			throw std::runtime_error("Fail to read texture " + filename + "!");
+		}
+	}
+
+	const VkFormat format = static_cast<VkFormat>(ktx.header.vkFormat);
+	const VkExtent2D extent = {
+		std::max(ktx.header.pixelWidth >> firstLevel, 1u),
+		std::max(ktx.header.pixelHeight >> firstLevel, 1u)
+	};
+	const uint32_t imageLevels = levelCount - firstLevel;
+
+	createImage2D(extent, imageLevels, format, VK_IMAGE_TILING_OPTIMAL,
+	              VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+	transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED,
+	                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLevels);
+	transferBufferToImage(staging.buffer, image, extent.width, extent.height,
+	                      offsets);
+	transitionImageLayout(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	                      imageLevels);
+
+	return EXIT_SUCCESS;
+}
+
+// Start streaming a KTX2 texture whose index has been checked, its tail is
+// uploaded with the open batch
+static int createStreamedTexture(const std::string& filename,
+                                 const AssetData& packed, const Ktx2File& ktx)
+{
+	s_textureStreaming = true;
+	s_streamedTextureFile = filename;
+	s_streamedTextureData = packed;
+	s_streamedTexture = ktx;
+
+	s_textureResidency = blockTextureResidency(
+		ktx.header.pixelWidth, ktx.header.pixelHeight, ktx.header.levelCount,
+		ktx2BlockSize(ktx.header.vkFormat));
+
+	const uint32_t firstLevel = s_textureResidency.residentLevel;
+
+	int result = uploadKtx2Levels(filename, packed, ktx, firstLevel,
+	                              s_textureImage, s_textureImageMemory);
+	ASSERT(result);
+
+	s_textureFormat = static_cast<VkFormat>(ktx.header.vkFormat);
+	s_textureExtent = {
+		std::max(ktx.header.pixelWidth >> firstLevel, 1u),
+		std::max(ktx.header.pixelHeight >> firstLevel, 1u)
+	};
+	s_textureMipLevels = ktx.header.levelCount - firstLevel;
+
+	std::cout << "Texture streaming: " << s_options.textureBudget << " MiB "
+		"budget, levels " << firstLevel << " and up always resident, " <<
+		(s_getMemoryProperties2
+			 ? "capped by VK_EXT_memory_budget"
+			 : "VK_EXT_memory_budget not supported") << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+// Configured budget, lowered to what the device local heaps have left when
+// the driver reports it
+static VkDeviceSize textureBudget()
+{
+	const VkDeviceSize budget = static_cast<VkDeviceSize>(s_options.
+		textureBudget) * 1024 * 1024;
+
+	if (!s_getMemoryProperties2)
+	{
+		return budget;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT heapBudget = {};
+	heapBudget.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	properties.pNext = &heapBudget;
+
+	s_getMemoryProperties2(s_physicalDevice, &properties);
+
+	// Largest free device local heap, the texture is in one of them
+	VkDeviceSize available = 0;
+	const VkPhysicalDeviceMemoryProperties& memory = properties.
+		memoryProperties;
+	for (uint32_t heap = 0; heap < memory.memoryHeapCount; heap++)
+	{
+		if ((memory.memoryHeaps[heap].flags &
+				VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heapBudget.heapBudget[heap] >
+			heapBudget.heapUsage[heap])
+		{
+			available = std::max(available, heapBudget.heapBudget[heap] -
+			                     heapBudget.heapUsage[heap]);
+		}
+	}
+
+	// The streamed levels already count as used
+	const VkDeviceSize streamed = residentBytes(
+		s_textureResidency, s_textureResidency.residentLevel) +
+		static_cast<VkDeviceSize>(available * STREAMING_HEAP_SHARE);
+
+	return std::min(budget, streamed);
+}
+
+// Screen feedback: how many pixels the texture spans where the mesh is
+// closest to the camera. The cube maps the whole texture on each face, other
+// meshes are taken as one face of their bounding box
+static void updateTextureFeedback(const glm::mat4& proj, const glm::vec3& eye)
+{
+	const float size = meshSize();
+	const float distance = std::max(glm::length(eye) - size * 0.5f, 0.1f);
+	const float pixels = size * proj[1][1] * 0.5f * s_swapChainExtent.height /
+		distance;
+
+	const Ktx2Header& header = s_streamedTexture.header;
+	noteTextureUse(s_textureResidency,
+	               footprintMipLevel(header.pixelWidth, header.pixelHeight,
+	                                 header.levelCount, pixels),
+	               s_streamingFrame);
+}
+
+static void swapInPendingResidency()
+{
+	s_retiredTextures.push_back({
+		s_textureImage, s_textureImageView, s_textureImageMemory,
+		s_streamingFrame
+	});
+
+	const uint32_t firstLevel = s_pendingResidency.firstLevel;
+
+	s_textureImage = s_pendingResidency.image;
+	s_textureImageMemory = s_pendingResidency.memory;
+	s_textureExtent = {
+		std::max(s_streamedTexture.header.pixelWidth >> firstLevel, 1u),
+		std::max(s_streamedTexture.header.pixelHeight >> firstLevel, 1u)
+	};
+	s_textureMipLevels = s_streamedTexture.header.levelCount - firstLevel;
+	s_textureImageView = createImageView(s_textureImage, s_textureFormat,
+	                                     VK_IMAGE_ASPECT_COLOR_BIT,
+	                                     s_textureMipLevels);
+
+	s_textureResidency.residentLevel = firstLevel;
+	s_pendingResidency = {};
+
+	std::cout << "Texture streaming: levels " << firstLevel << " and up "
+		"resident, " << residentBytes(s_textureResidency, firstLevel) / 1024 <<
+		" KiB" << std::endl;
+}
+
+// Once per frame, after the feedback. Swaps in the level range of the
+// previous upload when it is done, then starts the next one if the plan
+// changed. A single upload is in flight at a time
+static int updateTextureStreaming()
+{
+	s_streamingFrame++;
+
+	// The frame slot waited on before this call was submitted framesInFlight
+	// frames ago, every frame that could sample these is done
+	for (size_t i = 0; i < s_retiredTextures.size();)
+	{
+		RetiredTexture& retired = s_retiredTextures[i];
+
+		if (s_streamingFrame < retired.frame + s_options.framesInFlight)
+		{
+			i++;
+			continue;
+		}
+
+		vkDestroyImageView(s_logicalDevice, retired.view, nullptr);
+		vkDestroyImage(s_logicalDevice, retired.image, nullptr);
+		freeMemory(retired.memory);
+
+		s_retiredTextures.erase(s_retiredTextures.begin() + i);
+	}
+
+	if (s_pendingResidency.active)
+	{
+		if (vkGetFenceStatus(s_logicalDevice, s_uploadFence) != VK_SUCCESS)
+		{
+			return EXIT_SUCCESS;
+		}
+
+		int result = waitUploadBatch();
+		ASSERT(result);
+
+		swapInPendingResidency();
+	}
+
+	uint32_t firstLevel;
+	planResidency(&s_textureResidency, 1, textureBudget(), &firstLevel);
+
+	if (firstLevel == s_textureResidency.residentLevel)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	int result = beginUploadBatch();
+	ASSERT(result);
+
+	result = uploadKtx2Levels(s_streamedTextureFile, s_streamedTextureData,
+	                          s_streamedTexture, firstLevel,
+	                          s_pendingResidency.image,
+	                          s_pendingResidency.memory);
+	ASSERT(result);
+
+	result = submitUploadBatch();
+	ASSERT(result);
+
+	s_pendingResidency.active = true;
+	s_pendingResidency.firstLevel = firstLevel;
+
+	return EXIT_SUCCESS;
+}
+
+// The device is idle
+static void destroyTextureStreaming()
+{
+	if (s_pendingResidency.active)
+	{
+		waitUploadBatch();
+
+		vkDestroyImage(s_logicalDevice, s_pendingResidency.image, nullptr);
+		freeMemory(s_pendingResidency.memory);
+		s_pendingResidency = {};
+	}
+
+	for (RetiredTexture& retired : s_retiredTextures)
+	{
+		vkDestroyImageView(s_logicalDevice, retired.view, nullptr);
+		vkDestroyImage(s_logicalDevice, retired.image, nullptr);
+		freeMemory(retired.memory);
+	}
+	s_retiredTextures.clear();
+}
+
+// Gribb-Hartmann planes of a clip matrix with a [0, 1] depth range, normalized
+// so distances are in world units
+static void extractFrustumPlanes(const glm::mat4& clip, glm::vec4* planes)
+{
+	const glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+	const glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+	const glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+	const glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+
+	planes[0] = row3 + row0; // Left
+	planes[1] = row3 - row0; // Right
+	planes[2] = row3 + row1; // Bottom
+	planes[3] = row3 - row1; // Top
+	planes[4] = row2; // Near
+	planes[5] = row3 - row2; // Far
+
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+int updateUniforms(uint32_t imageIndex)
+{
+	static auto startTime = std::chrono::high_resolution_clock::now();
+
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(
+		currentTime - startTime).count();
+
+	UniformBufferObject ubo = {};
+
+	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
+	                        glm::vec3(0.0f, 0.0f, 1.0f));
+	const glm::vec3 eye = glm::vec3(2.0f, 2.0f, 2.0f) * s_sceneScale;
+	ubo.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f),
+	                       glm::vec3(0.0f, 0.0f, 1.0f));
+	ubo.proj = glm::perspective(glm::radians(45.0f),
+	                            s_swapChainExtent.width / static_cast<float>(
+		                            s_swapChainExtent.height), 0.1f,
+	                            10.0f * s_sceneScale);
+
+	if (s_options.gpuCulling)
+	{
+		const glm::mat4 clip = ubo.proj * ubo.view * ubo.model;
+		extractFrustumPlanes(clip, ubo.frustumPlanes);
+
+		// Frames are submitted in order, the pyramid read by this one was
+		// built by the previous call's frame
+		static glm::mat4 previousClip = clip;
+		ubo.previousClip = previousClip;
+		previousClip = clip;
+
+		ubo.cameraPosition = glm::inverse(ubo.model) * glm::vec4(eye, 1.0f);
+	}
+
+	if (s_textureStreaming)
+	{
+		updateTextureFeedback(ubo.proj, eye);
+	}
+
+	if (s_options.packedVertices)
+	{
+		ubo.positionOffset = glm::vec4(s_meshBoundsMin, 0.0f);
+		ubo.positionScale = glm::vec4(
+			(s_meshBoundsMax - s_meshBoundsMin) / 65535.0f, 0.0f);
+	}
+
+	memcpy(s_uniformBufferMemory.mapped + uniformSliceOffset(imageIndex, 0),
+	       &ubo, sizeof ubo);
+
+	if (s_options.animateInstances)
+	{
+		static float lastTime = time;
+
+		rotateTransformsZ(s_transforms, (time - lastTime) * glm::radians(
+			                  180.0f));
+		lastTime = time;
+
+		composeModelMatrices(s_transforms, reinterpret_cast<float*>(
+			                     s_instanceBufferMemory.mapped +
+			                     instanceSliceOffset(imageIndex)));
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static double timestampDeltaMs(uint64_t start, uint64_t end)
+{
+	const uint64_t mask = s_timestampValidBits >= 64
+		                      ? UINT64_MAX
+		                      : (1ull << s_timestampValidBits) - 1;
+	const uint64_t ticks = (end - start) & mask;
+
+	return ticks * static_cast<double>(s_physicalDeviceProperties.limits.
+		timestampPeriod) / 1000000.0;
+}
+
+// Read the queries of the last frame rendered into this swap image, its
+// fence has been waited on so this never stalls
+void readQueryResults(uint32_t imageIndex)
+{
+	s_frameTimings.ms[STAGE_GPU_RENDER_PASS] = 0.0;
+	s_frameTimings.ms[STAGE_GPU_DRAW] = 0.0;
+	s_frameTimings.ms[STAGE_GPU_CULL] = 0.0;
+	s_frameTimings.ms[STAGE_GPU_HIZ] = 0.0;
+	memset(s_frameTimings.statistics, 0, sizeof s_frameTimings.statistics);
+	memset(s_frameTimings.cullCounters, 0,
+	       sizeof s_frameTimings.cullCounters);
+
+	if (!s_queryResultsPending[imageIndex])
+	{
+		return;
+	}
+	s_queryResultsPending[imageIndex] = false;
+
+	if (s_timestampQueryPool != VK_NULL_HANDLE)
+	{
+		uint64_t timestamps[TIMESTAMP_QUERY_COUNT];
+
+		if (vkGetQueryPoolResults(s_logicalDevice, s_timestampQueryPool,
+		                          imageIndex * TIMESTAMP_QUERY_COUNT,
+		                          TIMESTAMP_QUERY_COUNT, sizeof timestamps,
+		                          timestamps, sizeof(uint64_t),
+		                          VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			s_frameTimings.ms[STAGE_GPU_RENDER_PASS] = timestampDeltaMs(
+				timestamps[TIMESTAMP_PASS_BEGIN],
+				timestamps[TIMESTAMP_PASS_END]);
+			s_frameTimings.ms[STAGE_GPU_DRAW] = timestampDeltaMs(
+				timestamps[TIMESTAMP_DRAW_BEGIN],
+				timestamps[TIMESTAMP_DRAW_END]);
+			s_frameTimings.ms[STAGE_GPU_CULL] = timestampDeltaMs(
+				timestamps[TIMESTAMP_CULL_BEGIN],
+				timestamps[TIMESTAMP_CULL_END]);
+			s_frameTimings.ms[STAGE_GPU_HIZ] = timestampDeltaMs(
+				timestamps[TIMESTAMP_HIZ_BEGIN],
+				timestamps[TIMESTAMP_HIZ_END]);
+		}
+	}
+
+	if (s_options.gpuCulling)
+	{
+		const CullOutput* output = reinterpret_cast<const CullOutput*>(
+			s_cullOutputBufferMemory.mapped + cullOutputSliceOffset(
+				imageIndex));
+
+		s_frameTimings.cullCounters[CULL_VISIBLE] = output->draw.instanceCount;
+		s_frameTimings.cullCounters[CULL_FRUSTUM_REJECTED] = output->
+			frustumRejected;
+		s_frameTimings.cullCounters[CULL_OCCLUSION_REJECTED] = output->
+			occlusionRejected;
+		s_frameTimings.cullCounters[CULL_CONE_REJECTED] = output->
+			coneRejected;
+	}
+
+	if (s_statisticsQueryPool != VK_NULL_HANDLE)
+	{
+		uint64_t statistics[PIPELINE_STATISTIC_COUNT];
+
+		if (vkGetQueryPoolResults(s_logicalDevice, s_statisticsQueryPool,
+		                          imageIndex, 1, sizeof statistics, statistics,
+		                          sizeof statistics, VK_QUERY_RESULT_64_BIT)
+			== VK_SUCCESS)
+		{
+			memcpy(s_frameTimings.statistics, statistics, sizeof statistics);
+		}
+	}
+}
+
+int recreateSwapChain();
+
+// Acquire or present reported that the swapchain no longer matches the
+// surface. A minimized window has no extent to build one for, the frames are
+// skipped until it is restored.
+static int rebuildOutdatedSwapChain()
+{
+	int width = 0;
+	int height = 0;
+	glfwGetFramebufferSize(s_window, &width, &height);
+
+	if (width == 0 || height == 0)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	return recreateSwapChain();
+}
+
+int drawFrame()
+{
+	const TimePoint frameStart = std::chrono::high_resolution_clock::now();
+
+	// 0 - Wait for the GPU to be done with this frame slot
+	//
+	vk_res = vkWaitForFences(s_logicalDevice, 1,
+	                         &s_inFlightFences[s_currentFrame], VK_TRUE,
+	                         UINT64_MAX);
+	ASSERT_VK(vk_res);
+
+	TimePoint stageStart = std::chrono::high_resolution_clock::now();
+	s_frameTimings.ms[STAGE_FENCE_WAIT] = elapsedMs(frameStart, stageStart);
+
+	// 1 - Get image from the swapchain, headless targets are used in turn
+	//
+	uint32_t imageIndex = s_currentFrame;
+
+	if (!s_options.headless)
+	{
+		vk_res = vkAcquireNextImageKHR(s_logicalDevice, s_swapChain,
+		                               UINT64_MAX,
+		                               s_imageAvailableSemaphores[
+			                               s_currentFrame], nullptr,
+		                               &imageIndex);
+
+		// The surface changed since the swapchain was made: nothing was
+		// acquired, build a new one and skip this frame
+		if (vk_res == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			return rebuildOutdatedSwapChain();
+		}
+		// Suboptimal still acquired the image and signals the semaphore,
+		// the frame is finished and the swapchain rebuilt after present
+		if (vk_res != VK_SUBOPTIMAL_KHR)
+		{
+			ASSERT_VK(vk_res);
+		}
+	}
+	const bool swapChainSuboptimal = vk_res == VK_SUBOPTIMAL_KHR;
+
+	TimePoint stageEnd = std::chrono::high_resolution_clock::now();
+	s_frameTimings.ms[STAGE_ACQUIRE] = elapsedMs(stageStart, stageEnd);
+	stageStart = stageEnd;
+
+	// The swap image may still be used by an older frame slot when
+	// images are acquired out of order
+	if (s_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+	{
+		vk_res = vkWaitForFences(s_logicalDevice, 1,
+		                         &s_imagesInFlight[imageIndex], VK_TRUE,
+		                         UINT64_MAX);
+		ASSERT_VK(vk_res);
+
+		stageEnd = std::chrono::high_resolution_clock::now();
+		s_frameTimings.ms[STAGE_FENCE_WAIT] += elapsedMs(stageStart, stageEnd);
+		stageStart = stageEnd;
+	}
+	s_imagesInFlight[imageIndex] = s_inFlightFences[s_currentFrame];
+
+	readQueryResults(imageIndex);
+
+	// Update uniforms
+	//
+	updateUniforms(imageIndex);
+
+	if (s_textureStreaming)
+	{
+		int result = updateTextureStreaming();
+		ASSERT(result);
+	}
+
+	stageEnd = std::chrono::high_resolution_clock::now();
+	s_frameTimings.ms[STAGE_UPDATE] = elapsedMs(stageStart, stageEnd);
+	stageStart = stageEnd;
+
+	// Record the frame unless its command buffer was prerecorded
+	VkCommandBuffer commandBuffer;
+
+	if (isRecordingPerFrame())
+	{
+		int result = recordFrame(imageIndex);
+		ASSERT(result);
+
+		commandBuffer = s_frameCommandBuffers[s_currentFrame];
+	}
+	else
+	{
+		commandBuffer = s_commandBuffers[imageIndex];
+	}
+
+	stageEnd = std::chrono::high_resolution_clock::now();
+	s_frameTimings.ms[STAGE_RECORD] = elapsedMs(stageStart, stageEnd);
+	stageStart = stageEnd;
+
+	// 2 - Execute Command Buffers
+	//
+	//
+	// Submit render pass
+	//
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+
+	// Wait semaphores
+	VkSemaphore waitSemaphores[] = {
+		s_imageAvailableSemaphores[s_currentFrame]
+	};
+	VkPipelineStageFlags waitStages[] = {
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+	};
+
+	submitInfo.waitSemaphoreCount = s_options.headless ? 0 : 1;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitStages;
+
+	// Signal semaphores
+	VkSemaphore signalSemaphores[] = {
+		s_renderFinishedSemaphores[s_currentFrame]
+	};
+
+	submitInfo.signalSemaphoreCount = s_options.headless ? 0 : 1;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	// Attach command buffer
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	vk_res = vkResetFences(s_logicalDevice, 1,
+	                       &s_inFlightFences[s_currentFrame]);
+	ASSERT_VK(vk_res);
+
+	vk_res = vkQueueSubmit(s_graphicsQueue, 1, &submitInfo,
+	                       s_inFlightFences[s_currentFrame]);
+	ASSERT_VK(vk_res);
+
+	s_queryResultsPending[imageIndex] = true;
+
+	stageEnd = std::chrono::high_resolution_clock::now();
+	s_frameTimings.ms[STAGE_SUBMIT] = elapsedMs(stageStart, stageEnd);
+	stageStart = stageEnd;
+
+	if (s_options.headless)
+	{
+		s_frameTimings.ms[STAGE_PRESENT] = 0.0;
+		s_frameTimings.ms[STAGE_FRAME] = elapsedMs(frameStart, stageEnd);
+
+		s_currentFrame = (s_currentFrame + 1) % s_options.framesInFlight;
+
+		return EXIT_SUCCESS;
+	}
+
+	// 3 - Present Frame
+	//
+	VkPresentInfoKHR presentInfo = {};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.pNext = nullptr;
+
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = signalSemaphores;
+
+	VkSwapchainKHR swapchain[] = {s_swapChain};
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = swapchain;
+	presentInfo.pImageIndices = &imageIndex;
+	presentInfo.pResults = nullptr;
+
+	vk_res = vkQueuePresentKHR(s_graphicsQueue, &presentInfo);
+	const bool swapChainOutdated = vk_res == VK_ERROR_OUT_OF_DATE_KHR ||
+		vk_res == VK_SUBOPTIMAL_KHR || swapChainSuboptimal;
+	if (!swapChainOutdated)
+	{
+		ASSERT_VK(vk_res);
+	}
+
+	stageEnd = std::chrono::high_resolution_clock::now();
+	s_frameTimings.ms[STAGE_PRESENT] = elapsedMs(stageStart, stageEnd);
+	s_frameTimings.ms[STAGE_FRAME] = elapsedMs(frameStart, stageEnd);
+
+	s_currentFrame = (s_currentFrame + 1) % s_options.framesInFlight;
+
+	if (swapChainOutdated)
+	{
+		return rebuildOutdatedSwapChain();
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Texture mip chain
+//
+// Every level down to 1x1, each half the previous one rounded down. Blitted
+// on the GPU when the format can be a filtered blit source and destination,
+// otherwise box filtered on the CPU and uploaded with level 0.
+
+static uint32_t mipLevelCount(VkExtent2D extent)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(extent.width, extent.height); size > 1;
+	     size /= 2)
+	{
+		levels++;
+	}
+	return levels;
+}
+
+static bool canBlitMipChain(VkFormat format)
+{
+	const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+		VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(s_physicalDevice, format, &props);
+
+	return (props.optimalTilingFeatures & features) == features;
+}
+
+// Offsets of the first mipLevels of a tightly packed RGBA8 chain, returns its
+// size
+static VkDeviceSize mipLevelOffsets(VkExtent2D extent, uint32_t mipLevels,
+                                    std::vector<VkDeviceSize>& offsets)
+{
+	offsets.resize(mipLevels);
+
+	VkDeviceSize size = 0;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		offsets[level] = size;
+		size += static_cast<VkDeviceSize>(std::max(extent.width >> level, 1u))
+			* std::max(extent.height >> level, 1u) * 4;
+	}
+	return size;
+}
+
+// sRGB 8-bit values to linear, and linear quantized to 12 bits back to sRGB
+struct SrgbTables
+{
+	float toLinear[256];
+	uint8_t fromLinear[4096];
+};
+
+static const SrgbTables& srgbTables()
+{
+	static const SrgbTables tables = []
+	{
+		SrgbTables t;
+		for (int i = 0; i < 256; i++)
+		{
+			const float c = i / 255.0f;
+			t.toLinear[i] = c <= 0.04045f
+				                ? c / 12.92f
+				                : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; i++)
+		{
+			const float l = i / 4095.0f;
+			const float c = l <= 0.0031308f
+				                ? l * 12.92f
+				                : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			t.fromLinear[i] = static_cast<uint8_t>(c * 255.0f + 0.5f);
+		}
+		return t;
+	}();
+	return tables;
+}
+
+// Linear RGBA of the texel back to sRGB, alpha stays linear
+static inline void encodeSrgbTexel(const float* texel, uint8_t* out,
+                                   const SrgbTables& tables)
+{
+#ifdef SIMD_SSE2
+	// The power curve fitted on 3 chained square roots, within one 8-bit
+	// step of the exact value, for the 4 channels at once
+	const __m128 linear = _mm_max_ps(_mm_loadu_ps(texel), _mm_setzero_ps());
+	const __m128 s1 = _mm_sqrt_ps(linear);
+	const __m128 s2 = _mm_sqrt_ps(s1);
+	const __m128 s3 = _mm_sqrt_ps(s2);
+	const __m128 curve = _mm_sub_ps(
+		_mm_add_ps(_mm_mul_ps(s1, _mm_set1_ps(0.662002687f)),
+		           _mm_mul_ps(s2, _mm_set1_ps(0.684122060f))),
+		_mm_add_ps(_mm_mul_ps(s3, _mm_set1_ps(0.323583601f)),
+		           _mm_mul_ps(linear, _mm_set1_ps(0.0225411470f))));
+
+	// Linear segment near black, and alpha
+	const __m128 dark = _mm_or_ps(
+		_mm_cmple_ps(linear, _mm_set1_ps(0.0031308f)),
+		_mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)));
+	const __m128 slope = _mm_setr_ps(12.92f, 12.92f, 12.92f, 1.0f);
+	const __m128 srgb = _mm_or_ps(_mm_and_ps(dark, _mm_mul_ps(linear, slope)),
+	                              _mm_andnot_ps(dark, curve));
+
+	const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(
+		_mm_min_ps(srgb, _mm_set1_ps(1.0f)), _mm_set1_ps(255.0f)));
+	const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q, q), q);
+	const uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(bytes));
+	memcpy(out, &packed, 4);
+#else
+	int32_t q[4];
+	for (int c = 0; c < 4; c++)
+	{
+		q[c] = static_cast<int32_t>(texel[c] * (c < 3 ? 4095.0f : 255.0f) +
+			0.5f);
+	}
+	out[0] = tables.fromLinear[q[0]];
+	out[1] = tables.fromLinear[q[1]];
+	out[2] = tables.fromLinear[q[2]];
+	out[3] = static_cast<uint8_t>(q[3]);
+#endif
+}
+
+// Fills levels 1 and up of an sRGB RGBA8 chain from level 0, given as RGB
+// or RGBA texels rather than read back from the chain, which is usually
+// uncached staging memory. Each texel averages 2x2 texels of the previous
+// level in linear space. A column or row left over by an odd size is
+// dropped, where the linear filtered blit blends it into the last texel
+static void downsampleMipChain(const uint8_t* texels, int components,
+                               uint8_t* chain, VkExtent2D extent,
+                               const std::vector<VkDeviceSize>& offsets)
+{
+	const SrgbTables& tables = srgbTables();
+
+	uint32_t width = extent.width;
+	uint32_t height = extent.height;
+
+	// Linear RGBA of the level being reduced and of the next one
+	std::vector<float> source(static_cast<size_t>(width) * height * 4);
+	std::vector<float> destination;
+
+	// Exact table lookups, no arithmetic beats them for 8-bit values
+	for (size_t i = 0; i < source.size() / 4; i++, texels += components)
+	{
+		source[i * 4] = tables.toLinear[texels[0]];
+		source[i * 4 + 1] = tables.toLinear[texels[1]];
+		source[i * 4 + 2] = tables.toLinear[texels[2]];
+		source[i * 4 + 3] = components == 4 ? texels[3] / 255.0f : 1.0f;
+	}
+
+	// Bands of rows, small levels stay on this thread
+	auto rowsPerJob = [](uint32_t levelWidth)
+	{
+		return std::max(1u, 65536 / levelWidth);
+	};
+
+	// One pool for the whole chain, sized for level 1 which has the most
+	// bands
+	const uint32_t firstWidth = std::max(width / 2, 1u);
+	const uint32_t firstHeight = std::max(height / 2, 1u);
+	const uint32_t maxJobCount = (firstHeight + rowsPerJob(firstWidth) - 1) /
+		rowsPerJob(firstWidth);
+
+	WorkerPool pool;
+	startWorkers(pool, std::max(1u, std::min(
+		                            maxJobCount,
+		                            std::thread::hardware_concurrency())) - 1);
+
+	for (uint32_t level = 1; level < offsets.size(); level++)
+	{
+		const uint32_t levelWidth = std::max(width / 2, 1u);
+		const uint32_t levelHeight = std::max(height / 2, 1u);
+		uint8_t* out = chain + offsets[level];
+
+		destination.resize(static_cast<size_t>(levelWidth) * levelHeight * 4);
+
+		const uint32_t levelRowsPerJob = rowsPerJob(levelWidth);
+		const uint32_t jobCount = (levelHeight + levelRowsPerJob - 1) /
+			levelRowsPerJob;
+
+		auto reduceRows = [&](uint32_t job)
+		{
+			const uint32_t rowEnd = std::min(levelHeight, (job + 1) *
+			                                 levelRowsPerJob);
+
+			for (uint32_t y = job * levelRowsPerJob; y < rowEnd; y++)
+			{
+				const float* row0 = &source[static_cast<size_t>(std::min(
+					y * 2, height - 1)) * width * 4];
+				const float* row1 = &source[static_cast<size_t>(std::min(
+					y * 2 + 1, height - 1)) * width * 4];
+				float* texel = &destination[static_cast<size_t>(y) *
+					levelWidth * 4];
+
+				for (uint32_t x = 0; x < levelWidth; x++, texel += 4)
+				{
+					const uint32_t x0 = std::min(x * 2, width - 1) * 4;
+					const uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+#ifdef SIMD_SSE2
+					const __m128 sum = _mm_add_ps(
+						_mm_add_ps(_mm_loadu_ps(row0 + x0),
+						           _mm_loadu_ps(row0 + x1)),
+						_mm_add_ps(_mm_loadu_ps(row1 + x0),
+						           _mm_loadu_ps(row1 + x1)));
+					_mm_storeu_ps(texel, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+					for (int c = 0; c < 4; c++)
+					{
+						texel[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] +
+							row1[x1 + c]) * 0.25f;
+					}
+#endif
+					encodeSrgbTexel(texel, out + (static_cast<size_t>(y) *
+						                levelWidth + x) * 4, tables);
+				}
+			}
+		};
+
+		if (jobCount > 1)
+		{
+			runJobs(pool, jobCount, reduceRows);
+		}
+		else
+		{
+			reduceRows(0);
+		}
+
+		std::swap(source, destination);
+		width = levelWidth;
+		height = levelHeight;
+	}
+
+	stopWorkers(pool);
+}
+
+// Image decoding
+//
+// Queued images are decoded together on the load workers, on a thread of
+// their own so the rest of the startup uploads are prepared meanwhile.
+// stb_image keeps the 3 channels of RGB files and they are expanded to RGBA
+// on the way into the mapped staging buffer, instead of being converted by
+// stb_image then copied.
+
+struct ImageDecode
+{
+	std::string filename;
+	// Whole file when it is in the asset archive, empty to read it from disk
+	AssetData file;
+	VkExtent2D extent;
+	// Channels of the file
+	int channels;
+	// Level 0 of an RGBA8 chain, in a staging buffer
+	uint8_t* chain;
+	// Levels to box filter on the CPU, empty for level 0 alone
+	std::vector<VkDeviceSize> mipOffsets;
+	double decodeMs;
+	double downsampleMs;
+	std::string error;
+};
+
+// Not touched from the main thread between startImageDecodes() and
+// finishImageDecodes()
+static std::vector<ImageDecode> s_imageDecodes;
+static std::thread s_imageDecodeThread;
+
+// Size and channels from the file header, without decoding
+static bool readImageInfo(const std::string& filename, const AssetData& file,
+                          VkExtent2D& extent, int& channels)
+{
+	int width, height;
+	if (file.size > 0
+		    ? !stbi_info_from_memory(file.data(), static_cast<int>(file.size),
+		                             &width, &height, &channels)
+		    : !stbi_info(filename.c_str(), &width, &height, &channels))
+	{
+		return false;
+	}
+
+	extent.width = static_cast<uint32_t>(width);
+	extent.height = static_cast<uint32_t>(height);
+	return true;
+}
+
+// MSVC builds the SSSE3 shuffles without /arch, they only run when cpuid
+// reports SSSE3
+#if defined(__SSSE3__) || defined(__AVX__) || (defined(_MSC_VER) && \
+	!defined(__clang__) && defined(SIMD_SSE2))
+#define RGB_EXPAND_SSSE3
+#endif
+
+#ifdef RGB_EXPAND_SSSE3
+static bool ssse3Supported()
+{
+#if defined(__SSSE3__) || defined(__AVX__)
+	return true;
+#else
+	// SSSE3 in ECX of leaf 1
+	static const bool supported = []
+	{
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+	}();
+	return supported;
+#endif
+}
+#endif
+
+// RGB texels to opaque RGBA, 4 per shuffle when SSSE3 is there. The scalar
+// path loads 4 bytes per texel, the last texel is copied bytewise so nothing
+// is read past the source
+static void expandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t count)
+{
+	size_t i = 0;
+
+#ifdef RGB_EXPAND_SSSE3
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8,
+	                                      -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+	// 16 bytes loaded for the 12 used
+	const size_t shuffleCount = ssse3Supported() ? count : 0;
+	for (; i + 6 <= shuffleCount; i += 4)
+	{
+		const __m128i texels = _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(rgb + i * 3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4),
+		                 _mm_or_si128(_mm_shuffle_epi8(texels, shuffle),
+		                              alpha));
+	}
+#endif
+
+	for (; i + 1 < count; i++)
+	{
+		uint32_t texel;
+		memcpy(&texel, rgb + i * 3, 4);
+		texel |= 0xff000000; // Little endian, the 4th byte is alpha
+		memcpy(rgba + i * 4, &texel, 4);
+	}
+
+	for (; i < count; i++)
+	{
+		rgba[i * 4] = rgb[i * 3];
+		rgba[i * 4 + 1] = rgb[i * 3 + 1];
+		rgba[i * 4 + 2] = rgb[i * 3 + 2];
+		rgba[i * 4 + 3] = 255;
+	}
+}
+
+static void decodeImage(ImageDecode& decode)
+{
+	const TimePoint startTime = std::chrono::high_resolution_clock::now();
+
+	const int components = decode.channels == 3 ? STBI_rgb : STBI_rgb_alpha;
+
+	int width, height, channels;
+	stbi_uc* pixels = decode.file.size > 0
+		                  ? stbi_load_from_memory(
+			                  decode.file.data(),
+			                  static_cast<int>(decode.file.size), &width,
+			                  &height, &channels, components)
+		                  : stbi_load(decode.filename.c_str(), &width,
+		                              &height, &channels, components);
+
+	if (!pixels)
+	{
+		decode.error = stbi_failure_reason();
+		return;
+	}
+
+	if (static_cast<uint32_t>(width) != decode.extent.width ||
+		static_cast<uint32_t>(height) != decode.extent.height)
+	{
+		stbi_image_free(pixels);
+		decode.error = "size differs from its header";
+		return;
+	}
+
+	const size_t texelCount = static_cast<size_t>(width) * height;
+
+	if (components == STBI_rgb)
+	{
+		expandRgbToRgba(pixels, decode.chain, texelCount);
+	}
+	else
+	{
+		memcpy(decode.chain, pixels, texelCount * 4);
+	}
+
+	const TimePoint decodeEnd = std::chrono::high_resolution_clock::now();
+	decode.decodeMs = elapsedMs(startTime, decodeEnd);
+
+	if (decode.mipOffsets.size() > 1)
+	{
+		downsampleMipChain(pixels, components, decode.chain, decode.extent,
+		                   decode.mipOffsets);
+
+		decode.downsampleMs = elapsedMs(
+			decodeEnd, std::chrono::high_resolution_clock::now());
+	}
+
+	stbi_image_free(pixels);
+}
+
+// Queue every image during the setup, then start them all at once
+static void queueImageDecode(ImageDecode decode)
+{
+	if (s_imageDecodeThread.joinable())
+	{
+		throw std::runtime_error("Image queued after the decodes started!");
+	}
+
+	s_imageDecodes.push_back(std::move(decode));
+}
+
+// Once per batch, the queue is left to the decode thread until
+// finishImageDecodes()
+static int startImageDecodes()
+{
+	if (s_imageDecodeThread.joinable())
+	{
+		std::cerr << "Image decodes already started" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (s_imageDecodes.empty())
+	{
+		return EXIT_SUCCESS;
+	}
+
+	s_imageDecodeThread = std::thread([]
+	{
+		runLoadJobs(static_cast<uint32_t>(s_imageDecodes.size()),
+		            [](uint32_t job)
+		            {
+			            decodeImage(s_imageDecodes[job]);
+		            });
+	});
+
+	return EXIT_SUCCESS;
+}
+
+// The staging buffers hold the images once this returns, call it before
+// submitting the upload batch
+static int finishImageDecodes()
+{
+	if (s_imageDecodeThread.joinable())
+	{
+		s_imageDecodeThread.join();
+	}
+
+	bool failed = false;
+	for (const ImageDecode& decode : s_imageDecodes)
+	{
+		if (!decode.error.empty())
+		{
+			std::cerr << "Failed to decode " << decode.filename << ": " <<
+				decode.error << std::endl;
+			failed = true;
+			continue;
+		}
+
+		std::cout << "Decoded " << decode.filename << " in " << decode.
+			decodeMs << " ms";
+		if (decode.mipOffsets.size() > 1)
+		{
+			std::cout << ", mip chain box filtered in " << decode.downsampleMs
+				<< " ms";
+		}
+		std::cout << std::endl;
+	}
+	s_imageDecodes.clear();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// KTX2 textures
+//
+// Block compressed levels made offline by tools/encode_texture.cpp. They are
+// read from the file, or the archive mapping, straight into the staging
+// buffer and copied as they are, mips included, or only the resident tail
+// with --texture-budget.
+
+static bool isKtx2File(const std::string& filename)
+{
+	const size_t dot = filename.find_last_of('.');
+	return dot != std::string::npos && filename.substr(dot) == ".ktx2";
+}
+
+static int loadKtx2Texture(const std::string& filename)
+{
+	const TimePoint startTime = std::chrono::high_resolution_clock::now();
+
+	// Mapped from the asset archive, or its index read from disk
+	AssetData packed;
+	if (const AssetEntry* entry = findAsset(filename))
+	{
+		packed = readAsset(*entry);
+	}
+
+	size_t fileSize = packed.size;
+	std::vector<uint8_t> index;
+
+	if (packed.size == 0)
+	{
+		std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Fail to load texture " + filename + "!");
+		}
+
+		fileSize = static_cast<size_t>(file.tellg());
+
+		// Header and level index, far less than this for any sane level count
+		index.resize(std::min<size_t>(fileSize, 4096));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(index.data()), index.size());
+	}
+
+	Ktx2File ktx;
+	const char* error = packed.size > 0
+		                    ? ktx2ReadIndex(packed.data(), packed.size,
+		                                    fileSize, ktx)
+		                    : ktx2ReadIndex(index.data(), index.size(),
+		                                    fileSize, ktx);
+	if (error == nullptr && ktx2BlockSize(ktx.header.vkFormat) == 0)
+	{
+		error = "only BC1, BC3 and BC7 blocks are supported";
+	}
+	// Levels past 1x1 would be sized 1x1 again, and the image creation fails
+	// on more levels than the full chain
+	if (error == nullptr && ktx.header.levelCount > mipLevelCount({
+		ktx.header.pixelWidth, ktx.header.pixelHeight
+	}))
+	{
+		error = "more mip levels than the image size allows";
+	}
+	if (error != nullptr)
+	{
+		throw std::runtime_error(filename + ": " + error + "!");
+	}
+
+	const VkFormat format = static_cast<VkFormat>(ktx.header.vkFormat);
+	const VkExtent2D extent = {ktx.header.pixelWidth, ktx.header.pixelHeight};
+
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(s_physicalDevice, format, &props);
+
+	if (!s_enabledFeatures.textureCompressionBC || !(props.
+		optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+	{
+		throw std::runtime_error("BC textures not supported by the device!");
+	}
+
+	// Whole blocks, the copies and the streaming budget count on it
+	const VkDeviceSize blockSize = ktx2BlockSize(ktx.header.vkFormat);
+
+	for (uint32_t level = 0; level < ktx.header.levelCount; level++)
+	{
+		const VkDeviceSize blocks =
+			static_cast<VkDeviceSize>((std::max(extent.width >> level, 1u) + 3) /
+				4) * ((std::max(extent.height >> level, 1u) + 3) / 4);
+
+		if (ktx.levels[level].byteLength != blocks * blockSize)
+		{
+			throw std::runtime_error(filename + ": unexpected level size!");
+		}
+	}
+
+	if (s_options.textureBudget > 0)
+	{
+		return createStreamedTexture(filename, packed, ktx);
+	}
+
+	std::vector<VkDeviceSize> offsets;
+	const VkDeviceSize textureSize = ktx2StagingOffsets(ktx, 0, offsets);
+
+	int result = uploadKtx2Levels(filename, packed, ktx, 0, s_textureImage,
+	                              s_textureImageMemory);
+	ASSERT(result);
+
+	s_textureFormat = format;
+	s_textureExtent = extent;
+	s_textureMipLevels = ktx.header.levelCount;
+
+	const TimePoint endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << "Texture " << filename << " " << extent.width << "x" <<
+		extent.height << ", " << s_textureMipLevels << " mip levels of " <<
+		blockSize << " byte blocks, " << textureSize / 1024 << " KiB read in "
+		<< elapsedMs(startTime, endTime) << " ms" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+int loadTexture()
+{
+	const std::string filename = s_options.textureFile.empty()
+		                             ? "textures/texture.jpg"
+		                             : s_options.textureFile;
+
+	// Packed textures are told apart by the format of their entry
+	const AssetEntry* entry = findAsset(filename);
+
+	if (entry ? entry->format == ASSET_FORMAT_KTX2 : isKtx2File(filename))
+	{
+		return loadKtx2Texture(filename);
+	}
+
+	AssetData file;
+	if (entry)
+	{
+		file = readAsset(*entry);
+	}
+
+	VkExtent2D extent;
+	int channels;
+	if (!readImageInfo(filename, file, extent, channels))
+	{
+		throw std::runtime_error("Fail to load texture!");
+	}
+
+	const VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+
+	s_textureExtent = extent;
+	s_textureMipLevels = mipLevelCount(extent);
+	const bool blit = canBlitMipChain(format);
+
+	// Level 0 alone when the GPU makes the others
+	std::vector<VkDeviceSize> offsets;
+	const VkDeviceSize textureSize = mipLevelOffsets(
+		extent, blit ? 1 : s_textureMipLevels, offsets);
+
+	const StagingBuffer staging = createStagingBuffer(textureSize);
+
+	// Decoded once the setup started the queue, while the mesh is loaded
+	ImageDecode decode = {};
+	decode.filename = filename;
+	decode.file = std::move(file);
+	decode.extent = extent;
+	decode.channels = channels;
+	decode.chain = staging.memory.mapped;
+	if (!blit)
+	{
+		decode.mipOffsets = offsets;
+	}
+
+	queueImageDecode(std::move(decode));
+
+	createImage2D(extent, s_textureMipLevels, format, VK_IMAGE_TILING_OPTIMAL,
+	              VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+	              (blit ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0),
+	              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_textureImage,
+	              s_textureImageMemory);
+
+	transitionImageLayout(s_textureImage, format, VK_IMAGE_LAYOUT_UNDEFINED,
+	                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                      s_textureMipLevels);
+	transferBufferToImage(staging.buffer, s_textureImage, extent.width,
+	                      extent.height, offsets);
+
+	if (blit)
+	{
+		generateMipChain(s_textureImage, extent, s_textureMipLevels);
+	}
+	else
+	{
+		transitionImageLayout(s_textureImage, format,
+		                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		                      s_textureMipLevels);
+	}
+
+	std::cout << "Texture " << extent.width << "x" << extent.height << ", " <<
+		s_textureMipLevels << " mip levels " << (blit
+			                                         ? "blitted on the GPU"
+			                                         : "box filtered on the CPU")
+		<< std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+int createTextureImageView()
+{
+	s_textureImageView = createImageView(s_textureImage, s_textureFormat,
+	                                     VK_IMAGE_ASPECT_COLOR_BIT,
+	                                     s_textureMipLevels);
+
+	return EXIT_SUCCESS;
+}
+
+// window is null in headless mode
+int setupVulkan(GLFWwindow* window)
+{
+	s_window = window;
+#ifdef _WIN32
+	if (window)
+	{
+		s_hInfos.hInstance = GetModuleHandle(nullptr);
+		s_hInfos.hWnd = glfwGetWin32Window(window);
+	}
+#endif
+
+	int result;
+
+	// Before anything is loaded, mapped until cleanUp()
+	if (!s_options.archiveFile.empty())
+	{
+		result = openAssetArchive(s_options.archiveFile);
+		ASSERT(result);
+	}
+
+	initAppExtensions();
+	initDeviceExtension();
+
+	result = initInstance();
+	ASSERT(result);
+
+	result = setupCallbacks();
+	ASSERT(result);
+
+	if (!s_options.headless)
+	{
+		result = initSurface();
+		ASSERT(result);
+	}
+
+	result = initLogicalDevice();
+	ASSERT(result);
+
+	result = s_options.headless ? createOffscreenTargets() : createSwapChain();
+	ASSERT(result);
+
+	result = createRenderPass();
+	ASSERT(result);
+
+	result = createDescriptorSetLayout();
+	ASSERT(result);
+
+	result = createPipelineCache();
+	ASSERT(result);
+
+	result = createGraphicsPipeline();
+	ASSERT(result);
+
+	result = createCullPipeline();
+	ASSERT(result);
+
+	result = createHiZPipeline();
+	ASSERT(result);
+
+	result = createDepthResources();
+	ASSERT(result);
+
+	result = createFrameBuffers();
+	ASSERT(result);
+
+	result = createCommandPools();
+	ASSERT(result);
+
+	// All startup uploads go in one batch, waited on before the first frame
+	result = beginUploadBatch();
+	ASSERT(result);
+
+	result = loadTexture();
+	ASSERT(result);
+
+	result = createTextureImageView();
+	ASSERT(result);
+
+	// Decoded while the mesh is loaded
+	result = startImageDecodes();
+	ASSERT(result);
+
+	result = createVertexAndIndexBuffers();
+	ASSERT(result);
+
+	result = createInstanceBuffer();
+	ASSERT(result);
+
+	result = finishImageDecodes();
+	ASSERT(result);
+
+	result = submitUploadBatch();
+	ASSERT(result);
+
+	result = createUniformBuffers();
+	ASSERT(result);
+
+	result = createCullBuffers();
+	ASSERT(result);
+
+	result = createDescriptorPool();
+	ASSERT(result);
+
+	result = createDescriptorSet();
+	ASSERT(result);
+
+	result = createHiZResources();
+	ASSERT(result);
+
+	result = createQueryPools();
+	ASSERT(result);
+
+	result = createCommandBuffers();
+	ASSERT(result);
+
+	result = createFrameCommandPools();
+	ASSERT(result);
+
+	result = createSyncObjects();
+	ASSERT(result);
+
+	result = waitUploadBatch();
+	ASSERT(result);
+
+	printMemoryStats();
+
+	return EXIT_SUCCESS;
+}
+
+// The swapchain itself is kept, it is retired by the next createSwapChain()
+void cleanUpSwapChain()
 {
-	const VkFormat depthFormat = findDepthFormat();
+	vkDeviceWaitIdle(s_logicalDevice);
 
-	createImage2D(s_swapChainExtent, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-	              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-	              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_depthImage,
-	              s_depthImageMemory);
-	s_depthImageView = createImageView(s_depthImage, depthFormat,
-	                                   VK_IMAGE_ASPECT_DEPTH_BIT);
+	for (auto frameBuffer : s_swapChainBuffers)
+	{
+		vkDestroyFramebuffer(s_logicalDevice, frameBuffer, nullptr);
+	}
+
+	destroyQueryPools();
+
+	for (auto imageView : s_swapChainImagesViews)
+	{
+		vkDestroyImageView(s_logicalDevice, imageView, nullptr);
+	}
+
+	destroyHiZResources();
+
+	vkDestroyImage(s_logicalDevice, s_depthImage, nullptr);
+	vkDestroyImageView(s_logicalDevice, s_depthImageView, nullptr);
+	freeMemory(s_depthImageMemory);
+}
+
+int recreateSwapChain()
+{
+	vkDeviceWaitIdle(s_logicalDevice);
+
+	const VkFormat oldFormat = s_swapChainFormat.format;
+
+	cleanUpSwapChain();
+	createSwapChain();
+	createDepthResources();
+
+	// Viewport and scissor are dynamic, the render pass and pipeline only
+	// depend on the surface format
+	if (s_swapChainFormat.format != oldFormat)
+	{
+		vkDestroyPipeline(s_logicalDevice, s_graphicsPipeline, nullptr);
+		vkDestroyPipelineLayout(s_logicalDevice, s_pipelineLayout, nullptr);
+		vkDestroyRenderPass(s_logicalDevice, s_renderPass, nullptr);
+
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+
+	createFrameBuffers();
+	createHiZResources();
+
+	// The rings need one slot per swap image, they all grow together
+	if (s_swapChainImagesViews.size() > s_uniformRingSlots)
+	{
+		destroyUniformBuffers();
+		createUniformBuffers();
+
+		if (s_options.animateInstances)
+		{
+			destroyInstanceBuffer();
+			createInstanceRing();
+		}
+
+		destroyCullBuffers();
+		createCullBuffers();
+		updateDescriptorSet();
+	}
+
+	createQueryPools();
+	createCommandBuffers();
+
+	// Swap images are new, none of them is in flight
+	s_imagesInFlight.assign(s_swapChainImagesViews.size(), VK_NULL_HANDLE);
 
 	return EXIT_SUCCESS;
 }
 
-int createCommandBuffers()
+void cleanUp()
 {
-	s_commandBuffers.resize(s_swapChainBuffers.size());
+	cleanUpSwapChain();
 
-	VkCommandBufferAllocateInfo commandBufferInfo = {};
-	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandBufferInfo.pNext = nullptr;
-	commandBufferInfo.commandPool = s_commandPool;
-	commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferInfo.commandBufferCount = static_cast<uint32_t>(
-		s_swapChainBuffers.size());
+	if (s_options.headless)
+	{
+		destroyOffscreenTargets();
+	}
+	else
+	{
+		vkDestroySwapchainKHR(s_logicalDevice, s_swapChain, nullptr);
+	}
+	vkDestroyPipeline(s_logicalDevice, s_graphicsPipeline, nullptr);
+	vkDestroyPipelineLayout(s_logicalDevice, s_pipelineLayout, nullptr);
+	vkDestroyRenderPass(s_logicalDevice, s_renderPass, nullptr);
+	destroyCullPipeline();
 
-	vk_res = vkAllocateCommandBuffers(s_logicalDevice, &commandBufferInfo,
-	                                  s_commandBuffers.data());
-	ASSERT_VK(vk_res);
+	if (savePipelineCache() != EXIT_SUCCESS)
+	{
+		std::cerr << "Failed to save the pipeline cache" << std::endl;
+	}
+	vkDestroyPipelineCache(s_logicalDevice, s_pipelineCache, nullptr);
 
-	for (size_t i = 0; i < s_commandBuffers.size(); i++)
+	for (uint32_t i = 0; i < s_options.framesInFlight; i++)
 	{
-		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-		commandBufferBeginInfo.sType =
-			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		commandBufferBeginInfo.pNext = nullptr;
-		commandBufferBeginInfo.flags = 0;
-		commandBufferBeginInfo.pInheritanceInfo = nullptr;
+		vkDestroySemaphore(s_logicalDevice, s_imageAvailableSemaphores[i],
+		                   nullptr);
+		vkDestroySemaphore(s_logicalDevice, s_renderFinishedSemaphores[i],
+		                   nullptr);
+		vkDestroyFence(s_logicalDevice, s_inFlightFences[i], nullptr);
+	}
 
-		// Begin Command Buffer
-		//
-		vk_res = vkBeginCommandBuffer(s_commandBuffers[i],
-		                              &commandBufferBeginInfo);
-		ASSERT_VK(vk_res);
+	vkDestroyDescriptorSetLayout(s_logicalDevice, s_descriptorLayout, nullptr);
+	vkDestroyBuffer(s_logicalDevice, s_vertexBuffer, nullptr);
+	freeMemory(s_vertexBufferMemory);
+	vkDestroyBuffer(s_logicalDevice, s_indexBuffer, nullptr);
+	freeMemory(s_indexBufferMemory);
+	if (s_options.meshlets)
+	{
+		vkDestroyBuffer(s_logicalDevice, s_meshletBuffer, nullptr);
+		freeMemory(s_meshletBufferMemory);
+	}
+	destroyInstanceBuffer();
+	destroyCullBuffers();
+	destroyTextureStreaming();
+	destroyFrameCommandPools();
+	vkDestroyCommandPool(s_logicalDevice, s_commandPool, nullptr);
+	vkDestroyCommandPool(s_logicalDevice, s_commandTransferPool, nullptr);
+	vkDestroyFence(s_logicalDevice, s_uploadFence, nullptr);
+	vkDestroySemaphore(s_logicalDevice, s_uploadSemaphore, nullptr);
 
-		// Begin Render Pass
-		//
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.pNext = nullptr;
-		renderPassInfo.renderPass = s_renderPass;
-		renderPassInfo.framebuffer = s_swapChainBuffers[i];
+	destroyUniformBuffers();
 
-		renderPassInfo.renderArea.offset = {0, 0};
-		renderPassInfo.renderArea.extent = s_swapChainExtent;
+	vkDestroyImageView(s_logicalDevice, s_textureImageView, nullptr);
+	vkDestroyImage(s_logicalDevice, s_textureImage, nullptr);
+	freeMemory(s_textureImageMemory);
 
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-		clearValues[1].depthStencil = {1.0f, 0};
+	vkDestroyDescriptorPool(s_logicalDevice, s_descriptorPool, nullptr);
+	destroyMemoryManager();
+	vkDestroyDevice(s_logicalDevice, nullptr);
+	if (!s_options.headless)
+	{
+		vkDestroySurfaceKHR(s_instance, s_surfaceKHR, nullptr);
+	}
+	vkDestroyInstance(s_instance, nullptr);
 
-		renderPassInfo.clearValueCount = 2;
-		renderPassInfo.pClearValues = clearValues.data();
+	closeAssetArchive();
+}
 
-		vkCmdBeginRenderPass(s_commandBuffers[i], &renderPassInfo,
-		                     VK_SUBPASS_CONTENTS_INLINE);
+/// GLFW
 
-		// Activate pipeline
-		vkCmdBindPipeline(s_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-		                  s_graphicsPipeline);
-
-		VkBuffer vertexBuffers[] = {s_vertexBuffer};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(s_commandBuffers[i], 0, 1, vertexBuffers,
-		                       offsets);
-		vkCmdBindIndexBuffer(s_commandBuffers[i], s_indexBuffer, 0,
-		                     VK_INDEX_TYPE_UINT16);
-
-		// Bind descriptors
-		vkCmdBindDescriptorSets(s_commandBuffers[i],
-		                        VK_PIPELINE_BIND_POINT_GRAPHICS,
-		                        s_pipelineLayout, 0, 1, &s_descriptorSets[i], 0,
-		                        nullptr);
+static void frameBufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+	// Minimized, there is no extent to build a swapchain for
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
 
-		// Draw
-		vkCmdDrawIndexed(s_commandBuffers[i],
-		                 static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+	recreateSwapChain();
+}
 
-		// End RenderPass
-		vkCmdEndRenderPass(s_commandBuffers[i]);
+static void printUsage()
+{
+	std::cout << "Usage: VulkanCube [options]" << std::endl
+		<< "  --device <index>          physical device to use (default 0)"
+		<< std::endl
+		<< "  --frames-in-flight <n>    frames recorded ahead of the GPU, 1 to "
+		<< MAX_FRAMES_IN_FLIGHT << " (default " << DEFAULT_FRAMES_IN_FLIGHT
+		<< ")" << std::endl
+		<< "  --benchmark <frames>      render a fixed number of frames in a "
+		"hidden window and report the throughput" << std::endl
+		<< "  --warmup <frames>         frames rendered before measuring (default "
+		<< DEFAULT_WARMUP_FRAMES << ")" << std::endl
+		<< "  --benchmark-output <file> write the results, JSON summary for a "
+		".json file, per-frame CSV otherwise" << std::endl
+		<< "  --headless                render offscreen without window nor "
+		"surface (default " << DEFAULT_HEADLESS_FRAMES << " frames)" <<
+		std::endl
+		<< "  --size <width>x<height>   window or offscreen size (default " <<
+		WIDTH << "x" << HEIGHT << ")" << std::endl
+		<< "  --instances <count>       draw a grid of cubes with one "
+		"instanced call" << std::endl
+		<< "  --animate-instances       recompose every instance matrix on "
+		"the CPU each frame" << std::endl
+		<< "  --transform-benchmark     time the SoA transform kernels "
+		"against glm and exit" << std::endl
+		<< "  --record-per-frame        record every frame instead of once "
+		"per swap image" << std::endl
+		<< "  --record-threads <n>      record every frame with secondary "
+		"command buffers on n threads" << std::endl
+		<< "  --instances-per-draw <n>  split the instances in draws of n "
+		"(default all in one draw)" << std::endl
+		<< "  --gpu-culling             frustum cull the instances in a "
+		"compute pass and draw them indirectly" << std::endl
+		<< "  --occlusion-culling       also cull them against the previous "
+		"frame's depth pyramid (implies --gpu-culling)" << std::endl
+		<< "  --mesh <file>             draw an .obj or .glb model instead "
+		"of the cube" << std::endl
+		<< "  --optimize-mesh           reorder the mesh for the vertex cache "
+		"and vertex fetch" << std::endl
+		<< "  --optimize-overdraw       also sort its triangle clusters "
+		"against overdraw (implies --optimize-mesh)" << std::endl
+		<< "  --packed-vertices         upload 12 byte quantized vertices "
+		"instead of 24 byte float ones" << std::endl
+		<< "  --meshlets                split the mesh in clusters culled by "
+		"frustum and normal cone on the GPU" << std::endl
+		<< "  --texture <file>          sample a .ktx2 of BC1/BC3/BC7 blocks "
+		"or an image instead of textures/texture.jpg" << std::endl
+		<< "  --texture-benchmark       time minified texture sampling with "
+		"and without mips (needs --headless)" << std::endl
+		<< "  --texture-budget <MiB>    stream the levels of a .ktx2 texture "
+		"on demand within this budget" << std::endl
+		<< "  --archive <file>          map a pack_assets archive and load the "
+		"assets it holds from it" << std::endl;
+}
 
-		// Close Command Buffer
-		vk_res = vkEndCommandBuffer(s_commandBuffers[i]);
-		ASSERT_VK(vk_res);
+static int parseArguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--device" && hasValue)
+		{
+			s_options.deviceIndex = std::stoul(argv[++i]);
+		}
+		else if (arg == "--frames-in-flight" && hasValue)
+		{
+			s_options.framesInFlight = std::stoul(argv[++i]);
+
+			if (s_options.framesInFlight < 1 || s_options.framesInFlight >
+				MAX_FRAMES_IN_FLIGHT)
+			{
+				std::cerr << "Frames in flight must be between 1 and " <<
+					MAX_FRAMES_IN_FLIGHT << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--benchmark" && hasValue)
+		{
+			s_options.benchmarkFrames = std::stoul(argv[++i]);
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			s_options.warmupFrames = std::stoul(argv[++i]);
+		}
+		else if (arg == "--benchmark-output" && hasValue)
+		{
+			s_options.benchmarkOutput = argv[++i];
+		}
+		else if (arg == "--instances" && hasValue)
+		{
+			s_options.instanceCount = std::stoul(argv[++i]);
+		}
+		else if (arg == "--animate-instances")
+		{
+			s_options.animateInstances = true;
+		}
+		else if (arg == "--transform-benchmark")
+		{
+			s_options.transformBenchmark = true;
+		}
+		else if (arg == "--record-per-frame")
+		{
+			s_options.recordPerFrame = true;
+		}
+		else if (arg == "--record-threads" && hasValue)
+		{
+			s_options.recordThreads = std::stoul(argv[++i]);
+		}
+		else if (arg == "--instances-per-draw" && hasValue)
+		{
+			s_options.instancesPerDraw = std::stoul(argv[++i]);
+		}
+		else if (arg == "--gpu-culling")
+		{
+			s_options.gpuCulling = true;
+		}
+		else if (arg == "--occlusion-culling")
+		{
+			s_options.gpuCulling = true;
+			s_options.occlusionCulling = true;
+		}
+		else if (arg == "--mesh" && hasValue)
+		{
+			s_options.meshFile = argv[++i];
+		}
+		else if (arg == "--optimize-mesh")
+		{
+			s_options.optimizeMesh = true;
+		}
+		else if (arg == "--optimize-overdraw")
+		{
+			s_options.optimizeMesh = true;
+			s_options.optimizeOverdraw = true;
+		}
+		else if (arg == "--packed-vertices")
+		{
+			s_options.packedVertices = true;
+		}
+		else if (arg == "--meshlets")
+		{
+			s_options.gpuCulling = true;
+			s_options.meshlets = true;
+		}
+		else if (arg == "--texture" && hasValue)
+		{
+			s_options.textureFile = argv[++i];
+		}
+		else if (arg == "--texture-benchmark")
+		{
+			s_options.textureBenchmark = true;
+		}
+		else if (arg == "--texture-budget" && hasValue)
+		{
+			s_options.textureBudget = std::stoul(argv[++i]);
+		}
+		else if (arg == "--archive" && hasValue)
+		{
+			s_options.archiveFile = argv[++i];
+		}
+		else if (arg == "--headless")
+		{
+			s_options.headless = true;
+		}
+		else if (arg == "--size" && hasValue)
+		{
+			if (sscanf(argv[++i], "%ux%u", &s_options.width,
+			           &s_options.height) != 2 || s_options.width == 0 ||
+				s_options.height == 0)
+			{
+				printUsage();
+				return EXIT_FAILURE;
+			}
+		}
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (s_options.animateInstances && s_options.instanceCount == 0)
+	{
+		std::cerr << "--animate-instances needs --instances" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Clusters are culled for the single mesh only
+	if (s_options.meshlets && (s_options.instanceCount > 0 || s_options.
+		occlusionCulling))
+	{
+		std::cerr << "--meshlets cannot be combined with --instances nor "
+			"--occlusion-culling" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (s_options.gpuCulling && !s_options.meshlets && s_options.
+		instanceCount == 0)
+	{
+		std::cerr << "--gpu-culling needs --instances" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (s_options.textureBenchmark && !s_options.headless)
+	{
+		std::cerr << "--texture-benchmark needs --headless" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Uncompressed images are uploaded with their whole chain
+	if (s_options.textureBudget > 0 && !isKtx2File(s_options.textureFile))
+	{
+		std::cerr << "--texture-budget needs a .ktx2 --texture" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Headless always runs a fixed number of frames
+	if (s_options.headless && s_options.benchmarkFrames == 0)
+	{
+		s_options.benchmarkFrames = DEFAULT_HEADLESS_FRAMES;
 	}
 
 	return EXIT_SUCCESS;
 }
 
-int createSemaphores()
+// Nearest-rank percentile of an ascending sorted series
+static double percentile(const std::vector<double>& sorted, double p)
 {
-	VkSemaphoreCreateInfo semaphoreInfo = {};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	semaphoreInfo.pNext = nullptr;
-	semaphoreInfo.flags = 0;
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
 
-	vk_res = vkCreateSemaphore(s_logicalDevice, &semaphoreInfo, nullptr,
-	                           &s_imageAvailableSemaphore);
-	ASSERT_VK(vk_res);
+	const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.
+		size()));
+	return sorted[std::max<size_t>(rank, 1) - 1];
+}
 
-	vk_res = vkCreateSemaphore(s_logicalDevice, &semaphoreInfo, nullptr,
-	                           &s_renderFinishedSemaphore);
-	ASSERT_VK(vk_res);
+struct StageSummary
+{
+	double p50;
+	double p90;
+	double p99;
+	double max;
+};
+
+static int writeBenchmarkResults(const std::vector<FrameTimings>& frames,
+                                 const StageSummary* summaries,
+                                 const double* statistics,
+                                 const double* cullCounters, double fps)
+{
+	std::ofstream file(s_options.benchmarkOutput, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Failed to open " << s_options.benchmarkOutput <<
+			std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const std::string& path = s_options.benchmarkOutput;
+	const bool json = path.size() >= 5 && path.compare(
+		path.size() - 5, 5, ".json") == 0;
+
+	if (json)
+	{
+		file << "{" << std::endl
+			<< "  \"headless\": " << (s_options.headless ? "true" : "false")
+			<< "," << std::endl
+			<< "  \"width\": " << s_swapChainExtent.width << "," << std::endl
+			<< "  \"height\": " << s_swapChainExtent.height << "," << std::endl
+			<< "  \"frames_in_flight\": " << s_options.framesInFlight << ","
+			<< std::endl
+			<< "  \"warmup_frames\": " << s_options.warmupFrames << ","
+			<< std::endl
+			<< "  \"frames\": " << frames.size() << "," << std::endl
+			<< "  \"fps\": " << fps << "," << std::endl
+			<< "  \"stages_ms\": {" << std::endl;
+
+		for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+		{
+			const StageSummary& summary = summaries[stage];
+			file << "    \"" << FRAME_STAGE_NAMES[stage] << "\": {\"p50\": " <<
+				summary.p50 << ", \"p90\": " << summary.p90 << ", \"p99\": "
+				<< summary.p99 << ", \"max\": " << summary.max << "}" <<
+				(stage + 1 < FRAME_STAGE_COUNT ? "," : "") << std::endl;
+		}
+
+		file << "  }," << std::endl
+			<< "  \"pipeline_statistics_mean\": {" << std::endl;
+
+		for (int i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+		{
+			file << "    \"" << PIPELINE_STATISTIC_NAMES[i] << "\": " <<
+				statistics[i] << (i + 1 < PIPELINE_STATISTIC_COUNT ? "," : "")
+				<< std::endl;
+		}
+
+		file << "  }," << std::endl
+			<< "  \"culling_mean\": {" << std::endl;
+
+		for (int i = 0; i < CULL_COUNTER_COUNT; i++)
+		{
+			file << "    \"" << CULL_COUNTER_NAMES[i] << "\": " <<
+				cullCounters[i] << (i + 1 < CULL_COUNTER_COUNT ? "," : "") <<
+				std::endl;
+		}
+
+		file << "  }" << std::endl << "}" << std::endl;
+	}
+	else
+	{
+		file << "frame";
+		for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+		{
+			file << "," << FRAME_STAGE_NAMES[stage] << "_ms";
+		}
+		for (int i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+		{
+			file << "," << PIPELINE_STATISTIC_NAMES[i];
+		}
+		for (int i = 0; i < CULL_COUNTER_COUNT; i++)
+		{
+			file << "," << CULL_COUNTER_NAMES[i];
+		}
+		file << std::endl;
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			file << i;
+			for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+			{
+				file << "," << frames[i].ms[stage];
+			}
+			for (int j = 0; j < PIPELINE_STATISTIC_COUNT; j++)
+			{
+				file << "," << frames[i].statistics[j];
+			}
+			for (int j = 0; j < CULL_COUNTER_COUNT; j++)
+			{
+				file << "," << frames[i].cullCounters[j];
+			}
+			file << std::endl;
+		}
+	}
 
 	return EXIT_SUCCESS;
 }
 
-int updateUniforms(uint32_t imageIndex)
+// Array of structures, the layout the scalar glm reference works on
+struct TransformAoS
 {
-	static auto startTime = std::chrono::high_resolution_clock::now();
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
 
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(
-		currentTime - startTime).count();
+// Batch SoA kernels against per-object glm composition, no Vulkan needed
+int runTransformBenchmark()
+{
+	static const size_t counts[] = {1000, 100000, 1000000};
+	// Enough repetitions for every size to compose ~20M matrices
+	const size_t objectsPerSize = 20000000;
 
-	UniformBufferObject ubo = {};
+#ifdef TRANSFORM_SIMD
+	const char* kernel = transformAvxSupported() ? "AVX" : "SSE";
+#else
+	const char* kernel = "scalar";
+#endif
+
+	std::cout << "Model matrix composition, " << kernel <<
+		" SoA kernel against glm" << std::endl;
+	std::cout << "  objects     glm ns/obj   SoA ns/obj   speedup   max error"
+		<< std::endl;
+
+	for (size_t count : counts)
+	{
+		TransformStore transforms;
+		transforms.resize(count);
+		std::vector<TransformAoS> aos(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const float angle = i * 2.3999632f;
+			const glm::vec3 axis = glm::normalize(glm::vec3(
+				std::sin(angle), std::cos(angle), 1.0f));
+			const glm::quat rotation = glm::angleAxis(angle, axis);
+			const glm::vec3 position(i % 100 * 2.0f, i / 100 % 100 * 2.0f,
+			                         i / 10000 * 2.0f);
+			const glm::vec3 scale(1.0f + i % 3, 1.0f, 0.5f + i % 2);
+
+			aos[i] = {position, rotation, scale};
+
+			transforms.positionX[i] = position.x;
+			transforms.positionY[i] = position.y;
+			transforms.positionZ[i] = position.z;
+			transforms.rotationX[i] = rotation.x;
+			transforms.rotationY[i] = rotation.y;
+			transforms.rotationZ[i] = rotation.z;
+			transforms.rotationW[i] = rotation.w;
+			transforms.scaleX[i] = scale.x;
+			transforms.scaleY[i] = scale.y;
+			transforms.scaleZ[i] = scale.z;
+		}
+
+		std::vector<InstanceData> reference(count);
+		std::vector<InstanceData> batched(count);
+		const size_t repetitions = std::max<size_t>(1, objectsPerSize / count);
+
+		TimePoint start = std::chrono::high_resolution_clock::now();
+		for (size_t r = 0; r < repetitions; r++)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				reference[i].model = glm::translate(glm::mat4(1.0f),
+				                                    aos[i].position) *
+					glm::mat4_cast(aos[i].rotation) *
+					glm::scale(glm::mat4(1.0f), aos[i].scale);
+			}
+		}
+		TimePoint end = std::chrono::high_resolution_clock::now();
+		const double glmNs = elapsedMs(start, end) * 1000000.0 / (count *
+			repetitions);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (size_t r = 0; r < repetitions; r++)
+		{
+			composeModelMatrices(transforms,
+			                     reinterpret_cast<float*>(batched.data()));
+		}
+		end = std::chrono::high_resolution_clock::now();
+		const double batchNs = elapsedMs(start, end) * 1000000.0 / (count *
+			repetitions);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				for (int row = 0; row < 4; row++)
+				{
+					maxError = std::max(maxError, std::fabs(
+						                    reference[i].model[c][row] -
+						                    batched[i].model[c][row]));
+				}
+			}
+		}
 
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
-	                        glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
-	                       glm::vec3(0.0f, 0.0f, 0.0f),
-	                       glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.proj = glm::perspective(glm::radians(45.0f),
-	                            s_swapChainExtent.width / static_cast<float>(
-		                            s_swapChainExtent.height), 0.1f, 10.0f);
+		printf("  %-10zu %11.2f %12.2f %8.2fx %11.2g\n", count, glmNs,
+		       batchNs, glmNs / batchNs, maxError);
+	}
 
-	void* data;
-	vkMapMemory(s_logicalDevice, s_uniformBuffersMemory[imageIndex], 0,
-	            sizeof ubo, 0, &data);
-	memcpy(data, &ubo, sizeof ubo);
-	vkUnmapMemory(s_logicalDevice, s_uniformBuffersMemory[imageIndex]);
 	return EXIT_SUCCESS;
 }
 
-int drawFrame()
+int runBenchmark()
 {
-	// 1 - Get image from the swapchain
-	//
-	uint32_t imageIndex;
-	vk_res = vkAcquireNextImageKHR(s_logicalDevice, s_swapChain, UINT16_MAX,
-	                               s_imageAvailableSemaphore, nullptr,
-	                               &imageIndex);
-	ASSERT_VK(vk_res);
+	int result;
 
-	// Update uniforms
-	//
-	updateUniforms(imageIndex);
+	for (uint32_t i = 0; i < s_options.warmupFrames; i++)
+	{
+		if (!s_options.headless)
+		{
+			glfwPollEvents();
+		}
 
-	// 2 - Execute Command Buffers
-	//
-	//
-	// Submit render pass
-	//
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pNext = nullptr;
+		result = drawFrame();
+		ASSERT(result);
+	}
 
-	// Wait semaphores
-	VkSemaphore waitSemaphores[] = {s_imageAvailableSemaphore};
-	VkPipelineStageFlags waitStages[] = {
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-	};
+	std::vector<FrameTimings> frames;
+	frames.reserve(s_options.benchmarkFrames);
 
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
+	const TimePoint startTime = std::chrono::high_resolution_clock::now();
 
-	// Signal semaphores
-	VkSemaphore signalSemaphores[] = {s_renderFinishedSemaphore};
+	for (uint32_t i = 0; i < s_options.benchmarkFrames; i++)
+	{
+		if (!s_options.headless)
+		{
+			glfwPollEvents();
+		}
 
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+		result = drawFrame();
+		ASSERT(result);
 
-	// Attach command buffer
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &s_commandBuffers[imageIndex];
+		frames.push_back(s_frameTimings);
+	}
 
-	vk_res = vkQueueSubmit(s_graphicsQueue, 1, &submitInfo, nullptr);
-	ASSERT_VK(vk_res);
+	vkDeviceWaitIdle(s_logicalDevice);
 
-	// 3 - Present Frame
-	//
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.pNext = nullptr;
+	const TimePoint endTime = std::chrono::high_resolution_clock::now();
+	const double seconds = elapsedMs(startTime, endTime) / 1000.0;
+	const double fps = s_options.benchmarkFrames / seconds;
 
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	std::cout << "Benchmark" << (s_options.headless ? " (headless)" : "") <<
+		": " << s_swapChainExtent.width << "x" << s_swapChainExtent.height <<
+		", " << s_options.benchmarkFrames << " frames after " <<
+		s_options.warmupFrames << " warm-up, " << s_options.framesInFlight <<
+		" in flight, " << seconds * 1000.0 / s_options.benchmarkFrames <<
+		" ms/frame, " << fps << " fps" << std::endl;
 
-	VkSwapchainKHR swapchain[] = {s_swapChain};
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapchain;
-	presentInfo.pImageIndices = &imageIndex;
-	presentInfo.pResults = nullptr;
+	StageSummary summaries[FRAME_STAGE_COUNT];
+	std::vector<double> series(frames.size());
 
-	vk_res = vkQueuePresentKHR(s_graphicsQueue, &presentInfo);
-	ASSERT_VK(vk_res);
+	std::cout << "  stage (ms)        p50       p90       p99       max" <<
+		std::endl;
 
-	vkQueueWaitIdle(s_graphicsQueue);
+	for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+	{
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			series[i] = frames[i].ms[stage];
+		}
+		std::sort(series.begin(), series.end());
 
-	return EXIT_SUCCESS;
-}
+		StageSummary& summary = summaries[stage];
+		summary.p50 = percentile(series, 50.0);
+		summary.p90 = percentile(series, 90.0);
+		summary.p99 = percentile(series, 99.0);
+		summary.max = series.empty() ? 0.0 : series.back();
 
-int loadTexture()
-{
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load("textures/texture.jpg", &texWidth, &texHeight,
-	                            &texChannels, STBI_rgb_alpha);
+		printf("  %-12s %9.3f %9.3f %9.3f %9.3f\n", FRAME_STAGE_NAMES[stage],
+		       summary.p50, summary.p90, summary.p99, summary.max);
+	}
 
-	VkDeviceSize textureSize = texWidth * texHeight * 4;
+	double statistics[PIPELINE_STATISTIC_COUNT] = {};
 
-	if (!pixels)
+	if (s_statisticsQueryPool != VK_NULL_HANDLE && !frames.empty())
 	{
-		throw std::runtime_error("Fail to load texture!");
-	}
+		std::cout << "  pipeline statistics (mean per frame)" << std::endl;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(textureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-	             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-	             stagingBufferMemory);
+		for (int i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+		{
+			for (const FrameTimings& frame : frames)
+			{
+				statistics[i] += static_cast<double>(frame.statistics[i]);
+			}
+			statistics[i] /= frames.size();
 
-	void* pData;
-	vkMapMemory(s_logicalDevice, stagingBufferMemory, 0, textureSize, 0,
-	            &pData);
-	memcpy(pData, pixels, static_cast<size_t>(textureSize));
-	vkUnmapMemory(s_logicalDevice, stagingBufferMemory);
+			printf("  %-21s %12.1f\n", PIPELINE_STATISTIC_NAMES[i],
+			       statistics[i]);
+		}
+	}
 
-	stbi_image_free(pixels);
+	double cullCounters[CULL_COUNTER_COUNT] = {};
 
-	const VkExtent2D extent =
+	if (s_options.gpuCulling && !frames.empty())
 	{
-		static_cast<uint32_t>(texWidth),
-		static_cast<uint32_t>(texHeight)
-	};
+		std::cout << (s_options.meshlets
+			              ? "  culled clusters (mean per frame)"
+			              : "  culled instances (mean per frame)") << std::endl;
 
-	createImage2D(extent, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-	              VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-	              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, s_textureImage,
-	              s_textureImageMemory);
+		for (int i = 0; i < CULL_COUNTER_COUNT; i++)
+		{
+			for (const FrameTimings& frame : frames)
+			{
+				cullCounters[i] += frame.cullCounters[i];
+			}
+			cullCounters[i] /= frames.size();
 
-	transitionImageLayout(s_textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-	                      VK_IMAGE_LAYOUT_UNDEFINED,
-	                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	transferBufferToImage(stagingBuffer, s_textureImage, extent.width,
-	                      extent.height);
-	transitionImageLayout(s_textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-	                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-	                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			printf("  %-21s %12.1f\n", CULL_COUNTER_NAMES[i],
+			       cullCounters[i]);
+		}
+	}
 
-	vkDestroyBuffer(s_logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(s_logicalDevice, stagingBufferMemory, nullptr);
+	if (!s_options.benchmarkOutput.empty())
+	{
+		result = writeBenchmarkResults(frames, summaries, statistics,
+		                               cullCounters, fps);
+		ASSERT(result);
+	}
 
 	return EXIT_SUCCESS;
 }
 
-int createTextureImageView()
-{
-	s_textureImageView = createImageView(s_textureImage,
-	                                     VK_FORMAT_R8G8B8A8_SRGB,
-	                                     VK_IMAGE_ASPECT_COLOR_BIT);
+// Texture sampling benchmark
+//
+// A compute pass samples the texture the way a distant surface would, with
+// TEXTURE_SAMPLE_MINIFICATION texels between neighbour pixels. It reads level
+// 0 first, as when the texture had no mips, then the level the hardware
+// would pick for that footprint.
 
-	return EXIT_SUCCESS;
-}
+// Keep in sync with texture_sample.comp
+const uint32_t TEXTURE_SAMPLE_GROUP_SIZE = 16;
+const uint32_t TEXTURE_SAMPLE_GRID = 1024;
+const uint32_t TEXTURE_SAMPLE_COUNT = 64;
+const float TEXTURE_SAMPLE_MINIFICATION = 8.0f;
 
-int setupVulkan(HINSTANCE hInstance, HWND hwnd)
+struct TextureSampleConstants
 {
-	s_hInfos.hInstance = hInstance;
-	s_hInfos.hWnd = hwnd;
+	float uvStep[2];
+	float lod;
+	uint32_t sampleCount;
+};
 
-	initAppExtensions();
-	initDeviceExtension();
+int runTextureBenchmark()
+{
+	if (s_timestampValidBits == 0)
+	{
+		std::cout << "Texture sampling benchmark skipped, no GPU timestamps"
+			<< std::endl;
+		return EXIT_SUCCESS;
+	}
 
-	int result = initInstance();
-	ASSERT(result);
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.pNext = nullptr;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(s_textureMipLevels);
+
+	VkSampler sampler;
+	vk_res = vkCreateSampler(s_logicalDevice, &samplerInfo, nullptr, &sampler);
+	ASSERT_VK(vk_res);
 
-	result = setupCallbacks();
-	ASSERT(result);
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-	result = initSurface();
-	ASSERT(result);
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
 
-	result = initLogicalDevice();
-	ASSERT(result);
+	VkDescriptorSetLayout descriptorLayout;
+	vk_res = vkCreateDescriptorSetLayout(s_logicalDevice, &layoutInfo, nullptr,
+	                                     &descriptorLayout);
+	ASSERT_VK(vk_res);
 
-	result = createSwapChain();
-	ASSERT(result);
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(TextureSampleConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkPipelineLayout pipelineLayout;
+	vk_res = vkCreatePipelineLayout(s_logicalDevice, &pipelineLayoutInfo,
+	                                nullptr, &pipelineLayout);
+	ASSERT_VK(vk_res);
 
-	result = createRenderPass();
-	ASSERT(result);
+	const AssetData compShaderCode = loadAsset("shaders/texture_sample.spv");
+	auto shaderModuleComp = createShaderModule(compShaderCode);
 
-	result = createDescriptorSetLayout();
-	ASSERT(result);
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModuleComp;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.basePipelineHandle = nullptr;
+	pipelineInfo.basePipelineIndex = -1;
 
-	result = createGraphicsPipeline();
-	ASSERT(result);
+	VkPipeline pipeline;
+	vk_res = vkCreateComputePipelines(s_logicalDevice, s_pipelineCache, 1,
+	                                  &pipelineInfo, nullptr, &pipeline);
+	ASSERT_VK(vk_res);
 
-	result = createDepthResources();
-	ASSERT(result);
+	vkDestroyShaderModule(s_logicalDevice, shaderModuleComp, nullptr);
 
-	result = createFrameBuffers();
+	// Written only if the shader is miscompiled, never read back
+	VkBuffer outputBuffer;
+	MemoryAllocation outputMemory;
+	int result = createBuffer(sizeof(float) * 4,
+	                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outputBuffer,
+	                          outputMemory);
 	ASSERT(result);
 
-	result = createCommandPools();
-	ASSERT(result);
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = 1;
 
-	result = loadTexture();
-	ASSERT(result);
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = 1;
 
-	result = createTextureImageView();
-	ASSERT(result);
+	VkDescriptorPool descriptorPool;
+	vk_res = vkCreateDescriptorPool(s_logicalDevice, &poolInfo, nullptr,
+	                                &descriptorPool);
+	ASSERT_VK(vk_res);
 
-	result = createVertexAndIndexBuffers();
-	ASSERT(result);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.pNext = nullptr;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &descriptorLayout;
 
-	result = createUniformBuffers();
-	ASSERT(result);
+	VkDescriptorSet descriptorSet;
+	vk_res = vkAllocateDescriptorSets(s_logicalDevice, &allocInfo,
+	                                  &descriptorSet);
+	ASSERT_VK(vk_res);
 
-	result = createDescriptorPool();
-	ASSERT(result);
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = s_textureImageView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	result = createDescriptorSet();
-	ASSERT(result);
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = outputBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
 
-	result = createCommandBuffers();
-	ASSERT(result);
+	std::array<VkWriteDescriptorSet, 2> writes = {};
+	for (uint32_t binding = 0; binding < writes.size(); binding++)
+	{
+		writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[binding].pNext = nullptr;
+		writes[binding].dstSet = descriptorSet;
+		writes[binding].dstBinding = binding;
+		writes[binding].dstArrayElement = 0;
+		writes[binding].descriptorCount = 1;
+		writes[binding].descriptorType = bindings[binding].descriptorType;
+	}
+	writes[0].pImageInfo = &imageInfo;
+	writes[1].pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(s_logicalDevice,
+	                       static_cast<uint32_t>(writes.size()), writes.data(),
+	                       0, nullptr);
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext = nullptr;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 4;
+
+	VkQueryPool queryPool;
+	vk_res = vkCreateQueryPool(s_logicalDevice, &queryPoolInfo, nullptr,
+	                           &queryPool);
+	ASSERT_VK(vk_res);
 
-	result = createSemaphores();
-	ASSERT(result);
+	VkCommandBufferAllocateInfo commandBufferInfo = {};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferInfo.pNext = nullptr;
+	commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferInfo.commandBufferCount = 1;
+	commandBufferInfo.commandPool = s_commandPool;
 
-	return EXIT_SUCCESS;
-}
+	VkCommandBuffer commandBuffer;
+	vk_res = vkAllocateCommandBuffers(s_logicalDevice, &commandBufferInfo,
+	                                  &commandBuffer);
+	ASSERT_VK(vk_res);
 
-void cleanUpSwapChain()
-{
-	vkDeviceWaitIdle(s_logicalDevice);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pNext = nullptr;
 
-	for (auto frameBuffer : s_swapChainBuffers)
-	{
-		vkDestroyFramebuffer(s_logicalDevice, frameBuffer, nullptr);
-	}
+	vk_res = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	ASSERT_VK(vk_res);
 
-	vkFreeCommandBuffers(s_logicalDevice, s_commandPool,
-	                     s_commandBuffers.size(), s_commandBuffers.data());
-	vkDestroyPipeline(s_logicalDevice, s_graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(s_logicalDevice, s_pipelineLayout, nullptr);
-	vkDestroyRenderPass(s_logicalDevice, s_renderPass, nullptr);
+	vkCmdResetQueryPool(commandBuffer, queryPool, 0, 4);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+	                        pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
-	for (auto imageView : s_swapChainImagesViews)
+	// Level 0, then the level whose texels are about as far apart as the
+	// pixels
+	const float lods[2] = {0.0f, std::log2(TEXTURE_SAMPLE_MINIFICATION)};
+
+	for (uint32_t pass = 0; pass < 2; pass++)
 	{
-		vkDestroyImageView(s_logicalDevice, imageView, nullptr);
+		TextureSampleConstants constants = {};
+		constants.uvStep[0] = TEXTURE_SAMPLE_MINIFICATION / s_textureExtent.
+			width;
+		constants.uvStep[1] = TEXTURE_SAMPLE_MINIFICATION / s_textureExtent.
+			height;
+		constants.lod = lods[pass];
+		constants.sampleCount = TEXTURE_SAMPLE_COUNT;
+
+		vkCmdPushConstants(commandBuffer, pipelineLayout,
+		                   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof constants,
+		                   &constants);
+
+		// The second pass starts once the first one is done
+		vkCmdPipelineBarrier(commandBuffer,
+		                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+		                     nullptr, 0, nullptr, 0, nullptr);
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		                    queryPool, pass * 2);
+		vkCmdDispatch(commandBuffer,
+		              TEXTURE_SAMPLE_GRID / TEXTURE_SAMPLE_GROUP_SIZE,
+		              TEXTURE_SAMPLE_GRID / TEXTURE_SAMPLE_GROUP_SIZE, 1);
+		vkCmdWriteTimestamp(commandBuffer,
+		                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+		                    pass * 2 + 1);
 	}
 
-	vkDestroySwapchainKHR(s_logicalDevice, s_swapChain, nullptr);
+	vk_res = vkEndCommandBuffer(commandBuffer);
+	ASSERT_VK(vk_res);
 
-	vkDestroyImage(s_logicalDevice, s_depthImage, nullptr);
-	vkDestroyImageView(s_logicalDevice, s_depthImageView, nullptr);
-	vkFreeMemory(s_logicalDevice, s_depthImageMemory, nullptr);
-}
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
 
-int recreateSwapChain()
-{
-	vkDeviceWaitIdle(s_logicalDevice);
+	vk_res = vkQueueSubmit(s_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	ASSERT_VK(vk_res);
 
-	cleanUpSwapChain();
-	createSwapChain();
-	createDepthResources();
-	createRenderPass();
-	createGraphicsPipeline();
-	createFrameBuffers();
-	createCommandBuffers();
+	vk_res = vkQueueWaitIdle(s_graphicsQueue);
+	ASSERT_VK(vk_res);
+
+	uint64_t timestamps[4];
+	vk_res = vkGetQueryPoolResults(s_logicalDevice, queryPool, 0, 4,
+	                               sizeof timestamps, timestamps,
+	                               sizeof(uint64_t),
+	                               VK_QUERY_RESULT_64_BIT |
+	                               VK_QUERY_RESULT_WAIT_BIT);
+	ASSERT_VK(vk_res);
+
+	const double samples = static_cast<double>(TEXTURE_SAMPLE_GRID) *
+		TEXTURE_SAMPLE_GRID * TEXTURE_SAMPLE_COUNT;
+
+	std::cout << "Texture sampling: " << s_textureExtent.width << "x" <<
+		s_textureExtent.height << ", " << s_textureMipLevels <<
+		" mip levels, " << TEXTURE_SAMPLE_MINIFICATION <<
+		"x minified, " << samples / 1000000.0 << " M samples" << std::endl;
+
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		const double ms = timestampDeltaMs(timestamps[pass * 2],
+		                                   timestamps[pass * 2 + 1]);
+
+		printf("  %-21s %9.3f ms %9.2f Gsamples/s\n",
+		       pass == 0 ? "level 0 only" : "mip chain", ms,
+		       samples / (ms * 1000000.0));
+	}
+
+	vkFreeCommandBuffers(s_logicalDevice, s_commandPool, 1, &commandBuffer);
+	vkDestroyQueryPool(s_logicalDevice, queryPool, nullptr);
+	vkDestroyDescriptorPool(s_logicalDevice, descriptorPool, nullptr);
+	vkDestroyBuffer(s_logicalDevice, outputBuffer, nullptr);
+	freeMemory(outputMemory);
+	vkDestroyPipeline(s_logicalDevice, pipeline, nullptr);
+	vkDestroyPipelineLayout(s_logicalDevice, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(s_logicalDevice, descriptorLayout, nullptr);
+	vkDestroySampler(s_logicalDevice, sampler, nullptr);
 
 	return EXIT_SUCCESS;
 }
 
-void cleanUp()
+int main(int argc, char** argv)
 {
-	cleanUpSwapChain();
-
-	vkDestroySemaphore(s_logicalDevice, s_imageAvailableSemaphore, nullptr);
-	vkDestroySemaphore(s_logicalDevice, s_renderFinishedSemaphore, nullptr);
-
-	vkDestroyDescriptorSetLayout(s_logicalDevice, s_descriptorLayout, nullptr);
-	vkDestroyBuffer(s_logicalDevice, s_vertexBuffer, nullptr);
-	vkFreeMemory(s_logicalDevice, s_vertexBufferMemory, nullptr);
-	vkDestroyBuffer(s_logicalDevice, s_indexBuffer, nullptr);
-	vkFreeMemory(s_logicalDevice, s_indexBufferMemory, nullptr);
-	vkDestroyCommandPool(s_logicalDevice, s_commandPool, nullptr);
-	vkDestroyCommandPool(s_logicalDevice, s_commandTransferPool, nullptr);
+	int result = parseArguments(argc, argv);
+	ASSERT(result);
 
-	for (auto uniformBuffer : s_uniformBuffers)
+	if (s_options.transformBenchmark)
 	{
-		vkDestroyBuffer(s_logicalDevice, uniformBuffer, nullptr);
+		return runTransformBenchmark();
 	}
 
-	for (auto uniformBufferMemory : s_uniformBuffersMemory)
+	if (s_options.headless)
 	{
-		vkFreeMemory(s_logicalDevice, uniformBufferMemory, nullptr);
-	}
+		result = setupVulkan(nullptr);
+		ASSERT(result);
 
-	vkDestroyImageView(s_logicalDevice, s_textureImageView, nullptr);
-	vkDestroyImage(s_logicalDevice, s_textureImage, nullptr);
-	vkFreeMemory(s_logicalDevice, s_textureImageMemory, nullptr);
+		result = runBenchmark();
+		ASSERT(result);
 
-	vkDestroyDescriptorPool(s_logicalDevice, s_descriptorPool, nullptr);
-	vkDestroyDevice(s_logicalDevice, nullptr);
-	vkDestroySurfaceKHR(s_instance, s_surfaceKHR, nullptr);
-	vkDestroyInstance(s_instance, nullptr);
-}
+		if (s_options.textureBenchmark)
+		{
+			result = runTextureBenchmark();
+			ASSERT(result);
+		}
 
-/// GLFW
+		cleanUp();
 
-static void frameBufferResizeCallback(GLFWwindow* window, int width, int height)
-{
-	recreateSwapChain();
-}
+		return EXIT_SUCCESS;
+	}
 
-int main()
-{
 	glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan window",
-	                                      nullptr, nullptr);
+
+	if (s_options.benchmarkFrames > 0)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	}
+
+	GLFWwindow* window = glfwCreateWindow(s_options.width, s_options.height,
+	                                      "Vulkan window", nullptr, nullptr);
 
 	glfwSetFramebufferSizeCallback(window, frameBufferResizeCallback);
 
 	uint32_t extensionCount = 0;
 	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
 
-	int result = setupVulkan(GetModuleHandle(nullptr),
-	                         glfwGetWin32Window(window));
+	result = setupVulkan(window);
 	ASSERT(result);
 
-	while (!glfwWindowShouldClose(window))
+	if (s_options.benchmarkFrames > 0)
 	{
-		glfwPollEvents();
-
-		result = drawFrame();
+		result = runBenchmark();
 		ASSERT(result);
 	}
+	else
+	{
+		while (!glfwWindowShouldClose(window))
+		{
+			glfwPollEvents();
+
+			result = drawFrame();
+			ASSERT(result);
+		}
+	}
 
 	cleanUp();
 
@@ -0,0 +1,463 @@
+/* asset_archive - packed asset archive reader and writer
+
+   One file holding every asset: a header, an index of the entries sorted by
+   name, then the payloads, each starting on a 4096 byte boundary so a mapping
+   of the file can hand them out as they are. A payload is stored as is or
+   LZ4 compressed (block format, no frame). Only depends on the standard
+   library.
+
+   Do this:
+      #define ASSET_ARCHIVE_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Layout, little endian:
+      "VCPK", version, entry count, size of the name table
+      per entry: offset, stored size, uncompressed size (3 x 64 bits),
+                 format, compression, name offset, name length (4 x 32 bits)
+      name table, the names one after the other without terminator
+      payloads
+*/
+
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define ASSET_ARCHIVE_VERSION 1
+#define ASSET_ARCHIVE_ALIGNMENT 4096
+
+// What an entry holds, told from its name by the packer
+#define ASSET_FORMAT_RAW 0
+#define ASSET_FORMAT_SPIRV 1
+#define ASSET_FORMAT_KTX2 2
+#define ASSET_FORMAT_IMAGE 3
+#define ASSET_FORMAT_MESH 4
+
+#define ASSET_COMPRESSION_NONE 0
+#define ASSET_COMPRESSION_LZ4 1
+
+struct AssetEntry
+{
+	std::string name;
+	uint64_t offset; // From the start of the archive
+	uint64_t size; // Stored
+	uint64_t uncompressedSize;
+	uint32_t format;
+	uint32_t compression;
+};
+
+// Entry to pack, payload already compressed when compression says so
+struct AssetSource
+{
+	std::string name;
+	uint32_t format;
+	uint32_t compression;
+	uint64_t uncompressedSize;
+	std::vector<uint8_t> payload;
+};
+
+// Parses the index of a whole archive of size bytes. Returns null on
+// success, otherwise why the archive cannot be used
+const char* assetReadIndex(const uint8_t* data, size_t size,
+                           std::vector<AssetEntry>& entries);
+
+// Entry of that name in an index read by assetReadIndex(), or null
+const AssetEntry* assetFind(const std::vector<AssetEntry>& entries,
+                            const std::string& name);
+
+// Whole archive, the sources are sorted by name and must have unique names
+std::vector<uint8_t> assetWriteArchive(std::vector<AssetSource> sources);
+
+// LZ4 block of size bytes, greedy matches over a 64 KiB window
+std::vector<uint8_t> lz4Compress(const uint8_t* data, size_t size);
+
+// False when the block is corrupt or does not decode to exactly dstSize
+// bytes. Never reads nor writes out of either buffer
+bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst,
+                   size_t dstSize);
+
+#endif // ASSET_ARCHIVE_H
+
+#ifdef ASSET_ARCHIVE_IMPLEMENTATION
+
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t ASSET_ARCHIVE_MAGIC[4] = {'V', 'C', 'P', 'K'};
+static const size_t ASSET_HEADER_SIZE = 16;
+static const size_t ASSET_ENTRY_SIZE = 3 * 8 + 4 * 4;
+
+static uint32_t assetRead32(const uint8_t* data)
+{
+	return static_cast<uint32_t>(data[0]) |
+		static_cast<uint32_t>(data[1]) << 8 |
+		static_cast<uint32_t>(data[2]) << 16 |
+		static_cast<uint32_t>(data[3]) << 24;
+}
+
+static uint64_t assetRead64(const uint8_t* data)
+{
+	return assetRead32(data) | static_cast<uint64_t>(assetRead32(data + 4)) <<
+		32;
+}
+
+static void assetWrite32(uint8_t* out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		out[i] = static_cast<uint8_t>(value >> i * 8);
+	}
+}
+
+static void assetWrite64(uint8_t* out, uint64_t value)
+{
+	assetWrite32(out, static_cast<uint32_t>(value));
+	assetWrite32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+const char* assetReadIndex(const uint8_t* data, size_t size,
+                           std::vector<AssetEntry>& entries)
+{
+	if (size < ASSET_HEADER_SIZE || memcmp(data, ASSET_ARCHIVE_MAGIC,
+	                                       sizeof ASSET_ARCHIVE_MAGIC) != 0)
+	{
+		return "not an asset archive";
+	}
+	if (assetRead32(data + 4) != ASSET_ARCHIVE_VERSION)
+	{
+		return "unsupported archive version";
+	}
+
+	const uint64_t entryCount = assetRead32(data + 8);
+	const uint64_t namesSize = assetRead32(data + 12);
+	const uint64_t namesOffset = ASSET_HEADER_SIZE + entryCount *
+		ASSET_ENTRY_SIZE;
+
+	if (namesOffset + namesSize > size)
+	{
+		return "truncated index";
+	}
+
+	entries.resize(static_cast<size_t>(entryCount));
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const uint8_t* entry = data + ASSET_HEADER_SIZE + i * ASSET_ENTRY_SIZE;
+		AssetEntry& out = entries[i];
+		out.offset = assetRead64(entry);
+		out.size = assetRead64(entry + 8);
+		out.uncompressedSize = assetRead64(entry + 16);
+		out.format = assetRead32(entry + 24);
+		out.compression = assetRead32(entry + 28);
+
+		const uint32_t nameOffset = assetRead32(entry + 32);
+		const uint32_t nameLength = assetRead32(entry + 36);
+		if (static_cast<uint64_t>(nameOffset) + nameLength > namesSize)
+		{
+			return "entry name past the name table";
+		}
+		out.name.assign(reinterpret_cast<const char*>(data + namesOffset +
+			                nameOffset), nameLength);
+
+		if (out.offset > size || out.size > size - out.offset)
+		{
+			return "entry data past the end of the archive";
+		}
+		if (out.offset % ASSET_ARCHIVE_ALIGNMENT != 0)
+		{
+			return "misaligned entry data";
+		}
+		if (out.compression == ASSET_COMPRESSION_NONE ? out.size != out.
+			    uncompressedSize : out.compression != ASSET_COMPRESSION_LZ4)
+		{
+			return "unsupported entry compression";
+		}
+		if (i > 0 && !(entries[i - 1].name < out.name))
+		{
+			return "entries not sorted by name";
+		}
+	}
+
+	return nullptr;
+}
+
+const AssetEntry* assetFind(const std::vector<AssetEntry>& entries,
+                            const std::string& name)
+{
+	const auto it = std::lower_bound(entries.begin(), entries.end(), name,
+	                                 [](const AssetEntry& entry,
+	                                    const std::string& value)
+	                                 {
+		                                 return entry.name < value;
+	                                 });
+
+	return it != entries.end() && it->name == name ? &*it : nullptr;
+}
+
+std::vector<uint8_t> assetWriteArchive(std::vector<AssetSource> sources)
+{
+	std::sort(sources.begin(), sources.end(),
+	          [](const AssetSource& a, const AssetSource& b)
+	          {
+		          return a.name < b.name;
+	          });
+
+	size_t namesSize = 0;
+	for (const AssetSource& source : sources)
+	{
+		namesSize += source.name.size();
+	}
+
+	const size_t indexSize = ASSET_HEADER_SIZE + sources.size() *
+		ASSET_ENTRY_SIZE + namesSize;
+
+	// Payloads one after the other, each on a boundary
+	std::vector<uint64_t> offsets(sources.size());
+	uint64_t end = indexSize;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		end = (end + ASSET_ARCHIVE_ALIGNMENT - 1) / ASSET_ARCHIVE_ALIGNMENT *
+			ASSET_ARCHIVE_ALIGNMENT;
+		offsets[i] = end;
+		end += sources[i].payload.size();
+	}
+
+	std::vector<uint8_t> out(static_cast<size_t>(end), 0);
+
+	memcpy(out.data(), ASSET_ARCHIVE_MAGIC, sizeof ASSET_ARCHIVE_MAGIC);
+	assetWrite32(&out[4], ASSET_ARCHIVE_VERSION);
+	assetWrite32(&out[8], static_cast<uint32_t>(sources.size()));
+	assetWrite32(&out[12], static_cast<uint32_t>(namesSize));
+
+	uint8_t* names = out.data() + ASSET_HEADER_SIZE + sources.size() *
+		ASSET_ENTRY_SIZE;
+	uint32_t nameOffset = 0;
+
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		const AssetSource& source = sources[i];
+		uint8_t* entry = &out[ASSET_HEADER_SIZE + i * ASSET_ENTRY_SIZE];
+
+		assetWrite64(entry, offsets[i]);
+		assetWrite64(entry + 8, source.payload.size());
+		assetWrite64(entry + 16, source.uncompressedSize);
+		assetWrite32(entry + 24, source.format);
+		assetWrite32(entry + 28, source.compression);
+		assetWrite32(entry + 32, nameOffset);
+		assetWrite32(entry + 36, static_cast<uint32_t>(source.name.size()));
+
+		memcpy(names + nameOffset, source.name.data(), source.name.size());
+		nameOffset += static_cast<uint32_t>(source.name.size());
+
+		if (!source.payload.empty())
+		{
+			memcpy(&out[static_cast<size_t>(offsets[i])], source.payload.data(),
+			       source.payload.size());
+		}
+	}
+
+	return out;
+}
+
+// The format ends a block with at least 5 literals, and the last match
+// starts at least 12 bytes before the end
+static const size_t LZ4_MIN_MATCH = 4;
+static const size_t LZ4_LAST_LITERALS = 5;
+static const size_t LZ4_MATCH_LIMIT = 12;
+static const size_t LZ4_MAX_OFFSET = 65535;
+static const int LZ4_HASH_BITS = 16;
+
+static void lz4WriteLength(std::vector<uint8_t>& out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+	{
+		out.push_back(255);
+	}
+	out.push_back(static_cast<uint8_t>(length));
+}
+
+static void lz4WriteSequence(std::vector<uint8_t>& out,
+                             const uint8_t* literals, size_t literalCount,
+                             size_t offset, size_t matchLength)
+{
+	const size_t matchCode = matchLength - LZ4_MIN_MATCH;
+	out.push_back(static_cast<uint8_t>(std::min<size_t>(literalCount, 15) <<
+		4 | (offset > 0 ? std::min<size_t>(matchCode, 15) : 0)));
+
+	if (literalCount >= 15)
+	{
+		lz4WriteLength(out, literalCount - 15);
+	}
+	out.insert(out.end(), literals, literals + literalCount);
+
+	// The last sequence has literals only
+	if (offset == 0)
+	{
+		return;
+	}
+
+	out.push_back(static_cast<uint8_t>(offset));
+	out.push_back(static_cast<uint8_t>(offset >> 8));
+
+	if (matchCode >= 15)
+	{
+		lz4WriteLength(out, matchCode - 15);
+	}
+}
+
+std::vector<uint8_t> lz4Compress(const uint8_t* data, size_t size)
+{
+	std::vector<uint8_t> out;
+	out.reserve(size + size / 255 + 16);
+
+	// Last position of each hashed 4 byte sequence, plus one
+	std::vector<uint32_t> table(size_t(1) << LZ4_HASH_BITS, 0);
+
+	size_t anchor = 0;
+	size_t i = 0;
+
+	while (i + LZ4_MATCH_LIMIT <= size)
+	{
+		uint32_t sequence;
+		memcpy(&sequence, data + i, 4);
+		const uint32_t hash = sequence * 2654435761u >> (32 - LZ4_HASH_BITS);
+
+		const size_t candidate = table[hash];
+		table[hash] = static_cast<uint32_t>(i + 1);
+
+		if (candidate == 0 || i - (candidate - 1) > LZ4_MAX_OFFSET || memcmp(
+			data + candidate - 1, &sequence, 4) != 0)
+		{
+			i++;
+			continue;
+		}
+
+		size_t match = candidate - 1;
+		size_t length = LZ4_MIN_MATCH;
+		const size_t limit = size - LZ4_LAST_LITERALS;
+
+		while (i + length < limit && data[match + length] == data[i + length])
+		{
+			length++;
+		}
+
+		// Grow back over the pending literals
+		while (i > anchor && match > 0 && data[i - 1] == data[match - 1])
+		{
+			i--;
+			match--;
+			length++;
+		}
+
+		lz4WriteSequence(out, data + anchor, i - anchor, i - match, length);
+
+		i += length;
+		anchor = i;
+	}
+
+	lz4WriteSequence(out, data + anchor, size - anchor, 0, LZ4_MIN_MATCH);
+
+	return out;
+}
+
+// Length continued over 255 bytes, false past the end of the input
+static bool lz4ReadLength(const uint8_t*& in, const uint8_t* end,
+                          size_t& length)
+{
+	uint8_t byte;
+	do
+	{
+		if (in == end)
+		{
+			return false;
+		}
+		byte = *in++;
+		length += byte;
+	}
+	while (byte == 255);
+
+	return true;
+}
+
+bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst,
+                   size_t dstSize)
+{
+	const uint8_t* in = src;
+	const uint8_t* inEnd = src + srcSize;
+	uint8_t* out = dst;
+	uint8_t* const outEnd = dst + dstSize;
+
+	while (in < inEnd)
+	{
+		const uint8_t token = *in++;
+
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !lz4ReadLength(in, inEnd, literalCount))
+		{
+			return false;
+		}
+		if (literalCount > static_cast<size_t>(inEnd - in) || literalCount >
+			static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+
+		if (literalCount > 0)
+		{
+			memcpy(out, in, literalCount);
+		}
+		in += literalCount;
+		out += literalCount;
+
+		if (in == inEnd)
+		{
+			break;
+		}
+
+		if (inEnd - in < 2)
+		{
+			return false;
+		}
+		const size_t offset = in[0] | in[1] << 8;
+		in += 2;
+
+		if (offset == 0 || offset > static_cast<size_t>(out - dst))
+		{
+			return false;
+		}
+
+		size_t length = token & 15;
+		if (length == 15 && !lz4ReadLength(in, inEnd, length))
+		{
+			return false;
+		}
+		length += LZ4_MIN_MATCH;
+
+		if (length > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+
+		// Overlapping matches repeat the last offset bytes
+		const uint8_t* match = out - offset;
+		if (offset >= length)
+		{
+			memcpy(out, match, length);
+		}
+		else
+		{
+			for (size_t k = 0; k < length; k++)
+			{
+				out[k] = match[k];
+			}
+		}
+		out += length;
+	}
+
+	return out == outEnd;
+}
+
+#endif // ASSET_ARCHIVE_IMPLEMENTATION
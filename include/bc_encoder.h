@@ -0,0 +1,534 @@
+/* bc_encoder - BC1, BC3 and BC7 block encoders
+
+   Encodes one 4x4 block of RGBA8 texels at a time, so callers can spread
+   the blocks of an image on as many threads as they like. Only depends on
+   the standard library.
+
+   Do this:
+      #define BC_ENCODER_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Endpoints are the extremes of the block along its principal axis, then
+   refitted once by least squares on the chosen indices. The encoders work
+   on the stored values, sRGB data is fitted in sRGB space.
+
+      BC1  8 bytes, RGB 5:6:5 endpoints and 4 colors, alpha is ignored
+      BC3  16 bytes, BC1 color and 8 alpha values interpolated from 2
+      BC7  16 bytes, mode 6 only: one RGBA 7.7.7.7 + p-bit endpoint pair and
+           16 values, good for both opaque and alpha blocks
+*/
+
+#ifndef BC_ENCODER_H
+#define BC_ENCODER_H
+
+#include <cstdint>
+
+// rgba holds the 16 texels of the block row by row
+void encodeBC1Block(const uint8_t* rgba, uint8_t* block);
+void encodeBC3Block(const uint8_t* rgba, uint8_t* block);
+void encodeBC7Block(const uint8_t* rgba, uint8_t* block);
+
+#endif // BC_ENCODER_H
+
+#ifdef BC_ENCODER_IMPLEMENTATION
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// Mean and principal axis of the first channels of the texels. The axis is
+// zero when every texel is the same
+static void bcPrincipalAxis(const uint8_t* rgba, int channels, float* mean,
+                            float* axis)
+{
+	float low[4] = {255.0f, 255.0f, 255.0f, 255.0f};
+	float high[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+	for (int c = 0; c < channels; c++)
+	{
+		mean[c] = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			const float value = rgba[i * 4 + c];
+			mean[c] += value;
+			low[c] = std::min(low[c], value);
+			high[c] = std::max(high[c], value);
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < channels; a++)
+		{
+			const float da = rgba[i * 4 + a] - mean[a];
+			for (int b = 0; b < channels; b++)
+			{
+				covariance[a][b] += da * (rgba[i * 4 + b] - mean[b]);
+			}
+		}
+	}
+
+	// Power iteration from the bounding box diagonal
+	for (int c = 0; c < channels; c++)
+	{
+		axis[c] = high[c] - low[c];
+	}
+
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++)
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length = std::max(length, std::fabs(next[a]));
+		}
+
+		if (length == 0.0f)
+		{
+			break;
+		}
+
+		for (int c = 0; c < channels; c++)
+		{
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channels; c++)
+	{
+		length += axis[c] * axis[c];
+	}
+	length = std::sqrt(length);
+
+	for (int c = 0; c < channels; c++)
+	{
+		axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+	}
+}
+
+// Block extremes along the axis, first the one with the largest projection
+static void bcAxisEndpoints(const uint8_t* rgba, int channels,
+                            const float* mean, const float* axis,
+                            float* endpoint0, float* endpoint1)
+{
+	float low = 0.0f;
+	float high = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++)
+		{
+			t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+		}
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+
+	for (int c = 0; c < channels; c++)
+	{
+		endpoint0[c] = std::min(std::max(mean[c] + axis[c] * high, 0.0f),
+		                        255.0f);
+		endpoint1[c] = std::min(std::max(mean[c] + axis[c] * low, 0.0f),
+		                        255.0f);
+	}
+}
+
+// Least squares endpoints given the weight of endpoint 0 in each texel.
+// Returns false when the weights cannot separate them
+static bool bcRefitEndpoints(const uint8_t* rgba, int channels,
+                             const float* weights, float* endpoint0,
+                             float* endpoint1)
+{
+	float aa = 0.0f;
+	float ab = 0.0f;
+	float bb = 0.0f;
+	float ax[4] = {};
+	float bx[4] = {};
+
+	for (int i = 0; i < 16; i++)
+	{
+		const float a = weights[i];
+		const float b = 1.0f - a;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < channels; c++)
+		{
+			ax[c] += a * rgba[i * 4 + c];
+			bx[c] += b * rgba[i * 4 + c];
+		}
+	}
+
+	const float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+
+	for (int c = 0; c < channels; c++)
+	{
+		endpoint0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) /
+		                                 determinant, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) /
+		                                 determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+// BC1 color block
+//
+
+static uint16_t bcPack565(const float* color)
+{
+	const int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+	const int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+	const int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static void bcUnpack565(uint16_t packed, int* color)
+{
+	const int r = packed >> 11;
+	const int g = packed >> 5 & 63;
+	const int b = packed & 31;
+	color[0] = r << 3 | r >> 2;
+	color[1] = g << 2 | g >> 4;
+	color[2] = b << 3 | b >> 2;
+}
+
+// 2-bit indices of the 4 color palette, returns the squared error
+static uint32_t bcColorIndices(const uint8_t* rgba, uint16_t color0,
+                               uint16_t color1, uint32_t& indices)
+{
+	int palette[4][3];
+	bcUnpack565(color0, palette[0]);
+	bcUnpack565(color1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	// Equal endpoints select the 3 color mode, only its first color is safe
+	const int paletteSize = color0 == color1 ? 1 : 4;
+
+	indices = 0;
+	uint32_t error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		uint32_t best = UINT32_MAX;
+		uint32_t bestIndex = 0;
+		for (int p = 0; p < paletteSize; p++)
+		{
+			uint32_t distance = 0;
+			for (int c = 0; c < 3; c++)
+			{
+				const int d = rgba[i * 4 + c] - palette[p][c];
+				distance += d * d;
+			}
+			if (distance < best)
+			{
+				best = distance;
+				bestIndex = p;
+			}
+		}
+		indices |= bestIndex << i * 2;
+		error += best;
+	}
+	return error;
+}
+
+// Endpoints packed in the order of the 4 color mode
+static uint32_t bcColorBlock(const uint8_t* rgba, const float* endpoint0,
+                             const float* endpoint1, uint16_t& color0,
+                             uint16_t& color1, uint32_t& indices)
+{
+	color0 = bcPack565(endpoint0);
+	color1 = bcPack565(endpoint1);
+	if (color0 < color1)
+	{
+		std::swap(color0, color1);
+	}
+	return bcColorIndices(rgba, color0, color1, indices);
+}
+
+static void bcWrite16(uint8_t* out, uint32_t value)
+{
+	out[0] = static_cast<uint8_t>(value);
+	out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void bcWrite32(uint8_t* out, uint32_t value)
+{
+	bcWrite16(out, value);
+	bcWrite16(out + 2, value >> 16);
+}
+
+void encodeBC1Block(const uint8_t* rgba, uint8_t* block)
+{
+	float mean[3];
+	float axis[3];
+	bcPrincipalAxis(rgba, 3, mean, axis);
+
+	float endpoint0[3];
+	float endpoint1[3];
+	bcAxisEndpoints(rgba, 3, mean, axis, endpoint0, endpoint1);
+
+	// Inset by a 16th of the range on each side, the extremes are often
+	// outliers
+	for (int c = 0; c < 3; c++)
+	{
+		const float inset = (endpoint0[c] - endpoint1[c]) / 16.0f;
+		endpoint0[c] -= inset;
+		endpoint1[c] += inset;
+	}
+
+	uint16_t color0;
+	uint16_t color1;
+	uint32_t indices;
+	uint32_t error = bcColorBlock(rgba, endpoint0, endpoint1, color0, color1,
+	                              indices);
+
+	// Weight of color 0 for each palette entry
+	static const float PALETTE_WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f,
+		1.0f / 3.0f};
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+	{
+		weights[i] = PALETTE_WEIGHTS[indices >> i * 2 & 3];
+	}
+
+	if (error > 0 && bcRefitEndpoints(rgba, 3, weights, endpoint0, endpoint1))
+	{
+		uint16_t refit0;
+		uint16_t refit1;
+		uint32_t refitIndices;
+		const uint32_t refitError = bcColorBlock(
+			rgba, endpoint0, endpoint1, refit0, refit1, refitIndices);
+		if (refitError < error)
+		{
+			color0 = refit0;
+			color1 = refit1;
+			indices = refitIndices;
+		}
+	}
+
+	bcWrite16(block, color0);
+	bcWrite16(block + 2, color1);
+	bcWrite32(block + 4, indices);
+}
+
+// BC3 alpha block
+//
+
+void encodeBC3Block(const uint8_t* rgba, uint8_t* block)
+{
+	int alpha0 = 0;
+	int alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		alpha0 = std::max<int>(alpha0, rgba[i * 4 + 3]);
+		alpha1 = std::min<int>(alpha1, rgba[i * 4 + 3]);
+	}
+
+	// alpha0 > alpha1 selects 6 interpolated values, equal ones need none
+	int palette[8] = {alpha0, alpha1};
+	for (int k = 1; k < 7; k++)
+	{
+		palette[k + 1] = ((7 - k) * alpha0 + k * alpha1) / 7;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16 && alpha0 != alpha1; i++)
+	{
+		int best = 256;
+		uint64_t bestIndex = 0;
+		for (int p = 0; p < 8; p++)
+		{
+			const int distance = std::abs(rgba[i * 4 + 3] - palette[p]);
+			if (distance < best)
+			{
+				best = distance;
+				bestIndex = p;
+			}
+		}
+		indices |= bestIndex << i * 3;
+	}
+
+	block[0] = static_cast<uint8_t>(alpha0);
+	block[1] = static_cast<uint8_t>(alpha1);
+	for (int i = 0; i < 6; i++)
+	{
+		block[2 + i] = static_cast<uint8_t>(indices >> i * 8);
+	}
+
+	encodeBC1Block(rgba, block + 8);
+}
+
+// BC7 mode 6 block
+//
+
+static const int BC7_WEIGHTS[16] = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+// 7-bit endpoint with the p-bit closest to the color
+static void bcQuantizeBC7(const float* endpoint, int* quantized, int& pBit)
+{
+	float bestError = 0.0f;
+	for (int p = 0; p < 2; p++)
+	{
+		int values[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			values[c] = std::min(std::max(static_cast<int>(std::floor(
+				                              (endpoint[c] - p) / 2.0f + 0.5f)),
+			                              0), 127);
+			const float d = (values[c] << 1 | p) - endpoint[c];
+			error += d * d;
+		}
+
+		if (p == 0 || error < bestError)
+		{
+			bestError = error;
+			pBit = p;
+			std::copy(values, values + 4, quantized);
+		}
+	}
+}
+
+// 4-bit indices of the 16 value palette, returns the squared error
+static uint32_t bcBC7Indices(const uint8_t* rgba, const int* quantized0,
+                             int pBit0, const int* quantized1, int pBit1,
+                             uint8_t* indices)
+{
+	int palette[16][4];
+	for (int c = 0; c < 4; c++)
+	{
+		const int value0 = quantized0[c] << 1 | pBit0;
+		const int value1 = quantized1[c] << 1 | pBit1;
+		for (int k = 0; k < 16; k++)
+		{
+			palette[k][c] = ((64 - BC7_WEIGHTS[k]) * value0 + BC7_WEIGHTS[k] *
+				value1 + 32) >> 6;
+		}
+	}
+
+	uint32_t error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		uint32_t best = UINT32_MAX;
+		for (int k = 0; k < 16; k++)
+		{
+			uint32_t distance = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				const int d = rgba[i * 4 + c] - palette[k][c];
+				distance += d * d;
+			}
+			if (distance < best)
+			{
+				best = distance;
+				indices[i] = static_cast<uint8_t>(k);
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+struct BC7Candidate
+{
+	int quantized[2][4];
+	int pBits[2];
+	uint8_t indices[16];
+	uint32_t error;
+};
+
+static void bcBC7Candidate(const uint8_t* rgba, const float* endpoint0,
+                           const float* endpoint1, BC7Candidate& candidate)
+{
+	bcQuantizeBC7(endpoint0, candidate.quantized[0], candidate.pBits[0]);
+	bcQuantizeBC7(endpoint1, candidate.quantized[1], candidate.pBits[1]);
+	candidate.error = bcBC7Indices(rgba, candidate.quantized[0],
+	                               candidate.pBits[0], candidate.quantized[1],
+	                               candidate.pBits[1], candidate.indices);
+}
+
+static void bcWriteBits(uint8_t* block, int& position, uint32_t value,
+                        int count)
+{
+	for (int i = 0; i < count; i++, position++)
+	{
+		block[position >> 3] |= static_cast<uint8_t>((value >> i & 1) <<
+			(position & 7));
+	}
+}
+
+void encodeBC7Block(const uint8_t* rgba, uint8_t* block)
+{
+	float mean[4];
+	float axis[4];
+	bcPrincipalAxis(rgba, 4, mean, axis);
+
+	float endpoint0[4];
+	float endpoint1[4];
+	bcAxisEndpoints(rgba, 4, mean, axis, endpoint0, endpoint1);
+
+	BC7Candidate best;
+	bcBC7Candidate(rgba, endpoint0, endpoint1, best);
+
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+	{
+		weights[i] = 1.0f - BC7_WEIGHTS[best.indices[i]] / 64.0f;
+	}
+
+	if (best.error > 0 && bcRefitEndpoints(rgba, 4, weights, endpoint0,
+	                                       endpoint1))
+	{
+		BC7Candidate refit;
+		bcBC7Candidate(rgba, endpoint0, endpoint1, refit);
+		if (refit.error < best.error)
+		{
+			best = refit;
+		}
+	}
+
+	// The first index is stored without its high bit, which must be 0
+	if (best.indices[0] >= 8)
+	{
+		std::swap(best.quantized[0], best.quantized[1]);
+		std::swap(best.pBits[0], best.pBits[1]);
+		for (int i = 0; i < 16; i++)
+		{
+			best.indices[i] = static_cast<uint8_t>(15 - best.indices[i]);
+		}
+	}
+
+	std::fill(block, block + 16, 0);
+	int position = 0;
+	bcWriteBits(block, position, 1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		bcWriteBits(block, position, best.quantized[0][c], 7);
+		bcWriteBits(block, position, best.quantized[1][c], 7);
+	}
+	bcWriteBits(block, position, best.pBits[0], 1);
+	bcWriteBits(block, position, best.pBits[1], 1);
+	for (int i = 0; i < 16; i++)
+	{
+		bcWriteBits(block, position, best.indices[i], i == 0 ? 3 : 4);
+	}
+}
+
+#endif // BC_ENCODER_IMPLEMENTATION
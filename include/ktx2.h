@@ -0,0 +1,353 @@
+/* ktx2 - minimal KTX2 container reader and writer
+
+   Reads the header and level index of a KTX 2.0 file, and writes 2D images
+   of block compressed BC1, BC3 and BC7 levels with their data format
+   descriptor. Only depends on the standard library.
+
+   Do this:
+      #define KTX2_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Not supported: supercompression (Basis, zstd, zlib), arrays, cube maps,
+   3D textures and files whose mips are left to the loader (levelCount 0).
+   Key/value data is neither read nor written.
+
+   The level data is stored from the smallest level to level 0 as the
+   specification requires, each level aligned to its block size.
+*/
+
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// VkFormat values, the container stores Vulkan formats
+#define KTX2_FORMAT_BC1_RGB_UNORM 131
+#define KTX2_FORMAT_BC1_RGB_SRGB 132
+#define KTX2_FORMAT_BC3_UNORM 137
+#define KTX2_FORMAT_BC3_SRGB 138
+#define KTX2_FORMAT_BC7_UNORM 145
+#define KTX2_FORMAT_BC7_SRGB 146
+
+struct Ktx2Header
+{
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+// Where a level is in the file, level 0 first
+struct Ktx2Level
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+struct Ktx2File
+{
+	Ktx2Header header;
+	std::vector<Ktx2Level> levels;
+};
+
+// Bytes of the header and level index of a file with levelCount levels
+size_t ktx2IndexSize(uint32_t levelCount);
+
+// Parses the first size bytes of a file of fileSize bytes, which must hold
+// at least ktx2IndexSize(1) bytes and then the whole level index. Returns
+// null on success, otherwise why the file cannot be used
+const char* ktx2ReadIndex(const uint8_t* data, size_t size, size_t fileSize,
+                          Ktx2File& file);
+
+// Block size in bytes of the formats above, 0 for any other
+uint32_t ktx2BlockSize(uint32_t vkFormat);
+
+// Whole file of a 2D image given its levels, level 0 first, each made of
+// 4x4 blocks of one of the formats above
+std::vector<uint8_t> ktx2Write(uint32_t vkFormat, uint32_t width,
+                               uint32_t height,
+                               const std::vector<std::vector<uint8_t>>&
+                               levels);
+
+#endif // KTX2_H
+
+#ifdef KTX2_IMPLEMENTATION
+
+#include <cstring>
+
+static const uint8_t KTX2_IDENTIFIER[12] = {
+	0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+// Identifier, 9 header words, the 4 words and 2 quadwords of the index
+static const size_t KTX2_HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+static const size_t KTX2_LEVEL_SIZE = 3 * 8;
+
+size_t ktx2IndexSize(uint32_t levelCount)
+{
+	return KTX2_HEADER_SIZE + static_cast<size_t>(levelCount) *
+		KTX2_LEVEL_SIZE;
+}
+
+static uint32_t ktx2Read32(const uint8_t* data)
+{
+	return static_cast<uint32_t>(data[0]) |
+		static_cast<uint32_t>(data[1]) << 8 |
+		static_cast<uint32_t>(data[2]) << 16 |
+		static_cast<uint32_t>(data[3]) << 24;
+}
+
+static uint64_t ktx2Read64(const uint8_t* data)
+{
+	return ktx2Read32(data) | static_cast<uint64_t>(ktx2Read32(data + 4)) <<
+		32;
+}
+
+const char* ktx2ReadIndex(const uint8_t* data, size_t size, size_t fileSize,
+                          Ktx2File& file)
+{
+	if (size < KTX2_HEADER_SIZE || memcmp(data, KTX2_IDENTIFIER,
+	                                      sizeof KTX2_IDENTIFIER) != 0)
+	{
+		return "not a KTX2 file";
+	}
+
+	uint32_t words[13];
+	for (int i = 0; i < 13; i++)
+	{
+		words[i] = ktx2Read32(data + 12 + i * 4);
+	}
+
+	Ktx2Header& header = file.header;
+	header.vkFormat = words[0];
+	header.typeSize = words[1];
+	header.pixelWidth = words[2];
+	header.pixelHeight = words[3];
+	header.pixelDepth = words[4];
+	header.layerCount = words[5];
+	header.faceCount = words[6];
+	header.levelCount = words[7];
+	header.supercompressionScheme = words[8];
+	header.dfdByteOffset = words[9];
+	header.dfdByteLength = words[10];
+	header.kvdByteOffset = words[11];
+	header.kvdByteLength = words[12];
+	header.sgdByteOffset = ktx2Read64(data + 64);
+	header.sgdByteLength = ktx2Read64(data + 72);
+
+	if (header.pixelWidth == 0 || header.pixelHeight == 0 ||
+		header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount !=
+		1)
+	{
+		return "only 2D images are supported";
+	}
+	if (header.levelCount == 0)
+	{
+		return "the file has no mip levels";
+	}
+	if (header.supercompressionScheme != 0)
+	{
+		return "supercompressed files are not supported";
+	}
+	if (size < ktx2IndexSize(header.levelCount))
+	{
+		return "truncated level index";
+	}
+
+	file.levels.resize(header.levelCount);
+	for (uint32_t level = 0; level < header.levelCount; level++)
+	{
+		const uint8_t* entry = data + KTX2_HEADER_SIZE + level *
+			KTX2_LEVEL_SIZE;
+		Ktx2Level& out = file.levels[level];
+		out.byteOffset = ktx2Read64(entry);
+		out.byteLength = ktx2Read64(entry + 8);
+		out.uncompressedByteLength = ktx2Read64(entry + 16);
+
+		if (out.byteOffset > fileSize || out.byteLength > fileSize - out.
+			byteOffset)
+		{
+			return "level data past the end of the file";
+		}
+	}
+
+	return nullptr;
+}
+
+uint32_t ktx2BlockSize(uint32_t vkFormat)
+{
+	switch (vkFormat)
+	{
+	case KTX2_FORMAT_BC1_RGB_UNORM:
+	case KTX2_FORMAT_BC1_RGB_SRGB:
+		return 8;
+	case KTX2_FORMAT_BC3_UNORM:
+	case KTX2_FORMAT_BC3_SRGB:
+	case KTX2_FORMAT_BC7_UNORM:
+	case KTX2_FORMAT_BC7_SRGB:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+static void ktx2Write32(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		out.push_back(static_cast<uint8_t>(value >> i * 8));
+	}
+}
+
+static void ktx2Write64(std::vector<uint8_t>& out, uint64_t value)
+{
+	ktx2Write32(out, static_cast<uint32_t>(value));
+	ktx2Write32(out, static_cast<uint32_t>(value >> 32));
+}
+
+// Basic data format descriptor block of a 4x4 block compressed format
+static std::vector<uint8_t> ktx2BlockDescriptor(uint32_t vkFormat)
+{
+	// Khronos data format: color models and channels of the BC formats
+	const uint32_t MODEL_BC1A = 128;
+	const uint32_t MODEL_BC3 = 130;
+	const uint32_t MODEL_BC7 = 134;
+	const uint32_t CHANNEL_COLOR = 0;
+	const uint32_t CHANNEL_BC3_ALPHA = 15;
+
+	const bool srgb = vkFormat == KTX2_FORMAT_BC1_RGB_SRGB ||
+		vkFormat == KTX2_FORMAT_BC3_SRGB || vkFormat == KTX2_FORMAT_BC7_SRGB;
+	const uint32_t blockSize = ktx2BlockSize(vkFormat);
+
+	uint32_t model = MODEL_BC1A;
+	if (vkFormat == KTX2_FORMAT_BC3_UNORM || vkFormat == KTX2_FORMAT_BC3_SRGB)
+	{
+		model = MODEL_BC3;
+	}
+	else if (blockSize == 16)
+	{
+		model = MODEL_BC7;
+	}
+
+	// Bit offset, bit length - 1 and channel of each sample
+	struct Sample
+	{
+		uint32_t offset;
+		uint32_t length;
+		uint32_t channel;
+	};
+	std::vector<Sample> samples;
+	if (model == MODEL_BC3)
+	{
+		samples.push_back({0, 63, CHANNEL_BC3_ALPHA});
+		samples.push_back({64, 63, CHANNEL_COLOR});
+	}
+	else
+	{
+		samples.push_back({0, blockSize * 8 - 1, CHANNEL_COLOR});
+	}
+
+	const uint32_t descriptorSize = 24 + 16 * static_cast<uint32_t>(samples.
+		size());
+
+	std::vector<uint8_t> out;
+	ktx2Write32(out, 4 + descriptorSize);
+	// Khronos vendor, basic descriptor type
+	ktx2Write32(out, 0);
+	// Version 1.3 of the format
+	ktx2Write32(out, 2 | descriptorSize << 16);
+	// BT.709 primaries, sRGB or linear transfer, straight alpha
+	ktx2Write32(out, model | 1 << 8 | (srgb ? 2 : 1) << 16);
+	// 4x4 texels per block
+	ktx2Write32(out, 3 | 3 << 8);
+	ktx2Write32(out, blockSize);
+	ktx2Write32(out, 0);
+
+	for (const Sample& sample : samples)
+	{
+		ktx2Write32(out, sample.offset | sample.length << 16 | sample.channel <<
+		            24);
+		ktx2Write32(out, 0);
+		ktx2Write32(out, 0);
+		ktx2Write32(out, UINT32_MAX);
+	}
+
+	return out;
+}
+
+std::vector<uint8_t> ktx2Write(uint32_t vkFormat, uint32_t width,
+                               uint32_t height,
+                               const std::vector<std::vector<uint8_t>>& levels)
+{
+	const uint32_t levelCount = static_cast<uint32_t>(levels.size());
+	const uint32_t blockSize = ktx2BlockSize(vkFormat);
+	const std::vector<uint8_t> descriptor = ktx2BlockDescriptor(vkFormat);
+
+	const size_t dfdOffset = ktx2IndexSize(levelCount);
+
+	// Smallest level first, each aligned to its block size
+	std::vector<uint64_t> offsets(levelCount);
+	uint64_t end = dfdOffset + descriptor.size();
+	for (uint32_t level = levelCount; level-- > 0;)
+	{
+		end = (end + blockSize - 1) / blockSize * blockSize;
+		offsets[level] = end;
+		end += levels[level].size();
+	}
+
+	std::vector<uint8_t> out(KTX2_IDENTIFIER, KTX2_IDENTIFIER +
+	                         sizeof KTX2_IDENTIFIER);
+	out.reserve(static_cast<size_t>(end));
+
+	ktx2Write32(out, vkFormat);
+	// Block compressed formats have no type size
+	ktx2Write32(out, 1);
+	ktx2Write32(out, width);
+	ktx2Write32(out, height);
+	ktx2Write32(out, 0);
+	ktx2Write32(out, 0);
+	ktx2Write32(out, 1);
+	ktx2Write32(out, levelCount);
+	ktx2Write32(out, 0);
+
+	ktx2Write32(out, static_cast<uint32_t>(dfdOffset));
+	ktx2Write32(out, static_cast<uint32_t>(descriptor.size()));
+	ktx2Write32(out, 0);
+	ktx2Write32(out, 0);
+	ktx2Write64(out, 0);
+	ktx2Write64(out, 0);
+
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		ktx2Write64(out, offsets[level]);
+		ktx2Write64(out, levels[level].size());
+		ktx2Write64(out, levels[level].size());
+	}
+
+	out.insert(out.end(), descriptor.begin(), descriptor.end());
+
+	for (uint32_t level = levelCount; level-- > 0;)
+	{
+		out.resize(static_cast<size_t>(offsets[level]), 0);
+		out.insert(out.end(), levels[level].begin(), levels[level].end());
+	}
+
+	return out;
+}
+
+#endif // KTX2_IMPLEMENTATION
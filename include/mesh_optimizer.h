@@ -0,0 +1,410 @@
+/* mesh_optimizer - triangle order optimization for the vertex cache
+
+   Reorders the triangles of an indexed triangle list for the post-transform
+   vertex cache with Tipsify (Sander, Nehab and Barczak, "Fast Triangle
+   Reordering for Vertex Locality and Reduced Overdraw"), optionally followed
+   by its cluster sort against overdraw. A FIFO cache simulation measures the
+   result. Only depends on the standard library.
+
+   Do this:
+      #define MESH_OPTIMIZER_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Triangles are only moved, never rotated nor changed: the output is a
+   permutation of the input triangles with their corners in the same order.
+*/
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Entries of the simulated FIFO, also the cache size Tipsify targets
+#define VERTEX_CACHE_SIZE 16
+// Overdraw clusters may cost this much more vertex transforms than the
+// cache optimized order
+#define OVERDRAW_THRESHOLD 1.05f
+
+struct VertexCacheStats
+{
+	double acmr; // Average cache miss ratio, transformed vertices per triangle
+	double atvr; // Average transformed vertex ratio, 1 at best
+};
+
+// Misses of a VERTEX_CACHE_SIZE entries FIFO drawing the indices in order
+VertexCacheStats simulateVertexCache(const std::vector<uint32_t>& indices,
+                                     size_t vertexCount);
+
+// Reorders the triangles for the vertex cache. clusterStarts receives the
+// first triangle of each run Tipsify restarted from a dead end, where the
+// cache is cold anyway
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+                         std::vector<uint32_t>& clusterStarts);
+
+// Reorders the clusters of optimizeVertexCache() against overdraw, splitting
+// them first where that costs little. positionStride is the byte distance
+// between two vertex positions of three floats each
+void optimizeOverdraw(std::vector<uint32_t>& indices, const float* positions,
+                      size_t positionStride, size_t vertexCount,
+                      const std::vector<uint32_t>& clusterStarts);
+
+#endif // MESH_OPTIMIZER_H
+
+#ifdef MESH_OPTIMIZER_IMPLEMENTATION
+
+#include <algorithm>
+#include <cmath>
+
+VertexCacheStats simulateVertexCache(const std::vector<uint32_t>& indices,
+                                     size_t vertexCount)
+{
+	// A vertex is cached while fewer than VERTEX_CACHE_SIZE misses followed
+	// its own
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = VERTEX_CACHE_SIZE + 1;
+	uint32_t misses = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (time - timestamps[index] > VERTEX_CACHE_SIZE)
+		{
+			timestamps[index] = time++;
+			misses++;
+		}
+	}
+
+	VertexCacheStats stats = {};
+	if (!indices.empty())
+	{
+		stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+		stats.atvr = static_cast<double>(misses) / vertexCount;
+	}
+	return stats;
+}
+
+// Triangles of each vertex, offsets into a single list
+struct MeshAdjacency
+{
+	std::vector<uint32_t> offsets; // vertexCount + 1
+	std::vector<uint32_t> triangles;
+};
+
+static void buildAdjacency(const std::vector<uint32_t>& indices,
+                           size_t vertexCount, MeshAdjacency& adjacency)
+{
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (uint32_t index : indices)
+	{
+		adjacency.offsets[index + 1]++;
+	}
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		adjacency.offsets[i + 1] += adjacency.offsets[i];
+	}
+
+	std::vector<uint32_t> cursors(adjacency.offsets.begin(),
+	                              adjacency.offsets.end() - 1);
+	adjacency.triangles.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		adjacency.triangles[cursors[indices[i]]++] = static_cast<uint32_t>(
+			i / 3);
+	}
+}
+
+// Fans around a vertex whose remaining triangles still hit the cache, or
+// restarts from a recent vertex at dead ends
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+                         std::vector<uint32_t>& clusterStarts)
+{
+	const size_t triangleCount = indices.size() / 3;
+
+	MeshAdjacency adjacency;
+	buildAdjacency(indices, vertexCount, adjacency);
+
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		liveTriangles[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+	}
+
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	clusterStarts.clear();
+
+	uint32_t time = VERTEX_CACHE_SIZE + 1;
+	uint32_t scan = 0; // Next vertex to try when the dead end stack is empty
+	// Nothing to fan around without vertices
+	int64_t fanning = vertexCount > 0 ? 0 : -1;
+	bool restarted = true;
+
+	while (fanning >= 0)
+	{
+		const uint32_t vertex = static_cast<uint32_t>(fanning);
+		candidates.clear();
+
+		for (uint32_t i = adjacency.offsets[vertex];
+		     i < adjacency.offsets[vertex + 1]; i++)
+		{
+			const uint32_t triangle = adjacency.triangles[i];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+
+			if (restarted)
+			{
+				clusterStarts.push_back(static_cast<uint32_t>(output.size() /
+					3));
+				restarted = false;
+			}
+
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t index = indices[triangle * 3 + corner];
+				output.push_back(index);
+				deadEnds.push_back(index);
+				candidates.push_back(index);
+				liveTriangles[index]--;
+
+				if (time - timestamps[index] > VERTEX_CACHE_SIZE)
+				{
+					timestamps[index] = time++;
+				}
+			}
+			emitted[triangle] = 1;
+		}
+
+		// Oldest candidate still in cache once its remaining triangles are
+		// emitted, the fan then reuses the most vertices
+		fanning = -1;
+		int64_t best = -1;
+		for (uint32_t candidate : candidates)
+		{
+			if (liveTriangles[candidate] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			if (time - timestamps[candidate] + 2 * liveTriangles[candidate] <=
+				VERTEX_CACHE_SIZE)
+			{
+				priority = time - timestamps[candidate];
+			}
+			if (priority > best)
+			{
+				best = priority;
+				fanning = candidate;
+			}
+		}
+
+		if (fanning >= 0)
+		{
+			continue;
+		}
+
+		// Dead end, most recent vertex with triangles left, then any
+		restarted = true;
+		while (!deadEnds.empty() && fanning < 0)
+		{
+			const uint32_t candidate = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[candidate] > 0)
+			{
+				fanning = candidate;
+			}
+		}
+		while (scan < vertexCount && fanning < 0)
+		{
+			if (liveTriangles[scan] > 0)
+			{
+				fanning = scan;
+			}
+			scan++;
+		}
+	}
+
+	indices.swap(output);
+}
+
+// Splits the clusters where the cache order so far is within
+// OVERDRAW_THRESHOLD of the whole cluster's, then draws the clusters facing
+// away from the mesh center first: they are the likeliest to occlude the
+// others
+void optimizeOverdraw(std::vector<uint32_t>& indices, const float* positions,
+                      size_t positionStride, size_t vertexCount,
+                      const std::vector<uint32_t>& clusterStarts)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = VERTEX_CACHE_SIZE + 1;
+
+	auto triangleMisses = [&](uint32_t triangle)
+	{
+		uint32_t misses = 0;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			const uint32_t index = indices[triangle * 3 + corner];
+			if (time - timestamps[index] > VERTEX_CACHE_SIZE)
+			{
+				timestamps[index] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	};
+
+	// A cold cache at every boundary, clusters may be drawn in any order
+	auto flushCache = [&]
+	{
+		time += VERTEX_CACHE_SIZE + 1;
+	};
+
+	std::vector<uint32_t> boundaries;
+	for (size_t cluster = 0; cluster < clusterStarts.size(); cluster++)
+	{
+		const uint32_t begin = clusterStarts[cluster];
+		const uint32_t end = cluster + 1 < clusterStarts.size()
+			                     ? clusterStarts[cluster + 1]
+			                     : triangleCount;
+
+		flushCache();
+		uint32_t clusterMisses = 0;
+		for (uint32_t triangle = begin; triangle < end; triangle++)
+		{
+			clusterMisses += triangleMisses(triangle);
+		}
+		const float clusterAcmr = static_cast<float>(clusterMisses) / (end -
+			begin);
+
+		flushCache();
+		boundaries.push_back(begin);
+		uint32_t start = begin;
+		uint32_t misses = 0;
+		for (uint32_t triangle = begin; triangle < end; triangle++)
+		{
+			misses += triangleMisses(triangle);
+
+			if (triangle + 1 < end && misses <= OVERDRAW_THRESHOLD *
+				clusterAcmr * (triangle + 1 - start))
+			{
+				start = triangle + 1;
+				misses = 0;
+				boundaries.push_back(start);
+				flushCache();
+			}
+		}
+	}
+	boundaries.push_back(triangleCount);
+
+	auto position = [&](uint32_t vertex)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(
+			positions) + vertex * positionStride);
+	};
+
+	// Area weighted centroid and normal of the mesh and of each cluster,
+	// three floats each
+	const size_t clusterCount = boundaries.size() - 1;
+	std::vector<float> centroids(clusterCount * 3, 0.0f);
+	std::vector<float> normals(clusterCount * 3, 0.0f);
+	float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+	float meshArea = 0.0f;
+
+	for (size_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		float* centroid = &centroids[cluster * 3];
+		float* clusterNormal = &normals[cluster * 3];
+		float clusterArea = 0.0f;
+
+		for (uint32_t triangle = boundaries[cluster];
+		     triangle < boundaries[cluster + 1]; triangle++)
+		{
+			const float* a = position(indices[triangle * 3]);
+			const float* b = position(indices[triangle * 3 + 1]);
+			const float* c = position(indices[triangle * 3 + 2]);
+
+			const float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			const float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+			const float normal[3] = {
+				ab[1] * ac[2] - ab[2] * ac[1],
+				ab[2] * ac[0] - ab[0] * ac[2],
+				ab[0] * ac[1] - ab[1] * ac[0]
+			};
+			const float area = std::sqrt(normal[0] * normal[0] + normal[1] *
+				normal[1] + normal[2] * normal[2]);
+
+			for (int k = 0; k < 3; k++)
+			{
+				centroid[k] += (a[k] + b[k] + c[k]) * (area / 3.0f);
+				clusterNormal[k] += normal[k];
+			}
+			clusterArea += area;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			meshCentroid[k] += centroid[k];
+		}
+		meshArea += clusterArea;
+		if (clusterArea > 0.0f)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				centroid[k] /= clusterArea;
+			}
+		}
+	}
+	if (meshArea > 0.0f)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			meshCentroid[k] /= meshArea;
+		}
+	}
+
+	std::vector<float> sortKeys(clusterCount);
+	std::vector<uint32_t> order(clusterCount);
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		const float* centroid = &centroids[cluster * 3];
+		const float* normal = &normals[cluster * 3];
+		const float length = std::sqrt(normal[0] * normal[0] + normal[1] *
+			normal[1] + normal[2] * normal[2]);
+
+		sortKeys[cluster] = 0.0f;
+		if (length > 0.0f)
+		{
+			sortKeys[cluster] = ((centroid[0] - meshCentroid[0]) * normal[0] +
+				(centroid[1] - meshCentroid[1]) * normal[1] + (centroid[2] -
+					meshCentroid[2]) * normal[2]) / length;
+		}
+		order[cluster] = cluster;
+	}
+
+	std::stable_sort(order.begin(), order.end(),
+	                 [&](uint32_t a, uint32_t b)
+	                 {
+		                 return sortKeys[a] > sortKeys[b];
+	                 });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (uint32_t cluster : order)
+	{
+		output.insert(output.end(),
+		              indices.begin() + boundaries[cluster] * 3,
+		              indices.begin() + boundaries[cluster + 1] * 3);
+	}
+	indices.swap(output);
+}
+
+#endif // MESH_OPTIMIZER_IMPLEMENTATION
@@ -0,0 +1,309 @@
+/* meshlet - cluster builder for per-cluster GPU culling
+
+   Splits an indexed triangle list in meshlets of at most 64 vertices and
+   124 triangles, and computes the bounding sphere and normal cone of each
+   one. Only depends on the standard library.
+
+   Do this:
+      #define MESHLET_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Clusters are cut greedily in index order: run a vertex cache optimization
+   first so consecutive triangles share vertices, the clusters are then
+   compact and full.
+
+   Culling a meshlet against a camera at position P, both in mesh space:
+      frustum   sphere (center, radius) outside any frustum plane
+      backface  dot(normalize(coneApex - P), coneAxis) > coneCutoff, every
+                triangle of the cluster faces away from P
+*/
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Meshlet
+{
+	uint32_t vertexOffset; // First entry in MeshletData::vertices
+	uint32_t triangleOffset; // First entry in MeshletData::triangles
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	// Mesh vertex of each meshlet vertex
+	std::vector<uint32_t> vertices;
+	// Three meshlet vertices per triangle, relative to the meshlet's
+	// vertexOffset
+	std::vector<uint8_t> triangles;
+};
+
+struct MeshletBounds
+{
+	float center[3];
+	float radius;
+	float coneApex[3];
+	float coneAxis[3];
+	// 1 when the triangles face too many ways to ever be culled together
+	float coneCutoff;
+};
+
+// Appends the meshlets of indexCount / 3 triangles to data, returns how many
+// were added. maxVertices is at most 255, the local indices are bytes
+size_t buildMeshlets(MeshletData& data, const uint32_t* indices,
+                     size_t indexCount, size_t vertexCount,
+                     size_t maxVertices = MESHLET_MAX_VERTICES,
+                     size_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// positionStride is the byte distance between two vertex positions of three
+// floats each
+MeshletBounds computeMeshletBounds(const MeshletData& data,
+                                   const Meshlet& meshlet,
+                                   const float* positions,
+                                   size_t positionStride);
+
+#endif // MESHLET_H
+
+#ifdef MESHLET_IMPLEMENTATION
+
+#include <algorithm>
+#include <cmath>
+
+size_t buildMeshlets(MeshletData& data, const uint32_t* indices,
+                     size_t indexCount, size_t vertexCount,
+                     size_t maxVertices, size_t maxTriangles)
+{
+	maxVertices = std::min<size_t>(std::max<size_t>(maxVertices, 3), 255);
+	maxTriangles = std::max<size_t>(maxTriangles, 1);
+
+	const size_t firstMeshlet = data.meshlets.size();
+	const uint8_t NOT_IN_MESHLET = 0xff;
+
+	// Local index of each mesh vertex in the open meshlet
+	std::vector<uint8_t> localIndices(vertexCount, NOT_IN_MESHLET);
+
+	Meshlet meshlet = {};
+	meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+	meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+
+	auto closeMeshlet = [&]
+	{
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			localIndices[data.vertices[meshlet.vertexOffset + i]] =
+				NOT_IN_MESHLET;
+		}
+
+		data.meshlets.push_back(meshlet);
+
+		meshlet.vertexOffset += meshlet.vertexCount;
+		meshlet.triangleOffset += meshlet.triangleCount * 3;
+		meshlet.vertexCount = 0;
+		meshlet.triangleCount = 0;
+	};
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		uint32_t newVertices = 0;
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			const uint32_t vertex = indices[i + corner];
+			// Repeated corners of degenerate triangles count once
+			const bool repeated = (corner > 0 && vertex == indices[i]) ||
+				(corner > 1 && vertex == indices[i + 1]);
+			newVertices += !repeated && localIndices[vertex] ==
+				NOT_IN_MESHLET;
+		}
+
+		if (meshlet.vertexCount + newVertices > maxVertices ||
+			meshlet.triangleCount == maxTriangles)
+		{
+			closeMeshlet();
+		}
+
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			const uint32_t vertex = indices[i + corner];
+			if (localIndices[vertex] == NOT_IN_MESHLET)
+			{
+				localIndices[vertex] = static_cast<uint8_t>(meshlet.
+					vertexCount);
+				data.vertices.push_back(vertex);
+				meshlet.vertexCount++;
+			}
+			data.triangles.push_back(localIndices[vertex]);
+		}
+		meshlet.triangleCount++;
+	}
+
+	if (meshlet.triangleCount > 0)
+	{
+		closeMeshlet();
+	}
+
+	return data.meshlets.size() - firstMeshlet;
+}
+
+MeshletBounds computeMeshletBounds(const MeshletData& data,
+                                   const Meshlet& meshlet,
+                                   const float* positions,
+                                   size_t positionStride)
+{
+	MeshletBounds bounds = {};
+	bounds.coneAxis[2] = 1.0f;
+	bounds.coneCutoff = 1.0f;
+
+	auto position = [&](uint32_t local, float* out)
+	{
+		const uint32_t vertex = data.vertices[meshlet.vertexOffset + local];
+		const float* source = reinterpret_cast<const float*>(
+			reinterpret_cast<const uint8_t*>(positions) + vertex *
+			positionStride);
+		out[0] = source[0];
+		out[1] = source[1];
+		out[2] = source[2];
+	};
+
+	if (meshlet.vertexCount == 0)
+	{
+		return bounds;
+	}
+
+	// Sphere around the center of the bounding box
+	float boxMin[3];
+	float boxMax[3];
+	position(0, boxMin);
+	position(0, boxMax);
+	for (uint32_t i = 1; i < meshlet.vertexCount; i++)
+	{
+		float p[3];
+		position(i, p);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			boxMin[axis] = std::min(boxMin[axis], p[axis]);
+			boxMax[axis] = std::max(boxMax[axis], p[axis]);
+		}
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		bounds.center[axis] = (boxMin[axis] + boxMax[axis]) * 0.5f;
+	}
+
+	float radiusSquared = 0.0f;
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+	{
+		float p[3];
+		position(i, p);
+		const float dx = p[0] - bounds.center[0];
+		const float dy = p[1] - bounds.center[1];
+		const float dz = p[2] - bounds.center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+
+	// Unit normals and first corners of the non degenerate triangles
+	std::vector<float> normals;
+	std::vector<float> corners;
+	normals.reserve(meshlet.triangleCount * 3);
+	corners.reserve(meshlet.triangleCount * 3);
+
+	float axis[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+	{
+		const uint8_t* triangle = &data.triangles[meshlet.triangleOffset + i *
+			3];
+		float a[3], b[3], c[3];
+		position(triangle[0], a);
+		position(triangle[1], b);
+		position(triangle[2], c);
+
+		const float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		const float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+		float n[3] = {
+			ab[1] * ac[2] - ab[2] * ac[1],
+			ab[2] * ac[0] - ab[0] * ac[2],
+			ab[0] * ac[1] - ab[1] * ac[0]
+		};
+
+		const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] *
+			n[2]);
+		if (length == 0.0f)
+		{
+			continue;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			n[k] /= length;
+			axis[k] += n[k];
+			normals.push_back(n[k]);
+			corners.push_back(a[k]);
+		}
+	}
+
+	const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+		axis[2] * axis[2]);
+	if (normals.empty() || axisLength == 0.0f)
+	{
+		return bounds;
+	}
+
+	for (int k = 0; k < 3; k++)
+	{
+		axis[k] /= axisLength;
+	}
+
+	// Widest angle between the axis and a triangle normal. Past about 84
+	// degrees the cone is nearly a half space and never culls
+	float minDot = 1.0f;
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		minDot = std::min(minDot, normals[i] * axis[0] + normals[i + 1] *
+		                  axis[1] + normals[i + 2] * axis[2]);
+	}
+
+	for (int k = 0; k < 3; k++)
+	{
+		bounds.coneAxis[k] = axis[k];
+		bounds.coneApex[k] = bounds.center[k];
+	}
+
+	if (minDot <= 0.1f)
+	{
+		return bounds;
+	}
+
+	// Apex moved back along the axis until it is behind every triangle
+	// plane, a camera seeing it from the front side of the cone then sees
+	// every triangle from behind
+	float maxT = 0.0f;
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		const float toCenter = (bounds.center[0] - corners[i]) * normals[i] +
+			(bounds.center[1] - corners[i + 1]) * normals[i + 1] +
+			(bounds.center[2] - corners[i + 2]) * normals[i + 2];
+		const float alongAxis = axis[0] * normals[i] + axis[1] *
+			normals[i + 1] + axis[2] * normals[i + 2];
+		maxT = std::max(maxT, toCenter / alongAxis);
+	}
+
+	for (int k = 0; k < 3; k++)
+	{
+		bounds.coneApex[k] = bounds.center[k] - axis[k] * maxT;
+	}
+	bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+
+	return bounds;
+}
+
+#endif // MESHLET_IMPLEMENTATION
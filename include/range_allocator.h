@@ -0,0 +1,138 @@
+/* range_allocator - best fit offset allocator over a sorted free list
+
+   Places ranges in a memory block of a given size: the free ranges are kept
+   sorted by offset, an allocation takes the smallest free range it fits in
+   once aligned, and freed ranges are merged back with their neighbours.
+   Offsets and sizes are plain integers, nothing is allocated on a device.
+   Only depends on the standard library.
+
+   Do this:
+      #define RANGE_ALLOCATOR_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Alignments must be powers of two, as Vulkan's are. Linear resources
+   (buffers, linear images) and optimal images may not share a
+   bufferImageGranularity page: pass optimal images through
+   rangeImageGranularity() first, they then start and end on page
+   boundaries.
+*/
+
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+
+struct MemoryRange
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+// value rounded up to a multiple of alignment, a power of two
+uint64_t alignRange(uint64_t value, uint64_t alignment);
+
+// Aligns an optimal image to whole pages of bufferImageGranularity and pads
+// its size to the end of its last page
+void rangeImageGranularity(uint64_t granularity, uint64_t& size,
+                           uint64_t& alignment);
+
+// Takes an aligned range out of a sorted free list, best fit. Alignment
+// padding stays free in front of the allocation. Returns false if no range
+// is large enough
+bool allocateRange(std::vector<MemoryRange>& freeRanges, uint64_t size,
+                   uint64_t alignment, uint64_t& offset);
+
+// Gives a range back to a sorted free list, merging it with its neighbours
+void freeRange(std::vector<MemoryRange>& freeRanges, uint64_t offset,
+               uint64_t size);
+
+#endif // RANGE_ALLOCATOR_H
+
+#ifdef RANGE_ALLOCATOR_IMPLEMENTATION
+
+#include <algorithm>
+
+uint64_t alignRange(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void rangeImageGranularity(uint64_t granularity, uint64_t& size,
+                           uint64_t& alignment)
+{
+	alignment = std::max(alignment, granularity);
+	size = alignRange(size, granularity);
+}
+
+bool allocateRange(std::vector<MemoryRange>& freeRanges, uint64_t size,
+                   uint64_t alignment, uint64_t& offset)
+{
+	size_t best = freeRanges.size();
+
+	for (size_t i = 0; i < freeRanges.size(); i++)
+	{
+		const MemoryRange& range = freeRanges[i];
+		const uint64_t padding = alignRange(range.offset, alignment) -
+			range.offset;
+
+		if (padding <= range.size && size <= range.size - padding &&
+			(best == freeRanges.size() || range.size < freeRanges[best].size))
+		{
+			best = i;
+		}
+	}
+
+	if (best == freeRanges.size())
+	{
+		return false;
+	}
+
+	const MemoryRange range = freeRanges[best];
+	offset = alignRange(range.offset, alignment);
+
+	const uint64_t padding = offset - range.offset;
+	const uint64_t remaining = range.size - padding - size;
+
+	freeRanges.erase(freeRanges.begin() + best);
+	if (remaining > 0)
+	{
+		freeRanges.insert(freeRanges.begin() + best,
+		                  {offset + size, remaining});
+	}
+	if (padding > 0)
+	{
+		freeRanges.insert(freeRanges.begin() + best, {range.offset, padding});
+	}
+
+	return true;
+}
+
+void freeRange(std::vector<MemoryRange>& freeRanges, uint64_t offset,
+               uint64_t size)
+{
+	auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+	                             [](const MemoryRange& range, uint64_t value)
+	                             {
+		                             return range.offset < value;
+	                             });
+
+	next = freeRanges.insert(next, {offset, size});
+
+	if (next + 1 != freeRanges.end() && next->offset + next->size == (next + 1)
+		->offset)
+	{
+		next->size += (next + 1)->size;
+		freeRanges.erase(next + 1);
+	}
+
+	if (next != freeRanges.begin() && (next - 1)->offset + (next - 1)->size ==
+		next->offset)
+	{
+		(next - 1)->size += next->size;
+		freeRanges.erase(next);
+	}
+}
+
+#endif // RANGE_ALLOCATOR_IMPLEMENTATION
@@ -0,0 +1,185 @@
+/* texture_residency - residency policy of streamed texture mip levels
+
+   Decides which mip levels of each texture stay resident within a memory
+   budget, from the level each texture wants this frame and when it was last
+   used. Works on level sizes alone, knows nothing of the device. Only
+   depends on the standard library.
+
+   Do this:
+      #define TEXTURE_RESIDENCY_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   Each frame: noteTextureUse() every visible texture with the level its
+   screen size wants (footprintMipLevel()), then planResidency() gives the
+   first level each texture should have resident. Levels up to
+   TEXTURE_RESIDENCY_TAIL_SIZE texels, the tail, are never evicted.
+*/
+
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Largest side of the levels that are never evicted
+#define TEXTURE_RESIDENCY_TAIL_SIZE 128
+
+// Levels [residentLevel, levelSizes.size()) are resident
+struct TextureResidency
+{
+	std::vector<uint64_t> levelSizes; // Bytes
+	uint32_t tailLevel; // First level of the resident tail
+	uint32_t residentLevel;
+	uint32_t wantedLevel; // From the latest feedback, at most tailLevel
+	uint64_t lastUsedFrame;
+};
+
+// Bytes of levels [firstLevel, levelSizes.size())
+uint64_t residentBytes(const TextureResidency& texture, uint32_t firstLevel);
+
+// Sizes of the levels of a texture made of 4x4 blocks, and its tail. Only
+// the tail is resident and wanted
+TextureResidency blockTextureResidency(uint32_t width, uint32_t height,
+                                       uint32_t levelCount,
+                                       uint64_t blockSize);
+
+// Level sampled with about one texel per pixel when the texture is pixels
+// wide on screen. Trilinear filtering blends it with the next one
+uint32_t footprintMipLevel(uint32_t width, uint32_t height,
+                           uint32_t levelCount, float pixels);
+
+// Feedback of a frame the texture is visible in
+void noteTextureUse(TextureResidency& texture, uint32_t level,
+                    uint64_t frame);
+
+// First level each of count textures should have resident within budget,
+// written to targets. Every texture gets its wanted levels and keeps the more
+// detailed ones it has; over budget, those extra levels are evicted first,
+// then the wanted ones down to the tail, the least recently used textures
+// first each time. Returns the bytes resident once the targets are reached,
+// over budget only when the tails alone do not fit
+uint64_t planResidency(const TextureResidency* textures, size_t count,
+                       uint64_t budget, uint32_t* targets);
+
+#endif // TEXTURE_RESIDENCY_H
+
+#ifdef TEXTURE_RESIDENCY_IMPLEMENTATION
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+uint64_t residentBytes(const TextureResidency& texture, uint32_t firstLevel)
+{
+	uint64_t bytes = 0;
+	for (size_t level = firstLevel; level < texture.levelSizes.size(); level++)
+	{
+		bytes += texture.levelSizes[level];
+	}
+	return bytes;
+}
+
+TextureResidency blockTextureResidency(uint32_t width, uint32_t height,
+                                       uint32_t levelCount,
+                                       uint64_t blockSize)
+{
+	TextureResidency texture = {};
+	texture.levelSizes.resize(levelCount);
+	texture.tailLevel = levelCount - 1;
+
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		const uint32_t levelWidth = std::max(width >> level, 1u);
+		const uint32_t levelHeight = std::max(height >> level, 1u);
+
+		texture.levelSizes[level] = static_cast<uint64_t>(
+			(levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize;
+
+		if (std::max(levelWidth, levelHeight) <= TEXTURE_RESIDENCY_TAIL_SIZE)
+		{
+			texture.tailLevel = std::min(texture.tailLevel, level);
+		}
+	}
+
+	texture.residentLevel = texture.tailLevel;
+	texture.wantedLevel = texture.tailLevel;
+
+	return texture;
+}
+
+uint32_t footprintMipLevel(uint32_t width, uint32_t height,
+                           uint32_t levelCount, float pixels)
+{
+	const float texels = static_cast<float>(std::max(width, height));
+	if (pixels <= 0.0f)
+	{
+		return levelCount - 1;
+	}
+
+	const float lod = std::log2(texels / pixels);
+	if (lod <= 0.0f)
+	{
+		return 0;
+	}
+
+	return std::min(static_cast<uint32_t>(lod), levelCount - 1);
+}
+
+void noteTextureUse(TextureResidency& texture, uint32_t level,
+                    uint64_t frame)
+{
+	texture.wantedLevel = std::min(level, texture.tailLevel);
+	texture.lastUsedFrame = frame;
+}
+
+uint64_t planResidency(const TextureResidency* textures, size_t count,
+                       uint64_t budget, uint32_t* targets)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		targets[i] = std::min(textures[i].wantedLevel,
+		                      textures[i].residentLevel);
+		total += residentBytes(textures[i], targets[i]);
+	}
+
+	if (total <= budget)
+	{
+		return total;
+	}
+
+	std::vector<size_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [textures](size_t a, size_t b)
+	{
+		return textures[a].lastUsedFrame < textures[b].lastUsedFrame;
+	});
+
+	for (int pass = 0; pass < 2 && total > budget; pass++)
+	{
+		for (size_t i : order)
+		{
+			const TextureResidency& texture = textures[i];
+			const uint32_t lastLevel = pass == 0
+				                           ? texture.wantedLevel
+				                           : texture.tailLevel;
+
+			while (total > budget && targets[i] < lastLevel)
+			{
+				total -= texture.levelSizes[targets[i]];
+				targets[i]++;
+			}
+
+			if (total <= budget)
+			{
+				break;
+			}
+		}
+	}
+
+	return total;
+}
+
+#endif // TEXTURE_RESIDENCY_IMPLEMENTATION
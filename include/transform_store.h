@@ -0,0 +1,336 @@
+/* transform_store - structure of arrays transforms and batch model matrices
+
+   Keeps the position, rotation (a unit quaternion) and scale of many objects
+   in separate arrays, so the batch kernels load 4 (SSE) or 8 (AVX) objects
+   per register, and composes their model matrices straight into a mapped
+   instance buffer. Only depends on the standard library and the SSE/AVX
+   intrinsics.
+
+   Do this:
+      #define TRANSFORM_STORE_IMPLEMENTATION
+   before you include this file in *one* C++ file to create the
+   implementation.
+
+   TRANSFORM_SIMD is defined when the SSE kernels are built, which x64
+   targets always do. TRANSFORM_AVX is defined when the AVX kernel is built:
+   with __AVX__ (/arch:AVX, -mavx) it always runs, MSVC also builds it
+   without /arch and only runs it when cpuid reports AVX.
+   Matrices are column major, 16 floats each like a glm::mat4.
+*/
+
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#ifndef TRANSFORM_SIMD
+#define TRANSFORM_SIMD
+#endif
+#if defined(__AVX__) || (defined(_MSC_VER) && !defined(__clang__))
+#define TRANSFORM_AVX
+#endif
+#endif
+
+struct TransformStore
+{
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	size_t size() const
+	{
+		return positionX.size();
+	}
+
+	// New transforms are at the origin, unrotated and unscaled
+	void resize(size_t count)
+	{
+		positionX.resize(count, 0.0f);
+		positionY.resize(count, 0.0f);
+		positionZ.resize(count, 0.0f);
+		rotationX.resize(count, 0.0f);
+		rotationY.resize(count, 0.0f);
+		rotationZ.resize(count, 0.0f);
+		rotationW.resize(count, 1.0f);
+		scaleX.resize(count, 1.0f);
+		scaleY.resize(count, 1.0f);
+		scaleZ.resize(count, 1.0f);
+	}
+};
+
+// Model matrix of object i, same result as
+// translate(position) * mat4_cast(rotation) * scale(scale)
+void composeModelMatrix(const TransformStore& transforms, size_t i,
+                        float* out);
+
+// Batch composition of every model matrix into out, 16 floats per object.
+// out is usually write-combined mapped memory, it is only written
+void composeModelMatrices(const TransformStore& transforms, float* out);
+
+// Spins every object around its local Z axis, rotation = rotation * q(angle)
+void rotateTransformsZ(TransformStore& transforms, float angle);
+
+// Whether composeModelMatrices() runs the AVX kernel on this CPU
+bool transformAvxSupported();
+
+#endif // TRANSFORM_STORE_H
+
+#ifdef TRANSFORM_STORE_IMPLEMENTATION
+
+#include <cmath>
+#include <cstdint>
+#if defined(TRANSFORM_AVX) && !defined(__AVX__)
+#include <intrin.h>
+#endif
+
+bool transformAvxSupported()
+{
+#if defined(__AVX__)
+	return true;
+#elif defined(TRANSFORM_AVX)
+	// AVX and OSXSAVE in ECX of leaf 1, then the OS must save the YMM state
+	static const bool supported = []
+	{
+		int info[4];
+		__cpuid(info, 1);
+		const int avxAndOsxsave = (1 << 28) | (1 << 27);
+		return (info[2] & avxAndOsxsave) == avxAndOsxsave &&
+			(_xgetbv(0) & 6) == 6;
+	}();
+	return supported;
+#else
+	return false;
+#endif
+}
+
+void composeModelMatrix(const TransformStore& transforms, size_t i,
+                        float* out)
+{
+	const float x = transforms.rotationX[i];
+	const float y = transforms.rotationY[i];
+	const float z = transforms.rotationZ[i];
+	const float w = transforms.rotationW[i];
+	const float sx = transforms.scaleX[i];
+	const float sy = transforms.scaleY[i];
+	const float sz = transforms.scaleZ[i];
+
+	out[0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+	out[1] = 2.0f * (x * y + w * z) * sx;
+	out[2] = 2.0f * (x * z - w * y) * sx;
+	out[3] = 0.0f;
+	out[4] = 2.0f * (x * y - w * z) * sy;
+	out[5] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+	out[6] = 2.0f * (y * z + w * x) * sy;
+	out[7] = 0.0f;
+	out[8] = 2.0f * (x * z + w * y) * sz;
+	out[9] = 2.0f * (y * z - w * x) * sz;
+	out[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+	out[11] = 0.0f;
+	out[12] = transforms.positionX[i];
+	out[13] = transforms.positionY[i];
+	out[14] = transforms.positionZ[i];
+	out[15] = 1.0f;
+}
+
+#ifdef TRANSFORM_SIMD
+// Transpose the 4 lanes of 4 rows into one column (object) each, streamed
+// since the destination is usually write-combined mapped memory
+static inline void storeColumns(float* out, size_t stride, __m128 a,
+                                __m128 b, __m128 c, __m128 d, bool aligned)
+{
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+
+	if (aligned)
+	{
+		_mm_stream_ps(out, a);
+		_mm_stream_ps(out + stride, b);
+		_mm_stream_ps(out + 2 * stride, c);
+		_mm_stream_ps(out + 3 * stride, d);
+	}
+	else
+	{
+		_mm_storeu_ps(out, a);
+		_mm_storeu_ps(out + stride, b);
+		_mm_storeu_ps(out + 2 * stride, c);
+		_mm_storeu_ps(out + 3 * stride, d);
+	}
+}
+
+// Write the model matrices of 4 objects given one lane per object
+static inline void storeModelMatrices(float* out, const __m128* m,
+                                      bool aligned)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	storeColumns(out, 16, m[0], m[1], m[2], zero, aligned);
+	storeColumns(out + 4, 16, m[3], m[4], m[5], zero, aligned);
+	storeColumns(out + 8, 16, m[6], m[7], m[8], zero, aligned);
+	storeColumns(out + 12, 16, m[9], m[10], m[11], one, aligned);
+}
+#endif
+
+void composeModelMatrices(const TransformStore& transforms, float* out)
+{
+	const size_t count = transforms.size();
+	size_t i = 0;
+
+#ifdef TRANSFORM_SIMD
+	const bool aligned = reinterpret_cast<uintptr_t>(out) % 16 == 0;
+
+#ifdef TRANSFORM_AVX
+	const __m256 one8 = _mm256_set1_ps(1.0f);
+	const __m256 two8 = _mm256_set1_ps(2.0f);
+	const size_t avxCount = transformAvxSupported() ? count : 0;
+
+	for (; i + 8 <= avxCount; i += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(&transforms.rotationX[i]);
+		const __m256 y = _mm256_loadu_ps(&transforms.rotationY[i]);
+		const __m256 z = _mm256_loadu_ps(&transforms.rotationZ[i]);
+		const __m256 w = _mm256_loadu_ps(&transforms.rotationW[i]);
+		const __m256 sx = _mm256_loadu_ps(&transforms.scaleX[i]);
+		const __m256 sy = _mm256_loadu_ps(&transforms.scaleY[i]);
+		const __m256 sz = _mm256_loadu_ps(&transforms.scaleZ[i]);
+
+		const __m256 xx = _mm256_mul_ps(x, x);
+		const __m256 yy = _mm256_mul_ps(y, y);
+		const __m256 zz = _mm256_mul_ps(z, z);
+		const __m256 xy = _mm256_mul_ps(x, y);
+		const __m256 xz = _mm256_mul_ps(x, z);
+		const __m256 yz = _mm256_mul_ps(y, z);
+		const __m256 wx = _mm256_mul_ps(w, x);
+		const __m256 wy = _mm256_mul_ps(w, y);
+		const __m256 wz = _mm256_mul_ps(w, z);
+
+		__m256 m[12];
+		m[0] = _mm256_mul_ps(_mm256_sub_ps(one8, _mm256_mul_ps(
+			                     two8, _mm256_add_ps(yy, zz))), sx);
+		m[1] = _mm256_mul_ps(_mm256_mul_ps(two8, _mm256_add_ps(xy, wz)), sx);
+		m[2] = _mm256_mul_ps(_mm256_mul_ps(two8, _mm256_sub_ps(xz, wy)), sx);
+		m[3] = _mm256_mul_ps(_mm256_mul_ps(two8, _mm256_sub_ps(xy, wz)), sy);
+		m[4] = _mm256_mul_ps(_mm256_sub_ps(one8, _mm256_mul_ps(
+			                     two8, _mm256_add_ps(xx, zz))), sy);
+		m[5] = _mm256_mul_ps(_mm256_mul_ps(two8, _mm256_add_ps(yz, wx)), sy);
+		m[6] = _mm256_mul_ps(_mm256_mul_ps(two8, _mm256_add_ps(xz, wy)), sz);
+		m[7] = _mm256_mul_ps(_mm256_mul_ps(two8, _mm256_sub_ps(yz, wx)), sz);
+		m[8] = _mm256_mul_ps(_mm256_sub_ps(one8, _mm256_mul_ps(
+			                     two8, _mm256_add_ps(xx, yy))), sz);
+		m[9] = _mm256_loadu_ps(&transforms.positionX[i]);
+		m[10] = _mm256_loadu_ps(&transforms.positionY[i]);
+		m[11] = _mm256_loadu_ps(&transforms.positionZ[i]);
+
+		// Transposes work on 128-bit halves, 4 objects each
+		__m128 low[12];
+		__m128 high[12];
+		for (int j = 0; j < 12; j++)
+		{
+			low[j] = _mm256_castps256_ps128(m[j]);
+			high[j] = _mm256_extractf128_ps(m[j], 1);
+		}
+
+		storeModelMatrices(out + i * 16, low, aligned);
+		storeModelMatrices(out + (i + 4) * 16, high, aligned);
+	}
+#endif
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&transforms.rotationX[i]);
+		const __m128 y = _mm_loadu_ps(&transforms.rotationY[i]);
+		const __m128 z = _mm_loadu_ps(&transforms.rotationZ[i]);
+		const __m128 w = _mm_loadu_ps(&transforms.rotationW[i]);
+		const __m128 sx = _mm_loadu_ps(&transforms.scaleX[i]);
+		const __m128 sy = _mm_loadu_ps(&transforms.scaleY[i]);
+		const __m128 sz = _mm_loadu_ps(&transforms.scaleZ[i]);
+
+		const __m128 xx = _mm_mul_ps(x, x);
+		const __m128 yy = _mm_mul_ps(y, y);
+		const __m128 zz = _mm_mul_ps(z, z);
+		const __m128 xy = _mm_mul_ps(x, y);
+		const __m128 xz = _mm_mul_ps(x, z);
+		const __m128 yz = _mm_mul_ps(y, z);
+		const __m128 wx = _mm_mul_ps(w, x);
+		const __m128 wy = _mm_mul_ps(w, y);
+		const __m128 wz = _mm_mul_ps(w, z);
+
+		__m128 m[12];
+		m[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))),
+		                  sx);
+		m[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		m[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		m[3] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		m[4] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))),
+		                  sy);
+		m[5] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		m[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		m[7] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		m[8] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))),
+		                  sz);
+		m[9] = _mm_loadu_ps(&transforms.positionX[i]);
+		m[10] = _mm_loadu_ps(&transforms.positionY[i]);
+		m[11] = _mm_loadu_ps(&transforms.positionZ[i]);
+
+		storeModelMatrices(out + i * 16, m, aligned);
+	}
+
+	// Streaming stores are weakly ordered
+	_mm_sfence();
+#endif
+
+	for (; i < count; i++)
+	{
+		composeModelMatrix(transforms, i, out + i * 16);
+	}
+}
+
+void rotateTransformsZ(TransformStore& transforms, float angle)
+{
+	const float c = std::cos(angle * 0.5f);
+	const float s = std::sin(angle * 0.5f);
+	const size_t count = transforms.size();
+	size_t i = 0;
+
+#ifdef TRANSFORM_SIMD
+	const __m128 c4 = _mm_set1_ps(c);
+	const __m128 s4 = _mm_set1_ps(s);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&transforms.rotationX[i]);
+		const __m128 y = _mm_loadu_ps(&transforms.rotationY[i]);
+		const __m128 z = _mm_loadu_ps(&transforms.rotationZ[i]);
+		const __m128 w = _mm_loadu_ps(&transforms.rotationW[i]);
+
+		_mm_storeu_ps(&transforms.rotationX[i],
+		              _mm_add_ps(_mm_mul_ps(x, c4), _mm_mul_ps(y, s4)));
+		_mm_storeu_ps(&transforms.rotationY[i],
+		              _mm_sub_ps(_mm_mul_ps(y, c4), _mm_mul_ps(x, s4)));
+		_mm_storeu_ps(&transforms.rotationZ[i],
+		              _mm_add_ps(_mm_mul_ps(z, c4), _mm_mul_ps(w, s4)));
+		_mm_storeu_ps(&transforms.rotationW[i],
+		              _mm_sub_ps(_mm_mul_ps(w, c4), _mm_mul_ps(z, s4)));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		const float x = transforms.rotationX[i];
+		const float y = transforms.rotationY[i];
+		const float z = transforms.rotationZ[i];
+		const float w = transforms.rotationW[i];
+
+		transforms.rotationX[i] = x * c + y * s;
+		transforms.rotationY[i] = y * c - x * s;
+		transforms.rotationZ[i] = z * c + w * s;
+		transforms.rotationW[i] = w * c - z * s;
+	}
+}
+
+#endif // TRANSFORM_STORE_IMPLEMENTATION
@@ -1,3 +1,11 @@
 %VULKAN_SDK%/Bin32/glslc.exe shader.vert -o vert.spv
+%VULKAN_SDK%/Bin32/glslc.exe -DPACKED_VERTICES shader.vert -o vert_packed.spv
 %VULKAN_SDK%/Bin32/glslc.exe shader.frag -o frag.spv
+%VULKAN_SDK%/Bin32/glslc.exe instanced.vert -o instanced_vert.spv
+%VULKAN_SDK%/Bin32/glslc.exe -DPACKED_VERTICES instanced.vert -o instanced_vert_packed.spv
+%VULKAN_SDK%/Bin32/glslc.exe cull.comp -o cull.spv
+%VULKAN_SDK%/Bin32/glslc.exe -DOCCLUSION_CULLING cull.comp -o cull_occlusion.spv
+%VULKAN_SDK%/Bin32/glslc.exe hiz.comp -o hiz.spv
+%VULKAN_SDK%/Bin32/glslc.exe cluster_cull.comp -o cluster_cull.spv
+%VULKAN_SDK%/Bin32/glslc.exe texture_sample.comp -o texture_sample.spv
 pause
\ No newline at end of file
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Same shaders as compile-shaders.bat, for Linux and macOS. Uses glslc from
+# the Vulkan SDK when VULKAN_SDK is set, from the PATH otherwise.
+set -e
+
+cd "$(dirname "$0")"
+
+if [ -n "$VULKAN_SDK" ] && [ -x "$VULKAN_SDK/bin/glslc" ]; then
+	GLSLC="$VULKAN_SDK/bin/glslc"
+else
+	GLSLC=glslc
+fi
+
+"$GLSLC" shader.vert -o vert.spv
+"$GLSLC" -DPACKED_VERTICES shader.vert -o vert_packed.spv
+"$GLSLC" shader.frag -o frag.spv
+"$GLSLC" instanced.vert -o instanced_vert.spv
+"$GLSLC" -DPACKED_VERTICES instanced.vert -o instanced_vert_packed.spv
+"$GLSLC" cull.comp -o cull.spv
+"$GLSLC" -DOCCLUSION_CULLING cull.comp -o cull_occlusion.spv
+"$GLSLC" hiz.comp -o hiz.spv
+"$GLSLC" cluster_cull.comp -o cluster_cull.spv
+"$GLSLC" texture_sample.comp -o texture_sample.spv
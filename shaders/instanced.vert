@@ -0,0 +1,56 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject{
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+#ifdef PACKED_VERTICES
+    vec4 frustumPlanes[6];
+    mat4 previousClip;
+    vec4 positionOffset;
+    vec4 positionScale;
+#endif
+} ubo;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+#ifdef PACKED_VERTICES
+// Quantized position in xyz, octahedral normal in w
+layout(location = 0) in uvec4 inPosition;
+layout(location = 1) in vec4 inColor;
+#else
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+#endif
+// Per instance, locations 2 to 5
+layout(location = 2) in mat4 inModel;
+
+layout(location = 0) out vec3 fragColor;
+#ifdef PACKED_VERTICES
+// Not read by shader.frag, which does no lighting yet
+layout(location = 1) out vec3 fragNormal;
+
+vec3 decodeOctahedral(uint encoded){
+    vec2 e = vec2(encoded & 0xffu, encoded >> 8) / 255. * 2. - 1.;
+    vec3 n = vec3(e, 1. - abs(e.x) - abs(e.y));
+    // Unfold the lower half
+    float t = max(-n.z, 0.);
+    n.xy += vec2(n.x >= 0. ? -t : t, n.y >= 0. ? -t : t);
+    return normalize(n);
+}
+#endif
+
+void main(){
+#ifdef PACKED_VERTICES
+    vec3 position = ubo.positionOffset.xyz + vec3(inPosition.xyz) * ubo.positionScale.xyz;
+    gl_Position = ubo.proj * ubo.view * ubo.model * inModel * vec4(position, 1.);
+    fragColor = inColor.rgb;
+    fragNormal = decodeOctahedral(inPosition.w);
+#else
+    gl_Position = ubo.proj * ubo.view * ubo.model * inModel * vec4(inPosition, 1.);
+    fragColor = inColor;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,404 @@
+// Tests of the asset archive parsers, which read untrusted files: LZ4 round
+// trips, hand made blocks with overlapping matches and long literal runs,
+// truncated and corrupt blocks, a wrong decompressed size, and indices with
+// names, offsets or sizes out of range. Every input sits in a buffer of its
+// exact size, build with -fsanitize=address to catch any read past it.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tests/asset_archive_test.cpp -o asset_archive_test
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define ASSET_ARCHIVE_IMPLEMENTATION
+#include "../include/asset_archive.h"
+#include "check.h"
+
+static std::vector<uint8_t> bytes(const std::string& text)
+{
+	return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+// Decompresses into a buffer of exactly dstSize bytes
+static bool decompress(const std::vector<uint8_t>& block, size_t dstSize,
+                       std::vector<uint8_t>& out)
+{
+	out.assign(dstSize, 0);
+	return lz4Decompress(block.data(), block.size(), out.data(), dstSize);
+}
+
+static bool roundTrips(const std::vector<uint8_t>& data)
+{
+	const std::vector<uint8_t> block = lz4Compress(data.data(), data.size());
+
+	std::vector<uint8_t> out;
+	return decompress(block, data.size(), out) && out == data;
+}
+
+// Compressed then decompressed, data comes back the same
+static void testRoundTrip()
+{
+	uint32_t seed = 1;
+	auto random = [&seed](uint32_t range)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) % range;
+	};
+
+	// Every short size, around the 12 byte limit of the last match
+	for (size_t size = 0; size < 40; size++)
+	{
+		std::vector<uint8_t> zeros(size, 0);
+		std::vector<uint8_t> noise(size);
+		for (uint8_t& byte : noise)
+		{
+			byte = static_cast<uint8_t>(random(256));
+		}
+
+		CHECK(roundTrips(zeros));
+		CHECK(roundTrips(noise));
+	}
+
+	// One byte repeated: matches at offset 1 overlapping their output, with
+	// lengths continued over several bytes
+	const std::vector<uint8_t> run(100000, 'a');
+	const std::vector<uint8_t> runBlock = lz4Compress(run.data(), run.size());
+	CHECK(runBlock.size() < run.size() / 100);
+	CHECK(roundTrips(run));
+
+	// Short period patterns, offsets smaller than the match
+	std::vector<uint8_t> pattern(5000);
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		pattern[i] = static_cast<uint8_t>("abcdefg"[i % 7]);
+	}
+	CHECK(roundTrips(pattern));
+
+	// Noise does not compress: literal runs of 15 and more, up to the whole
+	// input, continued over many bytes
+	std::vector<uint8_t> noise(70000);
+	for (uint8_t& byte : noise)
+	{
+		byte = static_cast<uint8_t>(random(256));
+	}
+	CHECK(roundTrips(noise));
+
+	// Literal runs of every length between repeated words, and repeats
+	// further than the 64 KiB window
+	std::vector<uint8_t> mixed;
+	for (int i = 0; mixed.size() < 300000; i++)
+	{
+		const size_t literals = random(300);
+		for (size_t k = 0; k < literals; k++)
+		{
+			mixed.push_back(static_cast<uint8_t>(random(256)));
+		}
+		const std::string word = "word" + std::to_string(random(50));
+		mixed.insert(mixed.end(), word.begin(), word.end());
+		if (i % 100 == 99)
+		{
+			mixed.insert(mixed.end(), noise.begin(), noise.end());
+		}
+	}
+	CHECK(roundTrips(mixed));
+}
+
+// Blocks written by hand, as another encoder would
+static void testHandMadeBlocks()
+{
+	std::vector<uint8_t> out;
+
+	// "ab" then a match of 10 at offset 2, then 5 literals
+	const std::vector<uint8_t> overlap = {
+		0x26, 'a', 'b', 2, 0, 0x50, 'v', 'w', 'x', 'y', 'z'
+	};
+	CHECK(decompress(overlap, 17, out));
+	CHECK(out == bytes("ababababababvwxyz"));
+
+	// Literal run of exactly 15: the length byte after the token is 0
+	std::vector<uint8_t> fifteen = {0xf0, 0};
+	const std::string fifteenText = "0123456789abcde";
+	fifteen.insert(fifteen.end(), fifteenText.begin(), fifteenText.end());
+	CHECK(decompress(fifteen, 15, out));
+	CHECK(out == bytes(fifteenText));
+
+	// 15 + 255 + 10 literals, the length continued over two bytes
+	std::vector<uint8_t> longRun = {0xf0, 255, 10};
+	longRun.insert(longRun.end(), 280, 'q');
+	CHECK(decompress(longRun, 280, out));
+	CHECK(out == std::vector<uint8_t>(280, 'q'));
+
+	// One literal, a match of 4 + 15 + 255 + 1 at offset 1
+	const std::vector<uint8_t> longMatch = {
+		0x1f, 'm', 1, 0, 255, 1, 0x50, 'e', 'n', 'd', 'e', 'd'
+	};
+	CHECK(decompress(longMatch, 1 + 275 + 5, out));
+	CHECK(out.size() == 281 && out[0] == 'm' && out[275] == 'm' &&
+		memcmp(&out[276], "ended", 5) == 0);
+
+	// Empty block for empty data
+	CHECK(decompress(std::vector<uint8_t>{}, 0, out));
+}
+
+// Cut or damaged blocks fail, or at least stay in their buffers
+static void testCorruptBlocks()
+{
+	std::string text;
+	for (int i = 0; i < 200; i++)
+	{
+		text += "line " + std::to_string(i % 17) + " of the text\n";
+	}
+	const std::vector<uint8_t> data = bytes(text);
+	const std::vector<uint8_t> block = lz4Compress(data.data(), data.size());
+	std::vector<uint8_t> out;
+
+	// Every truncation loses output
+	for (size_t size = 0; size < block.size(); size++)
+	{
+		const std::vector<uint8_t> truncated(block.begin(),
+		                                     block.begin() + size);
+		CHECK(!decompress(truncated, data.size(), out));
+	}
+
+	// Flipped bytes: the result does not matter, the sanitizer does
+	uint32_t seed = 7;
+	for (int i = 0; i < 2000; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		std::vector<uint8_t> damaged = block;
+		damaged[(seed >> 8) % damaged.size()] ^= static_cast<uint8_t>(
+			1 + (seed >> 24) % 255);
+		decompress(damaged, data.size(), out);
+	}
+
+	// Offset 0
+	CHECK(!decompress({0x10, 'a', 0, 0, 0x50, 'a', 'a', 'a', 'a', 'a'}, 10,
+		out));
+	// Offset before the start of the output
+	CHECK(!decompress({0x10, 'a', 2, 0, 0x50, 'a', 'a', 'a', 'a', 'a'}, 10,
+		out));
+	// Offset cut after its first byte
+	CHECK(!decompress({0x10, 'a', 1}, 5, out));
+	// Literal count past the end of the block
+	CHECK(!decompress({0x50, 'a', 'b'}, 5, out));
+	// Literal length continuation missing
+	CHECK(!decompress({0xf0}, 15, out));
+	CHECK(!decompress({0xf0, 255}, 270, out));
+	// Match length continuation missing
+	CHECK(!decompress({0x1f, 'a', 1, 0}, 20, out));
+}
+
+// The block decodes to exactly dstSize bytes or fails
+static void testWrongSize()
+{
+	const std::vector<uint8_t> data = bytes(
+		"the quick brown fox jumps over the quick brown dog");
+	const std::vector<uint8_t> block = lz4Compress(data.data(), data.size());
+	std::vector<uint8_t> out;
+
+	CHECK(decompress(block, data.size(), out));
+	CHECK(!decompress(block, data.size() - 1, out));
+	CHECK(!decompress(block, data.size() + 1, out));
+	CHECK(!decompress(block, 0, out));
+	CHECK(!decompress(block, 10, out));
+
+	// A match longer than the output left
+	CHECK(!decompress({0x1f, 'a', 1, 0, 10, 0x00}, 20, out));
+}
+
+static std::vector<uint8_t> makeArchive()
+{
+	std::vector<AssetSource> sources(3);
+
+	sources[0].name = "shaders/vert.spv";
+	sources[0].format = ASSET_FORMAT_SPIRV;
+	sources[0].compression = ASSET_COMPRESSION_NONE;
+	sources[0].payload = bytes("spirv words");
+	sources[0].uncompressedSize = sources[0].payload.size();
+
+	const std::vector<uint8_t> texels(10000, 0x80);
+	sources[1].name = "textures/texture.ktx2";
+	sources[1].format = ASSET_FORMAT_KTX2;
+	sources[1].compression = ASSET_COMPRESSION_LZ4;
+	sources[1].payload = lz4Compress(texels.data(), texels.size());
+	sources[1].uncompressedSize = texels.size();
+
+	sources[2].name = "empty";
+	sources[2].format = ASSET_FORMAT_RAW;
+	sources[2].compression = ASSET_COMPRESSION_NONE;
+	sources[2].uncompressedSize = 0;
+
+	return assetWriteArchive(sources);
+}
+
+// Offsets within the index, entry 0 after the 16 byte header
+static size_t entryField(size_t entry, size_t field)
+{
+	return 16 + entry * 40 + field;
+}
+
+static void write32(std::vector<uint8_t>& archive, size_t offset,
+                    uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		archive[offset + i] = static_cast<uint8_t>(value >> i * 8);
+	}
+}
+
+static void write64(std::vector<uint8_t>& archive, size_t offset,
+                    uint64_t value)
+{
+	write32(archive, offset, static_cast<uint32_t>(value));
+	write32(archive, offset + 4, static_cast<uint32_t>(value >> 32));
+}
+
+static const char* readIndex(const std::vector<uint8_t>& archive)
+{
+	std::vector<AssetEntry> entries;
+	return assetReadIndex(archive.data(), archive.size(), entries);
+}
+
+// An archive written by assetWriteArchive() reads back
+static void testIndex()
+{
+	const std::vector<uint8_t> archive = makeArchive();
+	std::vector<AssetEntry> entries;
+
+	CHECK(assetReadIndex(archive.data(), archive.size(), entries) == nullptr);
+	CHECK(entries.size() == 3);
+
+	const AssetEntry* shader = assetFind(entries, "shaders/vert.spv");
+	CHECK(shader != nullptr);
+	if (shader != nullptr)
+	{
+		CHECK(shader->offset % ASSET_ARCHIVE_ALIGNMENT == 0);
+		CHECK(shader->format == ASSET_FORMAT_SPIRV);
+		CHECK(memcmp(archive.data() + shader->offset, "spirv words", 11) ==
+			0);
+	}
+
+	const AssetEntry* texture = assetFind(entries, "textures/texture.ktx2");
+	CHECK(texture != nullptr);
+	if (texture != nullptr)
+	{
+		std::vector<uint8_t> texels(texture->uncompressedSize);
+		CHECK(texture->compression == ASSET_COMPRESSION_LZ4);
+		CHECK(lz4Decompress(archive.data() + texture->offset, texture->size,
+			texels.data(), texels.size()));
+		CHECK(texels == std::vector<uint8_t>(10000, 0x80));
+	}
+
+	CHECK(assetFind(entries, "empty") != nullptr);
+	CHECK(assetFind(entries, "missing") == nullptr);
+	CHECK(assetFind(entries, "shaders/vert") == nullptr);
+}
+
+// Damaged indices are refused with a reason, never read out of the archive
+static void testBadIndex()
+{
+	const std::vector<uint8_t> good = makeArchive();
+	// Sorted by name: "empty", "shaders/vert.spv", "textures/texture.ktx2"
+	const size_t shader = 1;
+
+	// Every truncation of the header and of the index
+	for (size_t size = 0; size < entryField(3, 0) + 41; size++)
+	{
+		const std::vector<uint8_t> truncated(good.begin(),
+		                                     good.begin() + size);
+		CHECK(readIndex(truncated) != nullptr);
+	}
+
+	std::vector<uint8_t> archive = good;
+	archive[0] = 'X';
+	CHECK(readIndex(archive) != nullptr);
+
+	archive = good;
+	write32(archive, 4, ASSET_ARCHIVE_VERSION + 1);
+	CHECK(readIndex(archive) != nullptr);
+
+	// More entries than the file holds
+	archive = good;
+	write32(archive, 8, 0xffffffff);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Name table past the end
+	archive = good;
+	write32(archive, 12, 0xffffffff);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Name offset, then length, past the name table
+	archive = good;
+	write32(archive, entryField(shader, 32), 0xfffffff0);
+	CHECK(readIndex(archive) != nullptr);
+
+	archive = good;
+	write32(archive, entryField(shader, 36), 0xffffffff);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Payload offset past the end, aligned or not
+	archive = good;
+	write64(archive, entryField(shader, 0), good.size() + 4096);
+	CHECK(readIndex(archive) != nullptr);
+
+	archive = good;
+	write64(archive, entryField(shader, 0), UINT64_MAX - 4095);
+	CHECK(readIndex(archive) != nullptr);
+
+	archive = good;
+	write64(archive, entryField(shader, 0), 4097);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Payload size past the end, and one that wraps offset + size around
+	archive = good;
+	write64(archive, entryField(shader, 8), good.size());
+	CHECK(readIndex(archive) != nullptr);
+
+	archive = good;
+	write64(archive, entryField(shader, 8), UINT64_MAX);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Stored size differing from the uncompressed one
+	archive = good;
+	write64(archive, entryField(shader, 16), 12);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Unknown compression
+	archive = good;
+	write32(archive, entryField(shader, 28), 7);
+	CHECK(readIndex(archive) != nullptr);
+
+	// Two entries swapped in the index are no longer sorted
+	archive = good;
+	std::swap_ranges(archive.begin() + entryField(0, 0),
+	                 archive.begin() + entryField(1, 0),
+	                 archive.begin() + entryField(1, 0));
+	CHECK(readIndex(archive) != nullptr);
+
+	// Flipped bytes in the index: the result does not matter, the
+	// sanitizer does
+	uint32_t seed = 3;
+	for (int i = 0; i < 5000; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		archive = good;
+		archive[(seed >> 8) % entryField(3, 0)] ^= static_cast<uint8_t>(
+			1 + (seed >> 24) % 255);
+		readIndex(archive);
+	}
+}
+
+int main()
+{
+	testRoundTrip();
+	testHandMadeBlocks();
+	testCorruptBlocks();
+	testWrongSize();
+	testIndex();
+	testBadIndex();
+
+	return checkResult("asset_archive_test");
+}
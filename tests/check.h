@@ -0,0 +1,37 @@
+// Checks shared by the tests under tests/. Each test is a program of its own
+// that prints the failed checks and exits with EXIT_FAILURE if there were any.
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+static int s_checkFailures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+			       #condition); \
+			s_checkFailures++; \
+		} \
+	} \
+	while (false)
+
+// Returned by main: prints the outcome of the checks of the test
+static int checkResult(const char* test)
+{
+	if (s_checkFailures > 0)
+	{
+		printf("%s: %d checks failed\n", test, s_checkFailures);
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: passed\n", test);
+	return EXIT_SUCCESS;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,301 @@
+// Tests of the meshlet builder and of the cluster bounds: meshlet limits,
+// every triangle in exactly one meshlet, local indices in range, spheres
+// holding their vertices and cones culling back facing clusters only.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tests/meshlet_test.cpp -o meshlet_test
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define MESHLET_IMPLEMENTATION
+#include "../include/meshlet.h"
+#include "check.h"
+
+// Position and a normal, the bounds only read the position
+struct TestVertex
+{
+	float position[3];
+	float normal[3];
+};
+
+struct TestMesh
+{
+	std::vector<TestVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// UV sphere of radius 1, counter-clockwise seen from outside
+static TestMesh makeSphere(uint32_t rings, uint32_t segments)
+{
+	TestMesh mesh;
+	const float pi = 3.14159265f;
+
+	for (uint32_t ring = 0; ring <= rings; ring++)
+	{
+		const float theta = pi * ring / rings;
+		for (uint32_t segment = 0; segment <= segments; segment++)
+		{
+			const float phi = 2.0f * pi * segment / segments;
+			const float p[3] = {
+				std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi),
+				std::cos(theta)
+			};
+			mesh.vertices.push_back({{p[0], p[1], p[2]}, {p[0], p[1], p[2]}});
+		}
+	}
+
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			const uint32_t a = ring * (segments + 1) + segment;
+			const uint32_t b = a + segments + 1;
+			mesh.indices.insert(mesh.indices.end(), {a, b, a + 1});
+			mesh.indices.insert(mesh.indices.end(), {a + 1, b, b + 1});
+		}
+	}
+
+	return mesh;
+}
+
+static const float* positionOf(const TestMesh& mesh, uint32_t vertex)
+{
+	return mesh.vertices[vertex].position;
+}
+
+static void checkMeshlets(const TestMesh& mesh, const MeshletData& data,
+                          size_t maxVertices, size_t maxTriangles)
+{
+	std::vector<std::array<uint32_t, 3>> triangles;
+
+	for (const Meshlet& meshlet : data.meshlets)
+	{
+		CHECK(meshlet.vertexCount > 0 && meshlet.vertexCount <= maxVertices);
+		CHECK(meshlet.triangleCount > 0 &&
+			meshlet.triangleCount <= maxTriangles);
+		CHECK(meshlet.vertexOffset + meshlet.vertexCount <=
+			data.vertices.size());
+		CHECK(meshlet.triangleOffset + meshlet.triangleCount * 3 <=
+			data.triangles.size());
+
+		// Each mesh vertex once per meshlet
+		std::vector<uint32_t> vertices(
+			data.vertices.begin() + meshlet.vertexOffset,
+			data.vertices.begin() + meshlet.vertexOffset + meshlet.vertexCount);
+		std::sort(vertices.begin(), vertices.end());
+		CHECK(std::adjacent_find(vertices.begin(), vertices.end()) ==
+			vertices.end());
+
+		for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+		{
+			std::array<uint32_t, 3> triangle;
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint8_t local = data.triangles[meshlet.triangleOffset + i *
+					3 + corner];
+				CHECK(local < meshlet.vertexCount);
+				triangle[corner] = data.vertices[meshlet.vertexOffset + local];
+			}
+			triangles.push_back(triangle);
+		}
+	}
+
+	// The input triangles, each exactly once and with its corners in order
+	std::vector<std::array<uint32_t, 3>> expected;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		expected.push_back({
+			mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]
+		});
+	}
+	std::sort(triangles.begin(), triangles.end());
+	std::sort(expected.begin(), expected.end());
+	CHECK(triangles == expected);
+}
+
+static void testLimits()
+{
+	const TestMesh mesh = makeSphere(40, 64);
+
+	for (const auto& limits : {
+		     std::array<size_t, 2>{MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES},
+		     std::array<size_t, 2>{3, 1},
+		     std::array<size_t, 2>{32, 16},
+		     std::array<size_t, 2>{255, 512}
+	     })
+	{
+		MeshletData data;
+		const size_t count = buildMeshlets(data, mesh.indices.data(),
+		                                   mesh.indices.size(),
+		                                   mesh.vertices.size(), limits[0],
+		                                   limits[1]);
+		CHECK(count == data.meshlets.size());
+		checkMeshlets(mesh, data, limits[0], limits[1]);
+	}
+
+	// Appending keeps the earlier meshlets and offsets
+	MeshletData data;
+	buildMeshlets(data, mesh.indices.data(), mesh.indices.size(),
+	              mesh.vertices.size());
+	const size_t first = data.meshlets.size();
+	const size_t added = buildMeshlets(data, mesh.indices.data(),
+	                                   mesh.indices.size(),
+	                                   mesh.vertices.size());
+	CHECK(added == first);
+	CHECK(data.meshlets[first].vertexOffset == data.meshlets[first - 1].
+		vertexOffset + data.meshlets[first - 1].vertexCount);
+}
+
+static void testDegenerateInput()
+{
+	TestMesh mesh;
+	mesh.vertices.resize(8);
+
+	// No triangles
+	MeshletData data;
+	CHECK(buildMeshlets(data, mesh.indices.data(), 0, 8) == 0);
+	CHECK(data.meshlets.empty());
+
+	// Repeated corners count as one vertex, a trailing partial triangle is
+	// ignored
+	mesh.indices = {0, 0, 0, 1, 1, 2, 3, 4, 3, 5, 6, 7, 5, 6};
+	CHECK(buildMeshlets(data, mesh.indices.data(), mesh.indices.size(), 8) ==
+		1);
+	CHECK(data.meshlets[0].vertexCount == 8);
+	CHECK(data.meshlets[0].triangleCount == 4);
+	mesh.indices.resize(12);
+	checkMeshlets(mesh, data, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+
+	// Bounds of a cluster of collapsed triangles
+	for (TestVertex& vertex : mesh.vertices)
+	{
+		vertex = {{1.0f, 2.0f, 3.0f}, {0.0f, 0.0f, 1.0f}};
+	}
+	const MeshletBounds bounds = computeMeshletBounds(
+		data, data.meshlets[0], mesh.vertices[0].position, sizeof(TestVertex));
+	CHECK(bounds.radius == 0.0f);
+	CHECK(bounds.center[0] == 1.0f && bounds.center[1] == 2.0f &&
+		bounds.center[2] == 3.0f);
+	CHECK(bounds.coneCutoff == 1.0f);
+}
+
+// Seen from position, every triangle of the meshlet faces away or is
+// degenerate
+static bool backFacing(const TestMesh& mesh, const MeshletData& data,
+                       const Meshlet& meshlet, const float* position)
+{
+	for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+	{
+		const float* p[3];
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			p[corner] = positionOf(mesh, data.vertices[meshlet.vertexOffset +
+				data.triangles[meshlet.triangleOffset + i * 3 + corner]]);
+		}
+
+		const float ab[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1],
+		                     p[1][2] - p[0][2]};
+		const float ac[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1],
+		                     p[2][2] - p[0][2]};
+		const float normal[3] = {
+			ab[1] * ac[2] - ab[2] * ac[1],
+			ab[2] * ac[0] - ab[0] * ac[2],
+			ab[0] * ac[1] - ab[1] * ac[0]
+		};
+
+		const float facing = normal[0] * (position[0] - p[0][0]) + normal[1] *
+			(position[1] - p[0][1]) + normal[2] * (position[2] - p[0][2]);
+		if (facing > 1e-5f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void testBounds()
+{
+	const TestMesh mesh = makeSphere(32, 48);
+	MeshletData data;
+	buildMeshlets(data, mesh.indices.data(), mesh.indices.size(),
+	              mesh.vertices.size());
+
+	uint32_t seed = 3;
+	auto random = [&seed]
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / (1 << 24) * 2.0f - 1.0f;
+	};
+
+	size_t culled = 0;
+	size_t backFacingViews = 0;
+
+	for (const Meshlet& meshlet : data.meshlets)
+	{
+		const MeshletBounds bounds = computeMeshletBounds(
+			data, meshlet, mesh.vertices[0].position, sizeof(TestVertex));
+
+		// The sphere holds every vertex of the meshlet
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			const float* p = positionOf(mesh, data.vertices[meshlet.
+				vertexOffset + i]);
+			const float dx = p[0] - bounds.center[0];
+			const float dy = p[1] - bounds.center[1];
+			const float dz = p[2] - bounds.center[2];
+			CHECK(std::sqrt(dx * dx + dy * dy + dz * dz) <= bounds.radius *
+				1.0001f + 1e-6f);
+		}
+
+		const float axisLength = std::sqrt(bounds.coneAxis[0] * bounds.
+			coneAxis[0] + bounds.coneAxis[1] * bounds.coneAxis[1] + bounds.
+			coneAxis[2] * bounds.coneAxis[2]);
+		CHECK(std::fabs(axisLength - 1.0f) < 1e-4f);
+		CHECK(bounds.coneCutoff >= 0.0f && bounds.coneCutoff <= 1.0f);
+
+		// Cameras around the sphere: the cone test of cluster_cull.comp only
+		// rejects clusters that are back facing from there
+		for (int view = 0; view < 200; view++)
+		{
+			const float camera[3] = {
+				random() * 4.0f, random() * 4.0f, random() * 4.0f
+			};
+			const float toApex[3] = {
+				bounds.coneApex[0] - camera[0], bounds.coneApex[1] - camera[1],
+				bounds.coneApex[2] - camera[2]
+			};
+			const float distance = std::sqrt(toApex[0] * toApex[0] + toApex[1] *
+				toApex[1] + toApex[2] * toApex[2]);
+			const bool coneCulled = distance > 0.0f && (toApex[0] * bounds.
+				coneAxis[0] + toApex[1] * bounds.coneAxis[1] + toApex[2] *
+				bounds.coneAxis[2]) / distance > bounds.coneCutoff;
+
+			const bool facingAway = backFacing(mesh, data, meshlet, camera);
+			backFacingViews += facingAway;
+			if (coneCulled)
+			{
+				CHECK(facingAway);
+				culled++;
+			}
+		}
+	}
+
+	// The cones are tight enough to cull a good share of the back facing
+	// views, the test above is not vacuous
+	CHECK(culled > backFacingViews / 4);
+	printf("  %zu of %zu back facing views culled by the cones\n", culled,
+	       backFacingViews);
+}
+
+int main()
+{
+	testLimits();
+	testDegenerateInput();
+	testBounds();
+
+	return checkResult("meshlet_test");
+}
@@ -0,0 +1,304 @@
+// Tests of the device memory range allocator, without a device: resources
+// are described by the size and alignment their VkMemoryRequirements would
+// give, and placed in one block the way allocateMemory() in Cube.cpp does.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tests/range_allocator_test.cpp -o range_allocator_test
+
+#include <cstdint>
+#include <vector>
+
+#define RANGE_ALLOCATOR_IMPLEMENTATION
+#include "../include/range_allocator.h"
+#include "check.h"
+
+// What allocateMemory() reads of VkMemoryRequirements
+struct FakeMemoryRequirements
+{
+	uint64_t size;
+	uint64_t alignment;
+};
+
+struct Placement
+{
+	uint64_t offset;
+	uint64_t size;
+	bool optimalImage;
+};
+
+static bool place(std::vector<MemoryRange>& freeRanges,
+                  const FakeMemoryRequirements& requirements,
+                  bool optimalImage, uint64_t granularity,
+                  Placement& placement)
+{
+	uint64_t size = requirements.size;
+	uint64_t alignment = requirements.alignment;
+	if (optimalImage)
+	{
+		rangeImageGranularity(granularity, size, alignment);
+	}
+
+	placement.size = size;
+	placement.optimalImage = optimalImage;
+	return allocateRange(freeRanges, size, alignment, placement.offset);
+}
+
+// Free ranges sorted, apart and within the block, and adding up with the
+// allocations to the block size
+static void checkFreeList(const std::vector<MemoryRange>& freeRanges,
+                          const std::vector<Placement>& placements,
+                          uint64_t blockSize)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < freeRanges.size(); i++)
+	{
+		CHECK(freeRanges[i].size > 0);
+		CHECK(freeRanges[i].offset + freeRanges[i].size <= blockSize);
+		if (i > 0)
+		{
+			// Touching ranges would have been merged
+			CHECK(freeRanges[i - 1].offset + freeRanges[i - 1].size <
+				freeRanges[i].offset);
+		}
+		total += freeRanges[i].size;
+	}
+
+	for (const Placement& placement : placements)
+	{
+		total += placement.size;
+	}
+	CHECK(total == blockSize);
+}
+
+static bool overlap(const Placement& a, const Placement& b)
+{
+	return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+static void testAlignment()
+{
+	const uint64_t blockSize = 1 << 20;
+	std::vector<MemoryRange> freeRanges = {{0, blockSize}};
+	std::vector<Placement> placements;
+
+	for (uint64_t alignment = 1; alignment <= 4096; alignment *= 2)
+	{
+		for (uint64_t size : {1ull, 3ull, 100ull, 256ull})
+		{
+			Placement placement;
+			CHECK(place(freeRanges, {size, alignment}, false, 1, placement));
+			CHECK(placement.offset % alignment == 0);
+
+			for (const Placement& other : placements)
+			{
+				CHECK(!overlap(placement, other));
+			}
+			placements.push_back(placement);
+		}
+	}
+
+	// The alignment padding is left free, small allocations fill it
+	checkFreeList(freeRanges, placements, blockSize);
+	CHECK(freeRanges.size() > 1);
+	Placement small;
+	CHECK(place(freeRanges, {1, 1}, false, 1, small));
+	CHECK(small.offset < placements.back().offset);
+}
+
+static void testGranularity()
+{
+	const uint64_t blockSize = 1 << 20;
+	const uint64_t granularity = 4096;
+	std::vector<MemoryRange> freeRanges = {{0, blockSize}};
+	std::vector<Placement> placements;
+
+	// Buffers and optimal images of sizes and alignments that do not fill
+	// whole pages
+	const struct
+	{
+		FakeMemoryRequirements requirements;
+		bool optimalImage;
+	} resources[] = {
+		{{100, 16}, false},
+		{{5000, 256}, true},
+		{{300, 64}, false},
+		{{4096 * 3 + 1, 1024}, true},
+		{{64, 4}, false},
+		{{10, 512}, true},
+		{{8192, 256}, false},
+	};
+
+	for (const auto& resource : resources)
+	{
+		Placement placement;
+		CHECK(place(freeRanges, resource.requirements, resource.optimalImage,
+		            granularity, placement));
+		CHECK(placement.offset % resource.requirements.alignment == 0);
+		CHECK(placement.size >= resource.requirements.size);
+		placements.push_back(placement);
+	}
+
+	checkFreeList(freeRanges, placements, blockSize);
+
+	// No page holds both a linear resource and an optimal image
+	for (const Placement& a : placements)
+	{
+		for (const Placement& b : placements)
+		{
+			if (!a.optimalImage || b.optimalImage)
+			{
+				continue;
+			}
+
+			const uint64_t imageFirstPage = a.offset / granularity;
+			const uint64_t imageLastPage = (a.offset + a.size - 1) /
+				granularity;
+			const uint64_t bufferFirstPage = b.offset / granularity;
+			const uint64_t bufferLastPage = (b.offset + b.size - 1) /
+				granularity;
+			CHECK(bufferLastPage < imageFirstPage ||
+				imageLastPage < bufferFirstPage);
+		}
+	}
+
+	// Freed images give back whole pages
+	for (const Placement& placement : placements)
+	{
+		if (placement.optimalImage)
+		{
+			CHECK(placement.offset % granularity == 0);
+			CHECK(placement.size % granularity == 0);
+		}
+	}
+}
+
+static void testBestFit()
+{
+	std::vector<MemoryRange> freeRanges = {
+		{0, 100}, {200, 50}, {300, 70}, {400, 64}
+	};
+
+	// The smallest range it fits in, not the first one
+	uint64_t offset;
+	CHECK(allocateRange(freeRanges, 60, 1, offset));
+	CHECK(offset == 400);
+	CHECK(allocateRange(freeRanges, 50, 1, offset));
+	CHECK(offset == 200);
+
+	// Alignment counts: 67 bytes fit in {300, 70} but not once aligned to 16
+	// bytes at 304
+	CHECK(allocateRange(freeRanges, 67, 16, offset));
+	CHECK(offset == 0);
+	CHECK(!allocateRange(freeRanges, 67, 16, offset));
+	CHECK(allocateRange(freeRanges, 67, 4, offset));
+	CHECK(offset == 300);
+
+	// Left are {67, 33}, {367, 3} and {460, 4}
+	CHECK(freeRanges.size() == 3);
+	CHECK(!allocateRange(freeRanges, 34, 1, offset));
+	CHECK(allocateRange(freeRanges, 4, 1, offset));
+	CHECK(offset == 460);
+	CHECK(!allocateRange(freeRanges, 1, 1024, offset));
+}
+
+static void testMerging()
+{
+	const uint64_t blockSize = 1000;
+	std::vector<MemoryRange> freeRanges = {{0, blockSize}};
+
+	uint64_t offsets[4];
+	for (uint64_t& offset : offsets)
+	{
+		CHECK(allocateRange(freeRanges, 100, 1, offset));
+	}
+	CHECK(freeRanges.size() == 1);
+	CHECK(freeRanges[0].offset == 400);
+
+	// Apart from everything
+	freeRange(freeRanges, offsets[1], 100);
+	CHECK(freeRanges.size() == 2);
+
+	// Merged with the next range
+	freeRange(freeRanges, offsets[3], 100);
+	CHECK(freeRanges.size() == 2);
+	CHECK(freeRanges[1].offset == 300 && freeRanges[1].size == 700);
+
+	// Merged with the previous range
+	freeRange(freeRanges, offsets[0], 100);
+	CHECK(freeRanges.size() == 2);
+	CHECK(freeRanges[0].offset == 0 && freeRanges[0].size == 200);
+
+	// Merged with both, the block is whole again
+	freeRange(freeRanges, offsets[2], 100);
+	CHECK(freeRanges.size() == 1);
+	CHECK(freeRanges[0].offset == 0 && freeRanges[0].size == blockSize);
+}
+
+// Allocations and frees in random order keep the free list consistent and
+// every allocation apart, and freeing everything leaves one range
+static void testRandom()
+{
+	const uint64_t blockSize = 1 << 24;
+	const uint64_t granularity = 1024;
+	std::vector<MemoryRange> freeRanges = {{0, blockSize}};
+	std::vector<Placement> placements;
+
+	uint32_t seed = 1;
+	auto random = [&seed](uint32_t range)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) % range;
+	};
+
+	for (int step = 0; step < 20000; step++)
+	{
+		if (placements.empty() || random(3) != 0)
+		{
+			const FakeMemoryRequirements requirements = {
+				1 + random(100000), 1ull << random(13)
+			};
+			Placement placement;
+			if (place(freeRanges, requirements, random(2) == 0, granularity,
+			          placement))
+			{
+				CHECK(placement.offset % requirements.alignment == 0);
+				for (const Placement& other : placements)
+				{
+					CHECK(!overlap(placement, other));
+				}
+				placements.push_back(placement);
+			}
+		}
+		else
+		{
+			const size_t i = random(static_cast<uint32_t>(placements.size()));
+			freeRange(freeRanges, placements[i].offset, placements[i].size);
+			placements.erase(placements.begin() + i);
+		}
+
+		if (step % 1000 == 0)
+		{
+			checkFreeList(freeRanges, placements, blockSize);
+		}
+	}
+
+	checkFreeList(freeRanges, placements, blockSize);
+
+	for (const Placement& placement : placements)
+	{
+		freeRange(freeRanges, placement.offset, placement.size);
+	}
+	CHECK(freeRanges.size() == 1);
+	CHECK(freeRanges[0].offset == 0 && freeRanges[0].size == blockSize);
+}
+
+int main()
+{
+	testAlignment();
+	testGranularity();
+	testBestFit();
+	testMerging();
+	testRandom();
+
+	return checkResult("range_allocator_test");
+}
@@ -0,0 +1,347 @@
+// Tests of the texture residency policy, without a device: level sizes and
+// the tail of block textures, the level wanted from a screen footprint, and
+// a camera travelling down a corridor lined with textures and back again,
+// the plan of every frame checked against what planResidency() promises.
+// Level changes land at once, this tests the policy and not the uploads.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tests/texture_residency_test.cpp -o texture_residency_test
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define TEXTURE_RESIDENCY_IMPLEMENTATION
+#include "../include/texture_residency.h"
+#include "check.h"
+
+#define SIMULATED_TEXTURE_COUNT 256
+#define SIMULATED_TEXTURE_SIZE 2048
+#define SIMULATED_FRAMES 4000
+
+static const double MiB = 1024.0 * 1024.0;
+
+// Every level down to 1x1
+static uint32_t levelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+	{
+		levels++;
+	}
+	return levels;
+}
+
+// What planResidency() promises, checked on the targets it returned: within
+// budget when the tails fit, no tail level evicted, levels more detailed
+// than wanted evicted before wanted ones, and each kind taken from the least
+// recently used textures first. Returns nullptr when all of it holds
+static const char* residencyPlanError(const TextureResidency* textures,
+                                      size_t count, uint64_t budget,
+                                      const uint32_t* targets, uint64_t total)
+{
+	uint64_t tails = 0;
+	uint64_t planned = 0;
+	bool wantedEvicted = false;
+	bool extraKept = false;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const TextureResidency& texture = textures[i];
+		tails += residentBytes(texture, texture.tailLevel);
+		planned += residentBytes(texture, targets[i]);
+
+		if (targets[i] > texture.tailLevel)
+		{
+			return "a tail level was evicted";
+		}
+		wantedEvicted |= targets[i] > texture.wantedLevel;
+		extraKept |= targets[i] < texture.wantedLevel;
+	}
+
+	if (planned != total)
+	{
+		return "the returned total is not the bytes of the targets";
+	}
+	if (total > budget && tails <= budget)
+	{
+		return "over budget while the tails fit";
+	}
+	if (wantedEvicted && extraKept)
+	{
+		return "wanted levels evicted while extra levels are kept";
+	}
+
+	// Whichever texture lost levels of a kind, the textures used before it
+	// have none of that kind left: none used before the most recently used
+	// of those that lost some
+	uint64_t extraEvictedFrame = 0;
+	uint64_t wantedEvictedFrame = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const TextureResidency& texture = textures[i];
+		// Levels kept from before and more detailed than wanted
+		if (texture.residentLevel < texture.wantedLevel && targets[i] >
+			texture.residentLevel)
+		{
+			extraEvictedFrame = std::max(extraEvictedFrame,
+			                             texture.lastUsedFrame);
+		}
+		if (targets[i] > texture.wantedLevel)
+		{
+			wantedEvictedFrame = std::max(wantedEvictedFrame,
+			                              texture.lastUsedFrame);
+		}
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const TextureResidency& texture = textures[i];
+		if (texture.lastUsedFrame < extraEvictedFrame && targets[i] < texture.
+			wantedLevel)
+		{
+			return "extra levels evicted before older textures' ones";
+		}
+		if (texture.lastUsedFrame < wantedEvictedFrame && targets[i] < texture.
+			tailLevel)
+		{
+			return "wanted levels evicted before older textures' ones";
+		}
+	}
+
+	return nullptr;
+}
+
+// Level sizes of BC7 and BC1 textures, and the levels of their tail
+static void testBlockTexture()
+{
+	const TextureResidency bc7 = blockTextureResidency(2048, 2048, 12, 16);
+
+	CHECK(bc7.levelSizes.size() == 12);
+	CHECK(bc7.levelSizes[0] == 2048ull * 2048);
+	CHECK(bc7.levelSizes[1] == 1024ull * 1024);
+	// 4x4 blocks down to 1x1
+	CHECK(bc7.levelSizes[10] == 16 && bc7.levelSizes[11] == 16);
+	// 128x128 and smaller
+	CHECK(bc7.tailLevel == 4);
+	CHECK(bc7.residentLevel == bc7.tailLevel);
+	CHECK(bc7.wantedLevel == bc7.tailLevel);
+
+	// Not square, the largest side decides
+	const TextureResidency bc1 = blockTextureResidency(512, 64, 10, 8);
+	CHECK(bc1.levelSizes[0] == 128ull * 16 * 8);
+	CHECK(bc1.levelSizes[3] == 16ull * 2 * 8);
+	CHECK(bc1.tailLevel == 2);
+
+	// Already small enough, all of it is the tail
+	const TextureResidency small = blockTextureResidency(64, 64, 7, 16);
+	CHECK(small.tailLevel == 0);
+	CHECK(residentBytes(small, 0) == residentBytes(small, small.tailLevel));
+}
+
+// Level of about one texel per pixel, clamped to the chain
+static void testFootprint()
+{
+	CHECK(footprintMipLevel(2048, 2048, 12, 2048.0f) == 0);
+	CHECK(footprintMipLevel(2048, 2048, 12, 4096.0f) == 0);
+	CHECK(footprintMipLevel(2048, 2048, 12, 1024.0f) == 1);
+	CHECK(footprintMipLevel(2048, 2048, 12, 700.0f) == 1);
+	CHECK(footprintMipLevel(2048, 2048, 12, 16.0f) == 7);
+	CHECK(footprintMipLevel(2048, 2048, 12, 0.5f) == 11);
+	CHECK(footprintMipLevel(2048, 2048, 12, 0.0f) == 11);
+	CHECK(footprintMipLevel(2048, 256, 12, 256.0f) == 3);
+
+	// Feedback never wants less than the tail
+	TextureResidency texture = blockTextureResidency(2048, 2048, 12, 16);
+	noteTextureUse(texture, 9, 5);
+	CHECK(texture.wantedLevel == texture.tailLevel);
+	CHECK(texture.lastUsedFrame == 5);
+	noteTextureUse(texture, 2, 6);
+	CHECK(texture.wantedLevel == 2);
+}
+
+// Three textures in a small budget: extra levels go first, then the wanted
+// ones, each from the least recently used texture first
+static void testEvictionOrder()
+{
+	std::vector<TextureResidency> textures(3, blockTextureResidency(
+		                                       512, 512, 10, 16));
+	std::vector<uint32_t> targets(textures.size());
+	const uint32_t tail = textures[0].tailLevel;
+	const uint64_t tails = residentBytes(textures[0], tail) * 3;
+
+	// Everything fits
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		noteTextureUse(textures[i], 0, 10 + i);
+	}
+	uint64_t total = planResidency(textures.data(), textures.size(),
+	                               UINT64_MAX, targets.data());
+	CHECK(targets == std::vector<uint32_t>(3, 0));
+	CHECK(total == residentBytes(textures[0], 0) * 3);
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		textures[i].residentLevel = targets[i];
+	}
+
+	// Texture 0 no longer needs level 0, the other two still do: its extra
+	// level goes before any wanted one, even though it was used last
+	noteTextureUse(textures[0], 1, 20);
+	const uint64_t budget = total - textures[0].levelSizes[0];
+	total = planResidency(textures.data(), textures.size(), budget,
+	                      targets.data());
+	CHECK(residencyPlanError(textures.data(), textures.size(), budget,
+		targets.data(), total) == nullptr);
+	CHECK(targets[0] == 1 && targets[1] == 0 && targets[2] == 0);
+
+	// Tighter: wanted levels of the least recently used, texture 1, go next
+	total = planResidency(textures.data(), textures.size(),
+	                      budget - textures[1].levelSizes[0], targets.data());
+	CHECK(targets[0] == 1 && targets[1] == 1 && targets[2] == 0);
+
+	// Only the tails fit, none of them is evicted
+	total = planResidency(textures.data(), textures.size(), tails,
+	                      targets.data());
+	CHECK(targets == std::vector<uint32_t>(3, tail));
+	CHECK(total == tails);
+
+	// Not even the tails fit: over budget, still no tail evicted
+	total = planResidency(textures.data(), textures.size(), tails / 2,
+	                      targets.data());
+	CHECK(targets == std::vector<uint32_t>(3, tail));
+	CHECK(total == tails);
+}
+
+// Camera passing 256 2048x2048 BC7 textures and back, for several budgets.
+// Every frame's plan keeps its promises, and the more memory the sharper
+static void testCorridor()
+{
+	// 1080 lines with a 45 degree field of view
+	const float focal = 540.0f / std::tan(22.5f * 3.14159265f / 180.0f);
+	// World units between two textures, across each one, and seen up to
+	const float spacing = 3.0f;
+	const float textureSize = 2.0f;
+	const float viewDistance = 60.0f;
+	const float corridorLength = SIMULATED_TEXTURE_COUNT * spacing;
+
+	const uint32_t levels = levelCount(SIMULATED_TEXTURE_SIZE,
+	                                   SIMULATED_TEXTURE_SIZE);
+	// BC7 blocks
+	const TextureResidency initial = blockTextureResidency(
+		SIMULATED_TEXTURE_SIZE, SIMULATED_TEXTURE_SIZE, levels, 16);
+
+	printf("  %d BC7 textures of %dx%d (%.0f MiB), %d frames\n",
+	       SIMULATED_TEXTURE_COUNT, SIMULATED_TEXTURE_SIZE,
+	       SIMULATED_TEXTURE_SIZE,
+	       residentBytes(initial, 0) * SIMULATED_TEXTURE_COUNT / MiB,
+	       SIMULATED_FRAMES);
+	printf("  budget MiB   peak MiB   streamed MiB   evicted MiB   blurry %%\n");
+
+	double lastBlurry = 100.0;
+
+	for (uint32_t budgetMiB : {8u, 16u, 32u, 64u})
+	{
+		const uint64_t budget = static_cast<uint64_t>(budgetMiB) * 1024 * 1024;
+
+		std::vector<TextureResidency> textures(SIMULATED_TEXTURE_COUNT,
+		                                       initial);
+		std::vector<uint32_t> targets(SIMULATED_TEXTURE_COUNT);
+
+		uint64_t peak = 0;
+		uint64_t streamed = 0;
+		uint64_t evicted = 0;
+		// Visible textures over all frames, and those short of their wanted
+		// levels
+		uint64_t visible = 0;
+		uint64_t blurry = 0;
+		const char* error = nullptr;
+
+		for (uint64_t frame = 1; frame <= SIMULATED_FRAMES && !error; frame++)
+		{
+			const float phase = static_cast<float>(frame) / SIMULATED_FRAMES;
+			const float camera = corridorLength * (phase < 0.5f
+				                                       ? phase * 2.0f
+				                                       : (1.0f - phase) * 2.0f);
+
+			for (size_t i = 0; i < textures.size(); i++)
+			{
+				const float distance = std::fabs(i * spacing - camera);
+				if (distance > viewDistance)
+				{
+					continue;
+				}
+
+				const float pixels = textureSize * focal / std::max(distance,
+					1.0f);
+				noteTextureUse(textures[i], footprintMipLevel(
+					               SIMULATED_TEXTURE_SIZE,
+					               SIMULATED_TEXTURE_SIZE, levels, pixels),
+				               frame);
+			}
+
+			const uint64_t total = planResidency(
+				textures.data(), textures.size(), budget, targets.data());
+
+			error = residencyPlanError(textures.data(), textures.size(),
+			                           budget, targets.data(), total);
+			if (error != nullptr)
+			{
+				printf("  %u MiB, frame %llu: %s\n", budgetMiB,
+				       static_cast<unsigned long long>(frame), error);
+			}
+
+			for (size_t i = 0; i < textures.size(); i++)
+			{
+				TextureResidency& texture = textures[i];
+				const uint64_t before = residentBytes(texture,
+				                                      texture.residentLevel);
+				const uint64_t after = residentBytes(texture, targets[i]);
+
+				if (after > before)
+				{
+					streamed += after - before;
+				}
+				else
+				{
+					evicted += before - after;
+				}
+				texture.residentLevel = targets[i];
+
+				if (texture.lastUsedFrame == frame)
+				{
+					visible++;
+					blurry += texture.residentLevel > texture.wantedLevel;
+				}
+			}
+
+			peak = std::max(peak, total);
+		}
+
+		const double blurryShare = visible > 0
+			                           ? 100.0 * blurry / visible
+			                           : 0.0;
+		printf("  %-10u %10.1f %14.1f %13.1f %10.2f\n", budgetMiB, peak / MiB,
+		       streamed / MiB, evicted / MiB, blurryShare);
+
+		CHECK(error == nullptr);
+		CHECK(peak <= budget);
+		CHECK(visible > 0);
+		CHECK(streamed > 0);
+		CHECK(blurryShare <= lastBlurry);
+		lastBlurry = blurryShare;
+	}
+
+	// The largest budget holds every visible texture's wanted levels
+	CHECK(lastBlurry == 0.0);
+}
+
+int main()
+{
+	testBlockTexture();
+	testFootprint();
+	testEvictionOrder();
+	testCorridor();
+
+	return checkResult("texture_residency_test");
+}
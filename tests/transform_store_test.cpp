@@ -0,0 +1,184 @@
+// Tests of the SoA transform kernels against a direct composition of
+// translate * rotate * scale, for object counts that end in each of the
+// AVX, SSE and scalar loops and for aligned and unaligned destinations.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tests/transform_store_test.cpp -o transform_store_test
+// and with -mavx added to test the AVX kernel as well.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define TRANSFORM_STORE_IMPLEMENTATION
+#include "../include/transform_store.h"
+#include "check.h"
+
+struct Quaternion
+{
+	float x, y, z, w;
+};
+
+static Quaternion multiply(const Quaternion& a, const Quaternion& b)
+{
+	return {
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+	};
+}
+
+// v rotated by q, as q * v * conjugate(q)
+static void rotate(const Quaternion& q, const float* v, float* out)
+{
+	const Quaternion p = multiply(multiply(q, {v[0], v[1], v[2], 0.0f}),
+	                              {-q.x, -q.y, -q.z, q.w});
+	out[0] = p.x;
+	out[1] = p.y;
+	out[2] = p.z;
+}
+
+// Column j of the model matrix is the rotated and scaled unit axis j, the
+// last column the position
+static void referenceMatrix(const TransformStore& transforms, size_t i,
+                            float* out)
+{
+	const Quaternion q = {
+		transforms.rotationX[i], transforms.rotationY[i],
+		transforms.rotationZ[i], transforms.rotationW[i]
+	};
+	const float scale[3] = {
+		transforms.scaleX[i], transforms.scaleY[i], transforms.scaleZ[i]
+	};
+
+	for (int column = 0; column < 3; column++)
+	{
+		float axis[3] = {0.0f, 0.0f, 0.0f};
+		axis[column] = scale[column];
+		rotate(q, axis, out + column * 4);
+		out[column * 4 + 3] = 0.0f;
+	}
+
+	out[12] = transforms.positionX[i];
+	out[13] = transforms.positionY[i];
+	out[14] = transforms.positionZ[i];
+	out[15] = 1.0f;
+}
+
+// Spread out, unit rotations and non uniform scales
+static TransformStore makeTransforms(size_t count)
+{
+	TransformStore transforms;
+	transforms.resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const float angle = i * 2.3999632f;
+		float axis[3] = {std::sin(angle), std::cos(angle), 1.0f};
+		const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+			axis[2] * axis[2]);
+		const float s = std::sin(angle * 0.5f) / length;
+
+		transforms.positionX[i] = i % 7 * 3.0f - 10.0f;
+		transforms.positionY[i] = i % 5 * -2.0f;
+		transforms.positionZ[i] = i * 0.25f;
+		transforms.rotationX[i] = axis[0] * s;
+		transforms.rotationY[i] = axis[1] * s;
+		transforms.rotationZ[i] = axis[2] * s;
+		transforms.rotationW[i] = std::cos(angle * 0.5f);
+		transforms.scaleX[i] = 1.0f + i % 3;
+		transforms.scaleY[i] = 0.5f;
+		transforms.scaleZ[i] = 2.0f - i % 2;
+	}
+
+	return transforms;
+}
+
+static bool nearlyEqual(float a, float b)
+{
+	return std::fabs(a - b) <= 1e-5f * std::max(1.0f, std::fabs(b));
+}
+
+static void testComposition()
+{
+	for (size_t count = 0; count <= 37; count++)
+	{
+		const TransformStore transforms = makeTransforms(count);
+
+		for (size_t misalignment : {0, 1})
+		{
+			// Aligned for the streaming stores or one float past that
+			std::vector<float> buffer(count * 16 + 8, -1.0f);
+			float* out = buffer.data();
+			while (reinterpret_cast<uintptr_t>(out) % 16 != misalignment * 4)
+			{
+				out++;
+			}
+
+			composeModelMatrices(transforms, out);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				float expected[16];
+				referenceMatrix(transforms, i, expected);
+
+				float single[16];
+				composeModelMatrix(transforms, i, single);
+
+				for (int k = 0; k < 16; k++)
+				{
+					CHECK(nearlyEqual(out[i * 16 + k], expected[k]));
+					CHECK(nearlyEqual(single[k], expected[k]));
+				}
+			}
+
+			// Nothing written past the last matrix
+			for (float* p = out + count * 16; p < buffer.data() + buffer.size();
+			     p++)
+			{
+				CHECK(*p == -1.0f);
+			}
+		}
+	}
+}
+
+static void testRotation()
+{
+	const float angle = 0.7f;
+	const Quaternion spin = {0.0f, 0.0f, std::sin(angle * 0.5f),
+	                         std::cos(angle * 0.5f)};
+
+	for (size_t count : {1, 4, 8, 13})
+	{
+		TransformStore transforms = makeTransforms(count);
+		const TransformStore before = transforms;
+
+		rotateTransformsZ(transforms, angle);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const Quaternion rotation = {
+				before.rotationX[i], before.rotationY[i], before.rotationZ[i],
+				before.rotationW[i]
+			};
+			const Quaternion expected = multiply(rotation, spin);
+
+			CHECK(nearlyEqual(transforms.rotationX[i], expected.x));
+			CHECK(nearlyEqual(transforms.rotationY[i], expected.y));
+			CHECK(nearlyEqual(transforms.rotationZ[i], expected.z));
+			CHECK(nearlyEqual(transforms.rotationW[i], expected.w));
+			CHECK(transforms.positionX[i] == before.positionX[i]);
+			CHECK(transforms.scaleX[i] == before.scaleX[i]);
+		}
+	}
+}
+
+int main()
+{
+	testComposition();
+	testRotation();
+
+	return checkResult("transform_store_test");
+}
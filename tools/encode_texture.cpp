@@ -0,0 +1,298 @@
+// Offline texture encoder
+//
+// Turns a JPG, PNG or any image stb_image reads into a KTX2 file of BC1, BC3
+// or BC7 blocks with its full mip chain, which VulkanCube --texture uploads
+// as is. The blocks of every level are encoded on all the cores.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tools/encode_texture.cpp -o encode_texture -pthread
+// or add this file alone to an empty console project.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+#define BC_ENCODER_IMPLEMENTATION
+#include "../include/bc_encoder.h"
+#define KTX2_IMPLEMENTATION
+#include "../include/ktx2.h"
+
+struct Level
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> rgba;
+};
+
+static float srgbToLinear(uint8_t value)
+{
+	const float c = value / 255.0f;
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static uint8_t linearToSrgb(float value)
+{
+	const float c = value <= 0.0031308f
+		                ? value * 12.92f
+		                : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+	return static_cast<uint8_t>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f +
+		0.5f);
+}
+
+// Next level, each texel the average of 2x2 texels of this one. Color is
+// averaged in linear space for sRGB data, alpha always as is
+static Level downsample(const Level& source, bool srgb)
+{
+	Level level;
+	level.width = std::max(source.width / 2, 1u);
+	level.height = std::max(source.height / 2, 1u);
+	level.rgba.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+	float toLinear[256];
+	for (int i = 0; i < 256; i++)
+	{
+		toLinear[i] = srgb ? srgbToLinear(static_cast<uint8_t>(i)) : i / 255.0f;
+	}
+
+	for (uint32_t y = 0; y < level.height; y++)
+	{
+		for (uint32_t x = 0; x < level.width; x++)
+		{
+			const uint32_t xs[2] = {
+				std::min(x * 2, source.width - 1),
+				std::min(x * 2 + 1, source.width - 1)
+			};
+			const uint32_t ys[2] = {
+				std::min(y * 2, source.height - 1),
+				std::min(y * 2 + 1, source.height - 1)
+			};
+
+			float sum[4] = {};
+			for (uint32_t sy : ys)
+			{
+				for (uint32_t sx : xs)
+				{
+					const uint8_t* texel = &source.rgba[(static_cast<size_t>(sy)
+						* source.width + sx) * 4];
+					for (int c = 0; c < 3; c++)
+					{
+						sum[c] += toLinear[texel[c]];
+					}
+					sum[3] += texel[3] / 255.0f;
+				}
+			}
+
+			uint8_t* out = &level.rgba[(static_cast<size_t>(y) * level.width +
+				x) * 4];
+			for (int c = 0; c < 3; c++)
+			{
+				out[c] = srgb
+					         ? linearToSrgb(sum[c] * 0.25f)
+					         : static_cast<uint8_t>(sum[c] * 0.25f * 255.0f +
+						         0.5f);
+			}
+			out[3] = static_cast<uint8_t>(sum[3] * 0.25f * 255.0f + 0.5f);
+		}
+	}
+
+	return level;
+}
+
+static void printUsage()
+{
+	std::cout << "Usage: encode_texture <input> <output.ktx2> [options]" <<
+		std::endl
+		<< "  --format <bc1|bc3|bc7>  block format (default bc7)" << std::endl
+		<< "  --linear                data is not sRGB color, e.g. normals" <<
+		std::endl
+		<< "  --threads <n>           encoding threads (default all cores)" <<
+		std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	const std::string input = argv[1];
+	const std::string output = argv[2];
+	std::string format = "bc7";
+	bool srgb = true;
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 3; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--format" && hasValue)
+		{
+			format = argv[++i];
+		}
+		else if (arg == "--linear")
+		{
+			srgb = false;
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			threadCount = std::max(1ul, std::stoul(argv[++i]));
+		}
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	uint32_t vkFormat;
+	void (*encodeBlock)(const uint8_t*, uint8_t*);
+	if (format == "bc1")
+	{
+		vkFormat = srgb ? KTX2_FORMAT_BC1_RGB_SRGB : KTX2_FORMAT_BC1_RGB_UNORM;
+		encodeBlock = encodeBC1Block;
+	}
+	else if (format == "bc3")
+	{
+		vkFormat = srgb ? KTX2_FORMAT_BC3_SRGB : KTX2_FORMAT_BC3_UNORM;
+		encodeBlock = encodeBC3Block;
+	}
+	else if (format == "bc7")
+	{
+		vkFormat = srgb ? KTX2_FORMAT_BC7_SRGB : KTX2_FORMAT_BC7_UNORM;
+		encodeBlock = encodeBC7Block;
+	}
+	else
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(input.c_str(), &width, &height, &channels,
+	                            STBI_rgb_alpha);
+	if (!pixels)
+	{
+		std::cerr << "Failed to load " << input << ": " <<
+			stbi_failure_reason() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Level> levels(1);
+	levels[0].width = static_cast<uint32_t>(width);
+	levels[0].height = static_cast<uint32_t>(height);
+	levels[0].rgba.assign(pixels, pixels + static_cast<size_t>(width) *
+	                      height * 4);
+	stbi_image_free(pixels);
+
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		levels.push_back(downsample(levels.back(), srgb));
+	}
+
+	// Every block of every level in one list, taken in order by the threads
+	struct BlockRow
+	{
+		uint32_t level;
+		uint32_t y;
+	};
+	std::vector<BlockRow> rows;
+	std::vector<std::vector<uint8_t>> encoded(levels.size());
+	const uint32_t blockSize = ktx2BlockSize(vkFormat);
+
+	for (uint32_t level = 0; level < levels.size(); level++)
+	{
+		const uint32_t blocksX = (levels[level].width + 3) / 4;
+		const uint32_t blocksY = (levels[level].height + 3) / 4;
+		encoded[level].resize(static_cast<size_t>(blocksX) * blocksY *
+		                      blockSize);
+
+		for (uint32_t y = 0; y < blocksY; y++)
+		{
+			rows.push_back({level, y});
+		}
+	}
+
+	std::atomic<size_t> nextRow{0};
+	auto encodeRows = [&]
+	{
+		for (size_t row = nextRow++; row < rows.size(); row = nextRow++)
+		{
+			const Level& level = levels[rows[row].level];
+			const uint32_t blocksX = (level.width + 3) / 4;
+			uint8_t* out = &encoded[rows[row].level][static_cast<size_t>(
+				rows[row].y) * blocksX * blockSize];
+
+			for (uint32_t bx = 0; bx < blocksX; bx++, out += blockSize)
+			{
+				// Texels past the edge repeat the last row or column
+				uint8_t texels[16 * 4];
+				for (uint32_t i = 0; i < 16; i++)
+				{
+					const uint32_t x = std::min(bx * 4 + i % 4, level.width - 1);
+					const uint32_t y = std::min(rows[row].y * 4 + i / 4,
+					                            level.height - 1);
+					memcpy(&texels[i * 4], &level.rgba[(static_cast<size_t>(y) *
+						       level.width + x) * 4], 4);
+				}
+
+				encodeBlock(texels, out);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		threads.emplace_back(encodeRows);
+	}
+	encodeRows();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	const std::vector<uint8_t> file = ktx2Write(
+		vkFormat, levels[0].width, levels[0].height, encoded);
+
+	std::ofstream stream(output, std::ios::binary);
+	stream.write(reinterpret_cast<const char*>(file.data()),
+	             static_cast<std::streamsize>(file.size()));
+	if (!stream)
+	{
+		std::cerr << "Failed to write " << output << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	size_t rgbaSize = 0;
+	for (const Level& level : levels)
+	{
+		rgbaSize += level.rgba.size();
+	}
+
+	const auto endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << input << " " << levels[0].width << "x" << levels[0].height <<
+		" -> " << output << ": " << format << (srgb ? " sRGB" : " linear") <<
+		", " << levels.size() << " levels, " << file.size() << " bytes (" <<
+		static_cast<double>(rgbaSize) / file.size() << "x smaller than RGBA8), "
+		<< std::chrono::duration<double, std::milli>(endTime - startTime).
+		count() << " ms on " << threadCount << " threads" << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+// Asset packer
+//
+// Packs the shaders, textures and meshes VulkanCube loads into one archive,
+// which VulkanCube --archive maps instead of opening each file. Entries are
+// named by the paths given, the way the sample opens them, so run it from the
+// repository root. With --lz4, SPIR-V, meshes and other files are LZ4
+// compressed when that saves an eighth of their size at least; KTX2 levels
+// are left as they are to be copied straight from the mapping, JPG and PNG
+// are compressed already.
+//
+// Build from the repository root with e.g.
+//     g++ -std=c++17 -O2 tools/pack_assets.cpp -o pack_assets
+// or add this file alone to an empty console project.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#define ASSET_ARCHIVE_IMPLEMENTATION
+#include "../include/asset_archive.h"
+
+static bool hasExtension(const std::string& name, const char* extension)
+{
+	const size_t length = strlen(extension);
+	if (name.size() < length)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < length; i++)
+	{
+		const char c = name[name.size() - length + i];
+		if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != extension[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static uint32_t assetFormat(const std::string& name)
+{
+	if (hasExtension(name, ".spv"))
+	{
+		return ASSET_FORMAT_SPIRV;
+	}
+	if (hasExtension(name, ".ktx2"))
+	{
+		return ASSET_FORMAT_KTX2;
+	}
+	if (hasExtension(name, ".jpg") || hasExtension(name, ".jpeg") ||
+		hasExtension(name, ".png"))
+	{
+		return ASSET_FORMAT_IMAGE;
+	}
+	if (hasExtension(name, ".obj") || hasExtension(name, ".glb"))
+	{
+		return ASSET_FORMAT_MESH;
+	}
+	return ASSET_FORMAT_RAW;
+}
+
+static const char* formatName(uint32_t format)
+{
+	switch (format)
+	{
+	case ASSET_FORMAT_SPIRV:
+		return "spirv";
+	case ASSET_FORMAT_KTX2:
+		return "ktx2";
+	case ASSET_FORMAT_IMAGE:
+		return "image";
+	case ASSET_FORMAT_MESH:
+		return "mesh";
+	default:
+		return "raw";
+	}
+}
+
+static void printUsage()
+{
+	std::cout << "Usage: pack_assets <out.pak> [--lz4] <file>..." << std::endl
+		<< "  --lz4   compress the entries that gain from it" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	std::string output;
+	bool lz4 = false;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+
+		if (arg == "--lz4")
+		{
+			lz4 = true;
+		}
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		else if (output.empty())
+		{
+			output = arg;
+		}
+		else
+		{
+			inputs.push_back(arg);
+		}
+	}
+
+	if (output.empty() || inputs.empty())
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	std::vector<AssetSource> sources;
+	uint64_t inputSize = 0;
+
+	for (const std::string& input : inputs)
+	{
+		std::ifstream file(input, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Cannot open " << input << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		AssetSource source;
+		source.name = input;
+		std::replace(source.name.begin(), source.name.end(), '\\', '/');
+		if (source.name.compare(0, 2, "./") == 0)
+		{
+			source.name.erase(0, 2);
+		}
+
+		for (const AssetSource& other : sources)
+		{
+			if (other.name == source.name)
+			{
+				std::cerr << source.name << " given twice" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+
+		source.format = assetFormat(source.name);
+		source.compression = ASSET_COMPRESSION_NONE;
+		source.payload.assign(std::istreambuf_iterator<char>(file),
+		                      std::istreambuf_iterator<char>());
+		source.uncompressedSize = source.payload.size();
+		inputSize += source.payload.size();
+
+		if (lz4 && source.format != ASSET_FORMAT_KTX2 && source.format !=
+			ASSET_FORMAT_IMAGE)
+		{
+			std::vector<uint8_t> compressed = lz4Compress(
+				source.payload.data(), source.payload.size());
+
+			if (compressed.size() <= source.payload.size() - source.payload.
+				size() / 8)
+			{
+				source.payload = std::move(compressed);
+				source.compression = ASSET_COMPRESSION_LZ4;
+			}
+		}
+
+		printf("  %-40s %-6s %10llu -> %10llu%s\n", source.name.c_str(),
+		       formatName(source.format),
+		       static_cast<unsigned long long>(source.uncompressedSize),
+		       static_cast<unsigned long long>(source.payload.size()),
+		       source.compression == ASSET_COMPRESSION_LZ4 ? " lz4" : "");
+
+		sources.push_back(std::move(source));
+	}
+
+	const size_t entryCount = sources.size();
+	const std::vector<uint8_t> archive = assetWriteArchive(std::move(sources));
+
+	std::ofstream out(output, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(archive.data()),
+	          static_cast<std::streamsize>(archive.size()));
+
+	if (!out)
+	{
+		std::cerr << "Cannot write " << output << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const auto endTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << output << ": " << entryCount << " entries, " <<
+		inputSize / 1024 << " KiB packed in " << archive.size() / 1024 <<
+		" KiB in " << std::chrono::duration<double, std::milli>(
+			endTime - startTime).count() << " ms" << std::endl;
+
+	return EXIT_SUCCESS;
+}